@@ -0,0 +1,106 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/* Blocking multi-producer, multi-consumer FIFO with a fixed capacity
+ *
+ * `push` blocks while the queue is full, which is how backpressure travels
+ * upstream.  After `close`, pushes fail and pops drain what is left before
+ * failing.
+ */
+template <typename T>
+class BoundedQueue {
+   public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->not_full.wait(lock, [this] {
+            return this->closed || this->items.size() < this->capacity;
+        });
+        if (this->closed) {
+            return false;
+        }
+        this->items.push_back(std::move(item));
+        lock.unlock();
+        this->not_empty.notify_one();
+        return true;
+    }
+
+    // Non-blocking push; `item` is left untouched when the queue is full
+    bool try_push(T& item) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->closed || this->items.size() >= this->capacity) {
+            return false;
+        }
+        this->items.push_back(std::move(item));
+        lock.unlock();
+        this->not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->not_empty.wait(
+            lock, [this] { return this->closed || !this->items.empty(); });
+        if (this->items.empty()) {
+            return false;
+        }
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        lock.unlock();
+        this->not_full.notify_one();
+        return true;
+    }
+
+    /* Wait for at least one item, then take up to `max_items`
+     *
+     * Returns the number of items appended to `out`; 0 once closed and empty.
+     */
+    size_t pop_batch(std::vector<T>& out, size_t max_items) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->not_empty.wait(
+            lock, [this] { return this->closed || !this->items.empty(); });
+        size_t count = 0;
+        while (count < max_items && !this->items.empty()) {
+            out.push_back(std::move(this->items.front()));
+            this->items.pop_front();
+            ++count;
+        }
+        lock.unlock();
+        if (count > 0) {
+            this->not_full.notify_all();
+        }
+        return count;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->closed = true;
+        }
+        this->not_full.notify_all();
+        this->not_empty.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->items.size();
+    }
+
+   private:
+    const size_t capacity;
+    bool closed;
+    std::deque<T> items;
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+#endif /* BOUNDED_QUEUE_HPP */
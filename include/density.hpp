@@ -0,0 +1,40 @@
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+#include "types.hpp"
+
+class ThreadPool;
+
+/* Axis-aligned binning of world space into a width x height image
+ *
+ * Bin (0, 0) starts at (origin_x, origin_y) and bins are `bin_size` world
+ * units square.  Points outside the image are ignored.
+ */
+struct DensityBins {
+    float origin_x;
+    float origin_y;
+    float bin_size;
+    int width;
+    int height;
+};
+
+/* Add the number of points falling in each bin to `counts`
+ *
+ * `counts` is row-major with width * height entries and is accumulated into,
+ * not cleared.  Bin coordinates are computed four points at a time with SSE
+ * where available.
+ */
+void bin_density(
+    const cv::Point2f* pts, size_t n, const DensityBins& bins, u32* counts);
+// Parallel variant: points are split into slices with private histograms
+void bin_density(
+    const cv::Point2f* pts,
+    size_t n,
+    const DensityBins& bins,
+    u32* counts,
+    ThreadPool&);
+
+#endif /* DENSITY_HPP */
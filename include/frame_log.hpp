@@ -0,0 +1,164 @@
+#ifndef FRAME_LOG_HPP
+#define FRAME_LOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "frame logs are read in place and assume a little-endian host"
+#endif
+
+/* Append-only log of timestamped keypoint frames
+ *
+ * Layout, all little-endian:
+ *
+ *   FrameLogHeader (64 bytes)
+ *   frames, each a FrameRecord followed by `count` cv::Point2f
+ *   index: one FrameLogEntry per frame, written by FrameLogWriter::close
+ *
+ * Frames are appended in timestamp order and never rewritten.  The index at
+ * the end lets a reader seek by timestamp with a binary search; a log whose
+ * writer never closed it has no index and is recovered by scanning the frames.
+ */
+struct FrameLogHeader {
+    char magic[8];
+    u32 version;
+    u32 flags;
+    // 0 until the writer is closed
+    u64 index_offset;
+    u64 frame_count;
+    u8 padding[32];
+};
+static_assert(sizeof(FrameLogHeader) == 64, "header layout");
+
+struct FrameRecord {
+    u64 timestamp_ns;
+    u32 count;
+    u32 reserved;
+};
+static_assert(sizeof(FrameRecord) == 16, "record layout");
+
+struct FrameLogEntry {
+    u64 timestamp_ns;
+    // Byte offset of the frame's FrameRecord
+    u64 offset;
+};
+
+constexpr char kFrameLogMagic[8] = {'F', 'R', 'A', 'M', 'E', 'L', 'O', 'G'};
+constexpr u32 kFrameLogVersion = 1;
+
+// One frame, pointing into the mapped log
+struct FrameView {
+    u64 timestamp_ns;
+    const cv::Point2f* points;
+    size_t count;
+};
+
+class FrameLogWriter {
+   public:
+    FrameLogWriter();
+    ~FrameLogWriter();
+    FrameLogWriter(const FrameLogWriter&) = delete;
+    FrameLogWriter& operator=(const FrameLogWriter&) = delete;
+
+    bool open(const std::string& path);
+    // False on I/O errors or a timestamp older than the previous frame's
+    bool append(u64 timestamp_ns, const cv::Point2f* pts, size_t n);
+    bool append(u64 timestamp_ns, const std::vector<cv::Point2f>& pts);
+    // Write the index and finish the header
+    bool close();
+    size_t size() const;
+
+   private:
+    std::FILE* file;
+    bool failed;
+    u64 offset;
+    std::vector<FrameLogEntry> index;
+};
+
+/* Read-only memory mapping of a frame log
+ *
+ * Frames are served in place.  Reading with `next` walks the log in order and
+ * keeps the OS reading ahead of the cursor, so sequential replay is bounded
+ * by disk bandwidth rather than page-fault latency.
+ */
+class FrameLogReader {
+   public:
+    FrameLogReader();
+    ~FrameLogReader();
+    FrameLogReader(const FrameLogReader&) = delete;
+    FrameLogReader& operator=(const FrameLogReader&) = delete;
+
+    // False if the file is missing or not a frame log
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const;
+    u64 timestamp(size_t i) const;
+    // `points` is nullptr if the index entry does not point at a whole frame
+    FrameView frame(size_t i) const;
+    // First frame with a timestamp >= `timestamp_ns`; size() if none
+    size_t find(u64 timestamp_ns) const;
+
+    // Position the cursor at frame `i`
+    void seek(size_t i);
+    size_t tell() const;
+    // Frame at the cursor, advancing it; false at the end, which a damaged
+    // index entry also is
+    bool next(FrameView& out);
+
+   private:
+    const u8* base;
+    size_t length;
+    const FrameLogEntry* entries;
+    size_t count;
+    // End of the frame data: the index, or the end of a log without one
+    size_t frames_end;
+    // Index rebuilt by scanning when the log has none
+    std::vector<FrameLogEntry> scanned;
+    size_t cursor;
+    // Byte offset up to which read-ahead has been requested
+    size_t prefetched;
+
+    bool record_at(const FrameLogEntry& entry, FrameRecord& out) const;
+    void scan();
+    void read_ahead(size_t offset);
+};
+
+/* Replays a frame log against the wall clock
+ *
+ * Log time advances at `speed` times real time from the point of the last
+ * seek or speed change; a speed of 0 pauses and an infinite speed makes every
+ * remaining frame due at once.  Callers poll `next` each iteration and either
+ * consume every due frame (a processing pipeline) or keep only the last one
+ * (a display).
+ */
+class FramePlayer {
+   public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit FramePlayer(FrameLogReader& log);
+    void set_speed(double speed, Clock::time_point now);
+    double speed() const;
+    // Continue from the first frame at or after `timestamp_ns`
+    void seek(u64 timestamp_ns, Clock::time_point now);
+    // Log time shown at `now`
+    u64 position(Clock::time_point now) const;
+    // Next frame that is due at `now`; false if none is due yet
+    bool next(Clock::time_point now, FrameView& out);
+    bool finished() const;
+
+   private:
+    FrameLogReader& log;
+    double rate;
+    Clock::time_point anchor_wall;
+    u64 anchor_log;
+};
+
+#endif /* FRAME_LOG_HPP */
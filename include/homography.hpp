@@ -0,0 +1,75 @@
+#ifndef HOMOGRAPHY_HPP
+#define HOMOGRAPHY_HPP
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "transform.hpp"
+#include "types.hpp"
+
+/* RANSAC settings for homography estimation
+ *
+ * `reproj_threshold` is the maximum distance, in world units, between a mapped
+ * local point and its world correspondence for the pair to count as an inlier.
+ * The iteration count adapts to the best inlier ratio seen so far and is capped
+ * by `max_iterations`.
+ */
+struct RansacParams {
+    float reproj_threshold = 3.0f;
+    float confidence = 0.995f;
+    int max_iterations = 2000;
+    u64 seed = 0x9e3779b97f4a7c15ull;
+};
+
+/* 2D projective transform
+ *
+ * Same column-major layout as Transform2d, but the third row is not assumed to
+ * be (0, 0, 1), so mapped points are divided by their homogeneous coordinate.
+ * The matrix is normalized so that its last element is 1.0 whenever possible.
+ *
+ * Ordering: [h00, h10, h20, h01, h11, h21, h02, h12, h22]
+ */
+class Homography2d {
+   public:
+    Homography2d();
+    Homography2d(const SqMatrix3);
+    // Least-squares fit mapping `local` onto `world` (4 or more pairs)
+    static Homography2d from_correspondences(
+        const std::vector<cv::Point2f>& local,
+        const std::vector<cv::Point2f>& world);
+    // Robust fit; `inlier_mask` (optional) receives 1 for inliers, 0 otherwise
+    static Homography2d from_correspondences_ransac(
+        const std::vector<cv::Point2f>& local,
+        const std::vector<cv::Point2f>& world,
+        const RansacParams& params = RansacParams(),
+        std::vector<u8>* inlier_mask = nullptr);
+    static Homography2d from_correspondences_ransac(
+        const std::vector<cv::Point2f>& local,
+        const std::vector<cv::Point2f>& world,
+        const RansacParams& params,
+        std::vector<u8>* inlier_mask,
+        ThreadPool&);
+    // world-to-image or image-to-plane
+    cv::Point2f world_to_local(const cv::Point2f) const;
+    // image-to-world or plane-to-image
+    cv::Point2f local_to_world(const cv::Point2f) const;
+    // Batch variants over `n` points, serial or split across a pool
+    void world_to_local(const cv::Point2f*, cv::Point2f*, size_t) const;
+    void world_to_local(
+        const cv::Point2f*, cv::Point2f*, size_t, ThreadPool&) const;
+    void local_to_world(const cv::Point2f*, cv::Point2f*, size_t) const;
+    void local_to_world(
+        const cv::Point2f*, cv::Point2f*, size_t, ThreadPool&) const;
+    const SqMatrix3& matrix() const;
+    std::string to_string() const;
+
+   private:
+    SqMatrix3 data;
+    SqMatrix3 inv_data;
+    static SqMatrix3 inv(const SqMatrix3);
+    static cv::Point2f mul(const SqMatrix3&, const cv::Point2f);
+    static void mul(
+        const SqMatrix3&, const cv::Point2f*, cv::Point2f*, size_t);
+};
+
+#endif /* HOMOGRAPHY_HPP */
@@ -0,0 +1,69 @@
+#ifndef INCREMENTAL_FIT_HPP
+#define INCREMENTAL_FIT_HPP
+
+#include <deque>
+#include <opencv2/core.hpp>
+
+#include "line_fit.hpp"
+#include "transform.hpp"
+
+/* Window and change thresholds for SlidingLineFit
+ *
+ * The window keeps at most `max_points` points and drops points older than
+ * `max_age` seconds; a value of 0 disables that bound.  The transform is
+ * rebuilt only when the fitted direction turns by more than `angle_tolerance`
+ * radians or the line shifts sideways by more than `offset_tolerance`.
+ */
+struct SlidingFitParams {
+    size_t max_points = 256;
+    double max_age = 0.0;
+    float angle_tolerance = 1e-3f;
+    float offset_tolerance = 0.5f;
+};
+
+/* Incremental line fit over a sliding window of arriving points
+ *
+ * Line-fit moments are updated in O(1) per point added or evicted.  The
+ * Transform2d (and with it the matrix inverse) is only rebuilt when the fit
+ * changes materially, so steady scanning costs a few flops per point.
+ *
+ * The origin follows the visualizer's convention: the reference point, which
+ * defaults to the first point ever added, projected onto the fitted line.
+ */
+class SlidingLineFit {
+   public:
+    explicit SlidingLineFit(const SlidingFitParams& = SlidingFitParams());
+
+    // Returns true if the transform was rebuilt by this point
+    bool add(const cv::Point2f pt, const double timestamp);
+    void set_reference(const cv::Point2f);
+    void clear();
+
+    // Latest transform; identity until two distinct points have arrived
+    const Transform2d& transform() const;
+    bool has_transform() const;
+    // Line the current transform was built from
+    cv::Vec4f transform_fit() const;
+    size_t size() const;
+
+   private:
+    struct Sample {
+        cv::Point2f pt;
+        double timestamp;
+    };
+
+    SlidingFitParams params;
+    std::deque<Sample> window;
+    LineMoments moments;
+    size_t evictions_since_refresh;
+    bool have_reference;
+    cv::Point2f reference;
+    bool have_transform;
+    cv::Vec4f fitted;
+    Transform2d tform;
+
+    void evict_front();
+    bool fit_changed(const cv::Vec4f) const;
+};
+
+#endif /* INCREMENTAL_FIT_HPP */
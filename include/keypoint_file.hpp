@@ -0,0 +1,96 @@
+#ifndef KEYPOINT_FILE_HPP
+#define KEYPOINT_FILE_HPP
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+class ThreadPool;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "keypoint files are read in place and assume a little-endian host"
+#endif
+
+/* Binary keypoint file, structure of arrays
+ *
+ * Layout, all little-endian:
+ *
+ *   KeypointFileHeader (64 bytes)
+ *   `count` f32 x coordinates at `x_offset`
+ *   `count` f32 y coordinates at `y_offset`
+ *
+ * Both columns start on a 64-byte boundary, so a mapped file can be handed to
+ * the structure-of-arrays Transform2d kernels as is.
+ */
+struct KeypointFileHeader {
+    char magic[8];
+    u32 version;
+    u32 flags;
+    u64 count;
+    u64 x_offset;
+    u64 y_offset;
+    u8 padding[24];
+};
+static_assert(sizeof(KeypointFileHeader) == 64, "header layout");
+
+constexpr char kKeypointFileMagic[8] = {'K', 'E', 'Y', 'P', 'T', '2', 'D', '\n'};
+constexpr u32 kKeypointFileVersion = 1;
+
+/* Read-only memory mapping of a keypoint file
+ *
+ * Opening only maps the file and checks the header; pages are read in by the
+ * OS as the columns are first touched, so opening is constant time whatever
+ * the size.  The columns stay valid until `close`.
+ */
+class KeypointFile {
+   public:
+    KeypointFile();
+    ~KeypointFile();
+    KeypointFile(const KeypointFile&) = delete;
+    KeypointFile& operator=(const KeypointFile&) = delete;
+
+    // False if the file is missing, truncated or not a keypoint file
+    bool open(const std::string& path);
+    void close();
+    // Hint that points [first, last) are about to be read
+    void prefetch(size_t first, size_t last) const;
+
+    size_t size() const;
+    const float* xs() const;
+    const float* ys() const;
+    cv::Point2f at(size_t i) const;
+
+    static bool write(
+        const std::string& path, const float* xs, const float* ys, size_t n);
+    static bool write(
+        const std::string& path, const cv::Point2f* pts, size_t n);
+
+   private:
+    const u8* base;
+    size_t length;
+    const float* x;
+    const float* y;
+    size_t count;
+};
+
+/* Parse keypoints from CSV or whitespace-separated text
+ *
+ * One "x,y" (or "x y", "x;y", "x<TAB>y") pair per line; further columns are
+ * ignored, as are blank lines, lines starting with '#' and a header line that
+ * does not start with a number.  The file is mapped and split at line breaks
+ * into one chunk per pool thread, and the chunks are parsed in parallel with
+ * std::from_chars.  Returns false if the file cannot be read or a line is not
+ * a pair of numbers.
+ */
+bool parse_keypoints_text(
+    const std::string& path, std::vector<cv::Point2f>& out, ThreadPool& pool);
+
+/* Load keypoints from a binary keypoint file, falling back to text
+ */
+bool load_keypoints(
+    const std::string& path, std::vector<cv::Point2f>& out, ThreadPool& pool);
+
+#endif /* KEYPOINT_FILE_HPP */
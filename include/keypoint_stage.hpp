@@ -0,0 +1,75 @@
+#ifndef KEYPOINT_STAGE_HPP
+#define KEYPOINT_STAGE_HPP
+
+#include <opencv2/core.hpp>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "transform.hpp"
+#include "types.hpp"
+
+/* One frame of detected keypoints, in image coordinates
+ *
+ * As in the visualizer, the first keypoint is the reference point that sets
+ * the origin of the fitted coordinate system.
+ */
+struct KeypointFrame {
+    u64 id = 0;
+    double timestamp = 0.0;
+    std::vector<cv::Point2f> keypoints;
+};
+
+/* A frame mapped to fitted (rejection, projection) coordinates
+ *
+ * `local` holds one entry per input keypoint, in input order.  `valid` is
+ * false when the frame had fewer than two keypoints to fit.
+ */
+struct LocalFrame {
+    u64 id = 0;
+    double timestamp = 0.0;
+    bool valid = false;
+    cv::Vec4f line_fit;
+    Transform2d tform;
+    std::vector<cv::Point2f> local;
+};
+
+/* Streaming keypoint-to-local stage
+ *
+ * Runs the visualizer's per-frame flow (fit a line, build the Transform2d,
+ * map the keypoints) on a pool.  A dispatcher thread takes up to `max_batch`
+ * queued frames at a time and processes them in parallel; results leave in
+ * submission order.  Both queues are bounded, so a slow consumer blocks the
+ * dispatcher, which in turn blocks `push`: memory use is capped at roughly
+ * 2 * capacity + max_batch frames no matter how bursty the input is.
+ */
+class KeypointStage {
+   public:
+    KeypointStage(ThreadPool&, size_t capacity = 64, size_t max_batch = 16);
+    ~KeypointStage();
+    KeypointStage(const KeypointStage&) = delete;
+    KeypointStage& operator=(const KeypointStage&) = delete;
+
+    // Blocks while the input queue is full; false after close()
+    bool push(KeypointFrame frame);
+    // Non-blocking; false (frame untouched) when full or closed
+    bool try_push(KeypointFrame& frame);
+    // Blocks for the next result; false once closed and fully drained
+    bool pop(LocalFrame& out);
+    // Stop accepting input; queued frames are still processed
+    void close();
+
+    // Frame-level work, also usable without the stage
+    static LocalFrame process(KeypointFrame frame, ThreadPool* pool = nullptr);
+
+   private:
+    ThreadPool& pool;
+    const size_t max_batch;
+    BoundedQueue<KeypointFrame> input;
+    BoundedQueue<LocalFrame> output;
+    std::thread dispatcher;
+
+    void run();
+};
+
+#endif /* KEYPOINT_STAGE_HPP */
@@ -0,0 +1,50 @@
+#ifndef LINE_FIT_HPP
+#define LINE_FIT_HPP
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include <vector>
+
+class ThreadPool;
+
+/* Running first and second moments of a 2D point set
+ *
+ * Kept as count, mean and centered sums of squares so points can be added,
+ * removed and partial results merged without losing precision far from the
+ * origin.  The fitted line matches cv::fitLine with cv::DIST_L2.
+ */
+struct LineMoments {
+    double n = 0.0;
+    double mean_x = 0.0;
+    double mean_y = 0.0;
+    double sxx = 0.0;
+    double syy = 0.0;
+    double sxy = 0.0;
+
+    void add(const cv::Point2f);
+    void remove(const cv::Point2f);
+    void merge(const LineMoments&);
+    // (vx, vy, x0, y0) with a unit direction, oriented so vy >= 0
+    cv::Vec4f fit() const;
+};
+
+// Total least-squares line through the points, as (vx, vy, x0, y0)
+cv::Vec4f fit_line(const cv::Point2f* pts, size_t n);
+cv::Vec4f fit_line(const cv::Point2f* pts, size_t n, ThreadPool&);
+cv::Vec4f fit_line(const std::vector<cv::Point2f>&);
+
+/* Signed perpendicular distance of each point from a fitted line
+ *
+ * The sign matches the x (rejection) coordinate of the Transform2d built from
+ * the same line fit.
+ */
+void line_residuals(
+    const cv::Vec4f line, const cv::Point2f* pts, float* out, size_t n);
+void line_residuals(
+    const cv::Vec4f line,
+    const cv::Point2f* pts,
+    float* out,
+    size_t n,
+    ThreadPool&);
+
+#endif /* LINE_FIT_HPP */
@@ -0,0 +1,52 @@
+#ifndef LOCAL_COORD_CACHE_HPP
+#define LOCAL_COORD_CACHE_HPP
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "transform.hpp"
+#include "types.hpp"
+
+class ThreadPool;
+
+/* Local coordinates of a point set under one transform, kept up to date
+ *
+ * The cache is keyed on a (dataset, transform) pair: the dataset by its
+ * pointer, size and a caller-supplied version, the transform by its matrix.
+ * Rebinding either to something different makes the whole set stale, and
+ * `update` then maps it through the batch world-to-local kernel; a pass where
+ * neither changed costs a flag check.
+ *
+ * The cache does not own the world points; they must stay alive and in place
+ * until the next `set_points`.
+ */
+class LocalCoordCache {
+   public:
+    LocalCoordCache();
+    // Bind a dataset; a different pointer, size or version invalidates all
+    void set_points(const cv::Point2f* pts, size_t n, u64 version);
+    // A transform with a different matrix invalidates all
+    void set_transform(const Transform2d& tform);
+
+    /* Map the points if stale, serially or split across a pool
+     *
+     * Returns the number of points mapped, 0 when the cache was current.
+     */
+    size_t update();
+    size_t update(ThreadPool& pool);
+
+    size_t size() const;
+    // Local coordinates, in the order of the bound dataset
+    const std::vector<cv::Point2f>& local() const;
+
+   private:
+    const cv::Point2f* world;
+    size_t count;
+    u64 version;
+    Transform2d tform;
+    std::vector<cv::Point2f> coords;
+    bool stale;
+};
+
+#endif /* LOCAL_COORD_CACHE_HPP */
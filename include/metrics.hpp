@@ -0,0 +1,201 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+/* Operational metrics: counters and latency histograms
+ *
+ *   static const MetricCounter calls = MetricsRegistry::global().counter(
+ *       "widget_calls_total", "Widget calls");
+ *   calls.add();
+ *
+ * Every thread that records gets its own shard holding a slot for each
+ * counter and histogram; only that thread ever writes it, so recording is a
+ * plain load and store to memory the thread already owns, with no atomic
+ * read-modify-write and no sharing of cache lines between threads.  A
+ * snapshot adds the shards up.  A thread's shard is folded into the totals
+ * when the thread exits and is then reused by the next new thread.
+ *
+ * Histograms are log-linear in the style of HdrHistogram: values below
+ * 2^kHistogramSubBits are exact, larger ones fall into one of
+ * 2^kHistogramSubBits sub-buckets per power of two, so any reported quantile
+ * is within about 6% of the recorded value.  Latencies are recorded in
+ * nanoseconds and exported in seconds.
+ *
+ * Registering the same name and labels twice returns the same metric.  Past
+ * kMaxCounters counters or kMaxHistograms histograms, registration returns a
+ * metric that records into a slot no snapshot reports.
+ */
+
+constexpr size_t kMaxCounters = 64;
+constexpr size_t kMaxHistograms = 8;
+constexpr int kHistogramSubBits = 4;
+// Sub-bucket rows cover values up to 2^40 ns, about 18 minutes
+constexpr int kHistogramMaxBits = 40;
+constexpr size_t kHistogramBuckets =
+    ((size_t)(kHistogramMaxBits - kHistogramSubBits) + 1) << kHistogramSubBits;
+
+// Bucket of `value`; values beyond the range go to the last bucket
+inline size_t histogram_bucket(u64 value) {
+    constexpr u64 sub_count = (u64)1 << kHistogramSubBits;
+    if (value < sub_count) {
+        return (size_t)value;
+    }
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - kHistogramSubBits;
+    const size_t bucket = ((size_t)(shift + 1) << kHistogramSubBits) +
+                          (size_t)((value >> shift) & (sub_count - 1));
+    return bucket < kHistogramBuckets ? bucket : kHistogramBuckets - 1;
+}
+
+// Smallest and largest value in `bucket`
+u64 histogram_bucket_low(size_t bucket);
+u64 histogram_bucket_high(size_t bucket);
+
+/* One thread's slots
+ *
+ * The last slot of each kind is the overflow sink.
+ */
+struct MetricsShard {
+    std::atomic<u64> counters[kMaxCounters + 1];
+    std::atomic<u64> counts[kMaxHistograms + 1][kHistogramBuckets];
+    std::atomic<u64> sums[kMaxHistograms + 1];
+    bool in_use;
+};
+
+// Calling thread's shard, attached on first use
+MetricsShard* attach_metrics_shard();
+extern thread_local MetricsShard* tl_metrics_shard;
+
+inline MetricsShard* metrics_shard() {
+    MetricsShard* shard = tl_metrics_shard;
+    return __builtin_expect(shard != nullptr, 1) ? shard : attach_metrics_shard();
+}
+
+// Single-writer increment: only the owning thread stores to its shard
+inline void metrics_add(std::atomic<u64>& slot, const u64 n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class MetricCounter {
+   public:
+    explicit MetricCounter(size_t slot = kMaxCounters) : slot(slot) {}
+    void add(u64 n = 1) const { metrics_add(metrics_shard()->counters[this->slot], n); }
+
+   private:
+    size_t slot;
+};
+
+class MetricHistogram {
+   public:
+    explicit MetricHistogram(size_t slot = kMaxHistograms) : slot(slot) {}
+    void record(u64 value) const {
+        MetricsShard* shard = metrics_shard();
+        metrics_add(shard->counts[this->slot][histogram_bucket(value)], 1);
+        metrics_add(shard->sums[this->slot], value);
+    }
+
+   private:
+    size_t slot;
+};
+
+// Records the nanoseconds from construction to destruction
+class ScopedLatency {
+   public:
+    explicit ScopedLatency(const MetricHistogram& histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        this->histogram.record((u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - this->start)
+                                   .count());
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+   private:
+    const MetricHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct CounterSnapshot {
+    std::string name;
+    std::string help;
+    // Prometheus label set without braces, e.g. kernel="soa"; may be empty
+    std::string labels;
+    u64 value;
+};
+
+struct HistogramSnapshot {
+    std::string name;
+    std::string help;
+    std::string labels;
+    u64 count;
+    u64 sum;
+    std::vector<u64> buckets;
+
+    // Value at quantile `q` in [0, 1], the middle of its bucket; 0 if empty
+    u64 quantile(double q) const;
+};
+
+struct MetricsSnapshot {
+    std::vector<CounterSnapshot> counters;
+    std::vector<HistogramSnapshot> histograms;
+
+    /* Prometheus text exposition format
+     *
+     * Counters as counters, histograms as summaries in seconds with the 0.5,
+     * 0.9, 0.99 and 0.999 quantiles.
+     */
+    std::string to_prometheus() const;
+};
+
+/* The process-wide set of metrics
+ *
+ * There is one registry, since each thread has a single shard.
+ */
+class MetricsRegistry {
+   public:
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    static MetricsRegistry& global();
+
+    MetricCounter counter(
+        const std::string& name, const std::string& help, const std::string& labels = "");
+    MetricHistogram histogram(
+        const std::string& name, const std::string& help, const std::string& labels = "");
+
+    MetricsSnapshot snapshot();
+    // Write the Prometheus text to `path` via a temporary file and a rename
+    bool write_prometheus(const std::string& path);
+
+    // Shard for a new thread, and its return when the thread exits
+    MetricsShard* attach();
+    void detach(MetricsShard* shard);
+
+   private:
+    MetricsRegistry();
+
+    struct Info {
+        std::string name;
+        std::string help;
+        std::string labels;
+    };
+
+    std::mutex mutex;
+    std::vector<Info> counter_info;
+    std::vector<Info> histogram_info;
+    std::vector<std::unique_ptr<MetricsShard>> shards;
+    // Totals of the threads that have exited
+    std::unique_ptr<MetricsShard> retired;
+};
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,39 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "types.hpp"
+
+/* Serves MetricsRegistry::global() over HTTP for a Prometheus scraper
+ *
+ * A background thread accepts connections on `address:port`, loopback by
+ * default, and answers `GET /metrics` (or `GET /`) with a fresh snapshot in
+ * the text exposition format; other paths get a 404.  Requests are handled
+ * one at a time and every connection is closed after its response, which is
+ * all a scraper needs.  The thread checks for `stop` ten times a second.
+ */
+class MetricsServer {
+   public:
+    MetricsServer();
+    ~MetricsServer();
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Port 0 picks a free port, see port(); false if the address is unusable
+    bool start(u16 port, const std::string& address = "127.0.0.1");
+    void stop();
+    u16 port() const;
+
+   private:
+    int listen_fd;
+    u16 bound_port;
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    void run();
+};
+
+#endif /* METRICS_SERVER_HPP */
@@ -0,0 +1,79 @@
+#ifndef POINT_GRID_HPP
+#define POINT_GRID_HPP
+
+#include <limits>
+#include <opencv2/core.hpp>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+
+/* Uniform-grid spatial index over a static 2D point set
+ *
+ * Points are bucketed by a counting sort into row-major cells and stored in
+ * cell order, so the cells of one grid row that overlap a query rectangle form
+ * a single contiguous run.  A rectangle query therefore costs one run per
+ * overlapping row plus the points returned, independent of the dataset size.
+ * Nearest-point queries search rings of cells outward from the query and stop
+ * once no unsearched cell can be closer, so they touch a handful of cells.
+ *
+ * Points with a NaN or infinite coordinate are kept but do not widen the grid;
+ * they are filed in the edge cells and never match a finite query.
+ */
+class PointGrid {
+   public:
+    // Half-open range [first, second) into sorted_points()
+    typedef std::pair<u32, u32> Run;
+
+    PointGrid();
+    // A cell_size of 0 picks one giving a few points per cell on average
+    void build(const cv::Point2f* pts, size_t n, float cell_size = 0.0f);
+    void build(const std::vector<cv::Point2f>& pts, float cell_size = 0.0f);
+
+    /* Runs of points in cells overlapping `rect`
+     *
+     * Conservative: points in boundary cells may lie just outside `rect`.
+     */
+    void query_runs(const cv::Rect2f& rect, std::vector<Run>& runs) const;
+    // Original indices of the points strictly inside `rect`
+    void query_rect(const cv::Rect2f& rect, std::vector<u32>& out) const;
+    // Original indices of the points within `radius` of `center`
+    void query_radius(
+        const cv::Point2f& center, float radius, std::vector<u32>& out) const;
+
+    /* Point nearest to `pt`, no further than `max_dist`
+     *
+     * On success `slot` is its index into sorted_points() and sorted_ids().
+     */
+    bool nearest(
+        const cv::Point2f& pt,
+        u32& slot,
+        float max_dist = std::numeric_limits<float>::infinity()) const;
+
+    size_t size() const;
+    cv::Rect2f bounds() const;
+    float cell_size() const;
+    const std::vector<cv::Point2f>& sorted_points() const;
+    // Original index of each entry of sorted_points()
+    const std::vector<u32>& sorted_ids() const;
+
+   private:
+    float cell;
+    float inv_cell;
+    float origin_x;
+    float origin_y;
+    int cols;
+    int rows;
+    cv::Rect2f extent;
+    std::vector<u32> cell_start;
+    std::vector<cv::Point2f> points;
+    std::vector<u32> ids;
+
+    int cell_x(float x) const;
+    int cell_y(float y) const;
+    float cells_dist2(const cv::Point2f& pt, int cx0, int cx1, int cy0, int cy1) const;
+    void nearest_in(
+        u32 first, u32 last, const cv::Point2f& pt, float& best_d2, u32& slot) const;
+};
+
+#endif /* POINT_GRID_HPP */
@@ -0,0 +1,103 @@
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include <string>
+
+#include "transform.hpp"
+#include "transform_file.hpp"
+#include "types.hpp"
+
+/* One keypoint frame in a ShmRing slot
+ *
+ * The points follow the header in the same slot.  When kFrameHasTransform is
+ * set, `tform` and `inverse` hold a transform whose local frame the points are
+ * given in; the consumer maps them to world coordinates with local_to_world.
+ */
+struct ShmFrame {
+    u64 timestamp_ns;
+    u32 count;
+    u32 flags;
+    AffineRows tform;
+    AffineRows inverse;
+
+    cv::Point2f* points() { return (cv::Point2f*)(this + 1); }
+    const cv::Point2f* points() const { return (const cv::Point2f*)(this + 1); }
+    void set_transform(const Transform2d& xform);
+    Transform2d transform() const;
+};
+static_assert(sizeof(ShmFrame) == 64, "frame header layout");
+
+// Control block at the start of a ring's mapping, see shm_ring.cpp
+struct ShmRingControl;
+
+// Flag: ShmFrame::tform and ShmFrame::inverse are set
+constexpr u32 kFrameHasTransform = 0x1;
+
+/* Single-producer, single-consumer ring of keypoint frames in shared memory
+ *
+ * The producer process creates a named POSIX shared memory object holding a
+ * control block and `slots` fixed-size slots; the consumer attaches to it by
+ * name.  Frames are written and read in place: the producer fills the slot
+ * returned by `acquire` and publishes it, the consumer reads (or transforms in
+ * place) the slot returned by `peek` and releases it.  Nothing is copied and
+ * neither side takes a lock.
+ *
+ * Head and tail are free-running 32-bit counters in the control block.  A side
+ * that finds the ring empty (or full) spins briefly and then sleeps on the
+ * counter with a futex, after flagging that it waits; the other side only
+ * makes the wake system call when that flag is set, so an uncontended hand-off
+ * costs no system calls at all.
+ */
+class ShmRing {
+   public:
+    ShmRing();
+    ~ShmRing();
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Producer: create (or replace) the ring `name`, e.g. "/keypoints"
+    bool create(const std::string& name, u32 slots, u32 max_points);
+    // Consumer: map an existing ring
+    bool attach(const std::string& name);
+    // Unmap; the creator also removes the name
+    void close();
+    static bool remove(const std::string& name);
+
+    /* Producer: slot for the next frame, waiting up to `timeout_ns` (< 0 for
+     * ever) while the ring is full; nullptr on timeout
+     */
+    ShmFrame* acquire(i64 timeout_ns = -1);
+    void publish();
+
+    /* Consumer: oldest published frame, waiting up to `timeout_ns` (< 0 for
+     * ever) while the ring is empty; nullptr on timeout
+     *
+     * The frame's `count` comes from the producer process and is clamped to
+     * max_points() here, so the points it covers always lie inside the slot.
+     */
+    ShmFrame* peek(i64 timeout_ns = -1);
+    void release();
+    // Consumer: frames published and not yet released
+    size_t available() const;
+
+    u32 max_points() const;
+    size_t slots() const;
+
+   private:
+    ShmRingControl* control;
+    u8* slot_base;
+    size_t mapped;
+    size_t slot_bytes;
+    u32 slot_count;
+    // max_points as checked against slot_bytes when the ring was mapped
+    u32 point_limit;
+    std::string owned_name;
+
+    ShmFrame* slot(u32 counter) const;
+    bool map(int fd, size_t length);
+};
+
+#endif /* SHM_RING_HPP */
@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimum points per parallel_for chunk in the batch point kernels
+constexpr size_t kPointBatchGrain = 16384;
+
+/* Work-stealing thread pool
+ *
+ * Each worker owns a task deque.  Workers pop their own tasks from the back and
+ * steal from the front of other workers' deques when they run dry, sleeping
+ * only when every deque is empty.  Tasks submitted from a worker stay on that
+ * worker's deque, so nested work keeps its cache locality.
+ *
+ * `parallel_for` is the main entry point for the batch kernels.  The calling
+ * thread always takes part in the loop, so a pool with no workers degrades to
+ * a plain serial loop and nested calls from inside a task cannot deadlock.
+ */
+class ThreadPool {
+   public:
+    // Range body: processes indices [begin, end)
+    typedef std::function<void(size_t, size_t)> RangeFn;
+
+    // 0 workers is valid: every call then runs on the calling thread
+    explicit ThreadPool(size_t num_workers);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Shared pool sized to the hardware (the caller counts as one thread)
+    static ThreadPool& global();
+
+    void submit(std::function<void()> task);
+    // Run `fn` over [begin, end) in chunks of at least `grain` indices
+    void parallel_for(
+        size_t begin, size_t end, const RangeFn& fn, size_t grain = 0);
+    // Threads that take part in a parallel_for: workers plus the caller
+    size_t concurrency() const;
+
+   private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    std::atomic<size_t> next_queue;
+    bool stopping;
+
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, std::function<void()>& task);
+    bool try_steal(size_t thief, std::function<void()>& task);
+    bool run_one(size_t index);
+};
+
+#endif /* THREAD_POOL_HPP */
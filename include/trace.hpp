@@ -0,0 +1,102 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <string>
+
+#include "types.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/* Scoped tracing of the hot paths
+ *
+ *   void Stage() {
+ *       TRACE_FUNCTION();
+ *       ...
+ *       {
+ *           TRACE_SCOPE("stage/part");
+ *           ...
+ *       }
+ *   }
+ *
+ * A scope records its name and its begin and end timestamps into a buffer
+ * owned by the calling thread: no locks, no allocation and no shared writes
+ * once a thread's buffer exists.  Names must be string literals (or otherwise
+ * outlive the trace).  When tracing is not started a scope costs a single
+ * relaxed load, and when the build defines no TRANSFORM_TRACE (CMake option
+ * TRANSFORM_TRACE=OFF) the macros expand to nothing at all.
+ *
+ * Each thread keeps at most kTraceBufferEvents events per session; later ones
+ * are counted as dropped.  `trace_write_json` writes the Chrome trace event
+ * format, which chrome://tracing and ui.perfetto.dev open directly.
+ */
+
+// Events kept per thread and session
+constexpr size_t kTraceBufferEvents = 1 << 16;
+
+// Timestamp in trace ticks: the TSC on x86, steady-clock nanoseconds elsewhere
+inline u64 trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (u64)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Begin a new session, discarding the events of the previous one
+void trace_start();
+void trace_stop();
+bool trace_active();
+// Label the calling thread in the trace, e.g. "scene worker"
+void trace_set_thread_name(const char* name);
+// Events recorded in the current (or last) session and events dropped
+size_t trace_event_count();
+size_t trace_dropped_count();
+/* Write the current (or last) session as Chrome trace JSON
+ *
+ * Call after trace_stop for a complete trace; must not run concurrently with
+ * trace_start.
+ */
+bool trace_write_json(const std::string& path);
+
+class TraceScope {
+   public:
+    explicit TraceScope(const char* name)
+        : name(name),
+          session(TraceScope::active.load(std::memory_order_relaxed)),
+          begin(this->session != 0 ? trace_ticks() : 0) {}
+    ~TraceScope() {
+        if (this->session != 0) {
+            TraceScope::record(this->name, this->session, this->begin, trace_ticks());
+        }
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Id of the running session, 0 while tracing is stopped
+    static std::atomic<u32> active;
+
+   private:
+    const char* name;
+    u32 session;
+    u64 begin;
+
+    static void record(const char* name, u32 session, u64 begin, u64 end);
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if defined(TRANSFORM_TRACE)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+#endif
+
+#endif /* TRACE_HPP */
@@ -3,6 +3,22 @@
 
 #include <array>
 #include <opencv2/core.hpp>
+#include <vector>
+
+class ThreadPool;
+
+// Text layouts written by Transform2d::format
+enum class TransformFormat {
+    // [xi,xj,xk,yi,yj,yk,Ti,Tj,Tk]
+    kCompact,
+    // {"x_axis":[xi,xj,xk],"y_axis":[...],"T_axis":[...]}
+    kJson,
+    // One "x_axis: [xi, xj, xk]" line per axis
+    kYaml,
+};
+
+// Characters Transform2d::format can write, in the longest layout
+constexpr size_t kTransformTextMax = 192;
 
 /* Square matrix represented by a 9-element array
  *
@@ -26,6 +42,8 @@ class Transform2d {
     Transform2d();
     Transform2d(const cv::Vec4f, const cv::Point2f);
     Transform2d(const SqMatrix3);
+    // Takes the inverse as given instead of computing it
+    Transform2d(const SqMatrix3& matrix, const SqMatrix3& inverse);
     Transform2d(
         const float,
         const float,
@@ -45,8 +63,54 @@ class Transform2d {
     cv::Point2f world_to_local(const cv::Point2f) const;
     // image-to-world or linefit-to-image
     cv::Point2f local_to_world(const cv::Point2f) const;
+    // Batch variants over `n` points, serial or split across a pool
+    void world_to_local(const cv::Point2f*, cv::Point2f*, size_t) const;
+    void world_to_local(
+        const cv::Point2f*, cv::Point2f*, size_t, ThreadPool&) const;
+    void local_to_world(const cv::Point2f*, cv::Point2f*, size_t) const;
+    void local_to_world(
+        const cv::Point2f*, cv::Point2f*, size_t, ThreadPool&) const;
+    // Structure-of-arrays variants: x and y in separate arrays
+    void world_to_local(
+        const float* x, const float* y, float* out_x, float* out_y, size_t)
+        const;
+    void world_to_local(
+        const float* x,
+        const float* y,
+        float* out_x,
+        float* out_y,
+        size_t,
+        ThreadPool&) const;
+    void local_to_world(
+        const float* x, const float* y, float* out_x, float* out_y, size_t)
+        const;
+    void local_to_world(
+        const float* x,
+        const float* y,
+        float* out_x,
+        float* out_y,
+        size_t,
+        ThreadPool&) const;
+    std::vector<cv::Point2f> world_to_local(
+        const std::vector<cv::Point2f>&) const;
+    std::vector<cv::Point2f> world_to_local(
+        const std::vector<cv::Point2f>&, ThreadPool&) const;
+    std::vector<cv::Point2f> local_to_world(
+        const std::vector<cv::Point2f>&) const;
+    std::vector<cv::Point2f> local_to_world(
+        const std::vector<cv::Point2f>&, ThreadPool&) const;
     std::string to_string() const;
+    char* format(
+        char* first,
+        char* last,
+        TransformFormat layout = TransformFormat::kCompact) const;
+    static const char* parse(
+        const char* first, const char* last, Transform2d& out);
     float z_mag() const;
+    // Local-to-world matrix, in the column-major order described above
+    const SqMatrix3& matrix() const;
+    // World-to-local matrix, same order
+    const SqMatrix3& inverse() const;
 
    private:
     SqMatrix3 data;
@@ -54,6 +118,15 @@ class Transform2d {
     static SqMatrix3 inv(const SqMatrix3);
     static SqMatrix3 adj(const SqMatrix3);
     static cv::Point2f mul(const SqMatrix3, const cv::Point2f);
+    static void mul(
+        const SqMatrix3&, const cv::Point2f*, cv::Point2f*, size_t);
+    static void mul(
+        const SqMatrix3&,
+        const float*,
+        const float*,
+        float*,
+        float*,
+        size_t);
     static float det(const SqMatrix3);
 };
 
@@ -0,0 +1,128 @@
+#ifndef TRANSFORM_FILE_HPP
+#define TRANSFORM_FILE_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <opencv2/core.hpp>
+#include <string>
+
+#include "transform.hpp"
+#include "types.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "transform files are read in place and assume a little-endian host"
+#endif
+
+/* Affine part of a 2D transform as two rows
+ *
+ * [xi yi Ti]
+ * [xj yj Tj]
+ *
+ * The constant bottom row of the 3x3 matrix is implied.
+ */
+struct AffineRows {
+    f32 xi, yi, Ti;
+    f32 xj, yj, Tj;
+
+    static AffineRows from_matrix(const SqMatrix3& m);
+    SqMatrix3 to_matrix() const;
+    cv::Point2f apply(const cv::Point2f& pt) const;
+};
+
+/* Binary transform log
+ *
+ * Layout, all little-endian:
+ *
+ *   TransformFileHeader (64 bytes)
+ *   count records of `stride` bytes, each the local-to-world AffineRows,
+ *   followed by the world-to-local AffineRows when kHasInverse is set
+ *
+ * Records sit at fixed offsets with no padding or framing, so a mapped file is
+ * used as is: TransformFile::open validates the header (and optionally the
+ * checksum) and then hands out pointers into the mapping.  The checksum covers
+ * the record bytes only.
+ */
+struct TransformFileHeader {
+    char magic[8];
+    u32 version;
+    u32 flags;
+    u32 stride;
+    u32 reserved;
+    u64 count;
+    u64 checksum;
+    u8 padding[24];
+};
+static_assert(sizeof(TransformFileHeader) == 64, "header layout");
+static_assert(sizeof(AffineRows) == 24, "record layout");
+
+constexpr char kTransformFileMagic[8] = {'X', 'F', 'O', 'R', 'M', '2', 'D', '\n'};
+constexpr u32 kTransformFileVersion = 1;
+// Flag: each record also holds the inverse
+constexpr u32 kHasInverse = 0x1;
+
+// Checksum used by the transform file; `n` must be a multiple of 8
+u64 transform_checksum(const void* data, size_t n);
+
+/* Appends transforms to a new transform file
+ *
+ * The header is rewritten with the final count and checksum by `close`; a
+ * file that was never closed has a count of 0 and is read as empty.
+ */
+class TransformWriter {
+   public:
+    TransformWriter();
+    ~TransformWriter();
+    TransformWriter(const TransformWriter&) = delete;
+    TransformWriter& operator=(const TransformWriter&) = delete;
+
+    bool open(const std::string& path, bool with_inverse);
+    bool append(const Transform2d& tform);
+    bool append(const Transform2d* tforms, size_t n);
+    // Finish the header; false if anything failed since `open`
+    bool close();
+    size_t size() const;
+
+   private:
+    std::FILE* file;
+    bool with_inverse;
+    bool failed;
+    u64 count;
+    // Running checksum state, see transform_checksum
+    u64 lanes[4];
+    size_t lane;
+};
+
+/* Read-only memory mapping of a transform file
+ *
+ * Nothing is parsed or copied: rows() and inverse_rows() point into the
+ * mapping.  Without checksum verification opening is constant time.
+ */
+class TransformFile {
+   public:
+    TransformFile();
+    ~TransformFile();
+    TransformFile(const TransformFile&) = delete;
+    TransformFile& operator=(const TransformFile&) = delete;
+
+    // False if the file is missing, truncated, foreign or fails the checksum
+    bool open(const std::string& path, bool verify = true);
+    void close();
+
+    size_t size() const;
+    bool has_inverse() const;
+    const AffineRows& rows(size_t i) const;
+    // Only valid when has_inverse()
+    const AffineRows& inverse_rows(size_t i) const;
+    // Transform `i`, inverted only if the file has no inverse
+    Transform2d at(size_t i) const;
+
+   private:
+    const u8* base;
+    size_t length;
+    const u8* records;
+    size_t stride;
+    size_t count;
+    bool inverse;
+};
+
+#endif /* TRANSFORM_FILE_HPP */
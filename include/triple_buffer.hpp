@@ -0,0 +1,63 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+#include "types.hpp"
+
+/* Lock-free single-producer, single-consumer latest-value buffer
+ *
+ * Three slots: the writer owns one (back), the reader owns one (front) and the
+ * third (middle) holds the newest published value.  Publishing and picking up
+ * are a single atomic exchange of the middle index, so neither side ever waits
+ * for the other; the reader just sees the newest value published so far and
+ * intermediate values may be skipped.
+ *
+ * Values left behind in the writer's slot are overwritten by the writer, so
+ * whatever they own is released on the writer's thread.
+ */
+template <typename T>
+class TripleBuffer {
+   public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer: slot to fill before publish(); keeps its previous contents
+    T& write_slot() { return this->slots[this->back].value; }
+
+    void publish() {
+        u8 prev = this->middle.exchange(
+            this->back | kFresh, std::memory_order_acq_rel);
+        this->back = prev & kIndexMask;
+    }
+
+    // Reader: switch to the newest published value; false if none is new
+    bool update() {
+        if (!(this->middle.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        u8 prev = this->middle.exchange(this->front, std::memory_order_acq_rel);
+        this->front = prev & kIndexMask;
+        return true;
+    }
+
+    // Reader: value picked up by the last successful update()
+    const T& read() const { return this->slots[this->front].value; }
+
+   private:
+    static constexpr u8 kIndexMask = 0x3;
+    static constexpr u8 kFresh = 0x4;
+
+    // Padded so the writer and reader slots do not share cache lines
+    struct alignas(64) Slot {
+        T value;
+    };
+
+    Slot slots[3];
+    alignas(64) std::atomic<u8> middle;
+    u8 back;
+    alignas(64) u8 front;
+};
+
+#endif /* TRIPLE_BUFFER_HPP */
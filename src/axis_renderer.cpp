@@ -0,0 +1,298 @@
+#include "axis_renderer.hpp"
+
+#include <raymath.h>
+#include <rlgl.h>
+
+#include <cmath>
+#include <cstddef>
+
+#include "render_stats.hpp"
+#include "trace.hpp"
+
+// Segments of the origin dot
+static const int kOriginSegments = 16;
+// Radius of the origin dot, in world units
+static const float kOriginRadius = 5.0f;
+
+static const char* kAxisVs = R"(#version 330
+in vec2 vertexPosition;
+in vec4 vertexColor;
+in vec3 instanceRow0;
+in vec3 instanceRow1;
+uniform mat4 mvp;
+out vec4 fragColor;
+void main() {
+    vec3 local = vec3(vertexPosition, 1.0);
+    vec2 world = vec2(dot(instanceRow0, local), dot(instanceRow1, local));
+    fragColor = vertexColor;
+    gl_Position = mvp * vec4(world, 0.0, 1.0);
+}
+)";
+
+static const char* kAxisFs = R"(#version 330
+in vec4 fragColor;
+out vec4 finalColor;
+void main() {
+    finalColor = fragColor;
+}
+)";
+
+AxisShape AxisGeometry(const Transform2d& xform, float scale, float thk) {
+    float fthk = thk * 2.0f;
+    float arr_tip_offset = scale * 0.2f + fthk;
+    if (scale < 10.0f) {
+        arr_tip_offset = 2.0f;
+        scale = 10.0f;
+    }
+    arr_tip_offset =
+        arr_tip_offset > 20.0 + fthk ? 20.0 + fthk : arr_tip_offset;
+    float arr_side_offset = arr_tip_offset * 0.3f;
+    float z = xform.z_mag();
+    if (z > 0) {
+        arr_side_offset = -arr_side_offset;
+    }
+
+    auto to_world = [&](float x, float y) {
+        cv::Point2f p = xform.local_to_world(cv::Point2f(x, y));
+        return Vector2{p.x, p.y};
+    };
+    AxisShape axis;
+    axis.origin = to_world(0.0f, 0.0f);
+    axis.x_end = to_world(scale, 0.0f);
+    axis.x_tip[0] = to_world(scale + arr_tip_offset, 0.0f);
+    axis.x_tip[1] = to_world(scale, arr_side_offset);
+    axis.x_tip[2] = to_world(scale, -arr_side_offset);
+    axis.y_end = to_world(0.0f, scale);
+    axis.y_tip[0] = to_world(0.0f, scale + arr_tip_offset);
+    axis.y_tip[1] = to_world(-arr_side_offset, scale);
+    axis.y_tip[2] = to_world(arr_side_offset, scale);
+    return axis;
+}
+
+Matrix TransformToMatrix(const Transform2d& xform) {
+    const SqMatrix3& d = xform.matrix();
+    Matrix m = MatrixIdentity();
+    m.m0 = d[0];
+    m.m1 = d[1];
+    m.m4 = d[3];
+    m.m5 = d[4];
+    m.m12 = d[6];
+    m.m13 = d[7];
+    return m;
+}
+
+AxisRenderer::AxisRenderer()
+    : instanced(false),
+      shader{0, nullptr},
+      mvp_loc(-1),
+      instance_attribs{-1, -1},
+      vao(0),
+      mesh_vbo(0),
+      instance_vbo(0),
+      instance_capacity(0),
+      count(0),
+      mesh_scale(0.0f),
+      mesh_thk(0.0f) {}
+
+void AxisRenderer::init() {
+    this->build_mesh(1.0f, 1.0f);
+
+    int version = rlGetVersion();
+    if (version != RL_OPENGL_33 && version != RL_OPENGL_43) {
+        return;
+    }
+    this->shader = LoadShaderFromMemory(kAxisVs, kAxisFs);
+    if (this->shader.id == rlGetShaderIdDefault()) {
+        return;
+    }
+    this->mvp_loc = rlGetLocationUniform(this->shader.id, "mvp");
+    this->instance_attribs[0] = rlGetLocationAttrib(this->shader.id, "instanceRow0");
+    this->instance_attribs[1] = rlGetLocationAttrib(this->shader.id, "instanceRow1");
+    int position_attrib = rlGetLocationAttrib(this->shader.id, "vertexPosition");
+    int color_attrib = rlGetLocationAttrib(this->shader.id, "vertexColor");
+
+    this->vao = rlLoadVertexArray();
+    rlEnableVertexArray(this->vao);
+    this->mesh_vbo = rlLoadVertexBuffer(
+        this->mesh.data(), (int)(this->mesh.size() * sizeof(Vertex)), true);
+    rlSetVertexAttribute(
+        position_attrib,
+        2,
+        RL_FLOAT,
+        false,
+        sizeof(Vertex),
+        (void*)offsetof(Vertex, position));
+    rlEnableVertexAttribute(position_attrib);
+    rlSetVertexAttribute(
+        color_attrib,
+        4,
+        RL_UNSIGNED_BYTE,
+        true,
+        sizeof(Vertex),
+        (void*)offsetof(Vertex, color));
+    rlEnableVertexAttribute(color_attrib);
+    rlDisableVertexArray();
+    this->instanced = true;
+    this->reserve_instances(16);
+}
+
+void AxisRenderer::unload() {
+    if (this->instanced) {
+        rlUnloadVertexBuffer(this->instance_vbo);
+        rlUnloadVertexBuffer(this->mesh_vbo);
+        rlUnloadVertexArray(this->vao);
+        UnloadShader(this->shader);
+    }
+    *this = AxisRenderer();
+}
+
+/* Triangles of one axis system in local coordinates
+ *
+ * Same shapes as AxisGeometry with the identity transform, with each line
+ * widened into a quad.  The vertex count does not depend on the style, so a
+ * rebuild is a plain buffer update.
+ */
+void AxisRenderer::build_mesh(const float scale, const float thk) {
+    this->mesh.clear();
+    auto add_line = [this](Vector2 a, Vector2 b, float thk, Color color) {
+        Vector2 dir = Vector2Normalize(Vector2Subtract(b, a));
+        Vector2 n = {-dir.y * thk * 0.5f, dir.x * thk * 0.5f};
+        Vector2 quad[4] = {
+            Vector2Subtract(a, n), Vector2Subtract(b, n), Vector2Add(b, n), Vector2Add(a, n)};
+        for (int i : {0, 1, 2, 0, 2, 3}) {
+            this->mesh.push_back({quad[i], color});
+        }
+    };
+    const AxisShape axis = AxisGeometry(Transform2d(), scale, thk);
+    add_line(axis.origin, axis.x_end, thk, RED);
+    for (const Vector2& v : axis.x_tip) {
+        this->mesh.push_back({v, RED});
+    }
+    add_line(axis.origin, axis.y_end, thk, GREEN);
+    for (const Vector2& v : axis.y_tip) {
+        this->mesh.push_back({v, GREEN});
+    }
+    const float step = 2.0f * PI / kOriginSegments;
+    for (int i = 0; i < kOriginSegments; ++i) {
+        this->mesh.push_back({axis.origin, LIGHTGRAY});
+        this->mesh.push_back(
+            {{kOriginRadius * cosf((i + 1) * step), kOriginRadius * sinf((i + 1) * step)},
+             LIGHTGRAY});
+        this->mesh.push_back(
+            {{kOriginRadius * cosf(i * step), kOriginRadius * sinf(i * step)}, LIGHTGRAY});
+    }
+    this->mesh_scale = scale;
+    this->mesh_thk = thk;
+    if (this->instanced) {
+        rlUpdateVertexBuffer(
+            this->mesh_vbo, this->mesh.data(), (int)(this->mesh.size() * sizeof(Vertex)), 0);
+    }
+}
+
+/* Grow the per-instance buffer to hold at least `n` transforms
+ */
+void AxisRenderer::reserve_instances(const size_t n) {
+    if (n <= this->instance_capacity) {
+        return;
+    }
+    size_t capacity = this->instance_capacity > 0 ? this->instance_capacity : 1;
+    while (capacity < n) capacity *= 2;
+    rlEnableVertexArray(this->vao);
+    if (this->instance_vbo != 0) {
+        rlUnloadVertexBuffer(this->instance_vbo);
+    }
+    this->instance_vbo =
+        rlLoadVertexBuffer(nullptr, (int)(capacity * sizeof(Instance)), true);
+    for (int row = 0; row < 2; ++row) {
+        const int attrib = this->instance_attribs[row];
+        rlSetVertexAttribute(
+            attrib,
+            3,
+            RL_FLOAT,
+            false,
+            sizeof(Instance),
+            (void*)(row == 0 ? offsetof(Instance, row0) : offsetof(Instance, row1)));
+        rlEnableVertexAttribute(attrib);
+        rlSetVertexAttributeDivisor(attrib, 1);
+    }
+    rlDisableVertexArray();
+    this->instance_capacity = capacity;
+}
+
+void AxisRenderer::set_axes(const Transform2d* xforms, const size_t n) {
+    this->count = n;
+    if (!this->instanced) {
+        this->matrices.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            this->matrices[i] = TransformToMatrix(xforms[i]);
+        }
+        return;
+    }
+    this->reserve_instances(n);
+    std::vector<Instance> instances(n);
+    for (size_t i = 0; i < n; ++i) {
+        const SqMatrix3& d = xforms[i].matrix();
+        instances[i] = {{d[0], d[3], d[6]}, {d[1], d[4], d[7]}};
+    }
+    if (n > 0) {
+        rlUpdateVertexBuffer(
+            this->instance_vbo, instances.data(), (int)(n * sizeof(Instance)), 0);
+    }
+}
+
+void AxisRenderer::set_axes(const std::vector<Transform2d>& xforms) {
+    this->set_axes(xforms.data(), xforms.size());
+}
+
+size_t AxisRenderer::size() const { return this->count; }
+
+/* Draw every axis system with arrows of `scale` and lines `thk` wide
+ *
+ * The pending rlgl batch is flushed first so earlier shapes keep their draw
+ * order.
+ */
+void AxisRenderer::draw(const float scale, const float thk) {
+    TRACE_SCOPE("draw/axes");
+    if (this->count == 0) {
+        return;
+    }
+    if (scale != this->mesh_scale || thk != this->mesh_thk) {
+        this->build_mesh(scale, thk);
+    }
+    rlDrawRenderBatchActive();
+    rlDisableBackfaceCulling();
+    CountDrawCalls(1);
+    if (this->instanced) {
+        CountDrawCalls(1);
+        Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+        rlEnableShader(this->shader.id);
+        rlSetUniformMatrix(this->mvp_loc, mvp);
+        rlEnableVertexArray(this->vao);
+        rlDrawVertexArrayInstanced(0, (int)this->mesh.size(), (int)this->count);
+        rlDisableVertexArray();
+        rlDisableShader();
+    } else {
+        this->draw_batched();
+        CountDrawCalls(BatchedDrawCalls(this->count * this->mesh.size()));
+        rlDrawRenderBatchActive();
+    }
+    rlEnableBackfaceCulling();
+}
+
+/* Fallback: replay the mesh through the rlgl batch under each transform
+ */
+void AxisRenderer::draw_batched() const {
+    const int verts = (int)this->mesh.size();
+    for (const Matrix& m : this->matrices) {
+        rlPushMatrix();
+        rlMultMatrixf(MatrixToFloatV(m).v);
+        rlBegin(RL_TRIANGLES);
+        rlCheckRenderBatchLimit(verts);
+        for (const Vertex& v : this->mesh) {
+            rlColor4ub(v.color.r, v.color.g, v.color.b, v.color.a);
+            rlVertex2f(v.position.x, v.position.y);
+        }
+        rlEnd();
+        rlPopMatrix();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef AXIS_RENDERER_HPP
+#define AXIS_RENDERER_HPP
+
+#include <raylib.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "transform.hpp"
+
+/* Shapes of one axis system: two lines with arrow heads
+ */
+struct AxisShape {
+    Vector2 origin;
+    Vector2 x_end;
+    Vector2 x_tip[3];
+    Vector2 y_end;
+    Vector2 y_tip[3];
+};
+
+// Axis shapes mapped through `xform`, in world coordinates
+AxisShape AxisGeometry(const Transform2d& xform, float scale, float thk);
+
+// `xform` as a raylib matrix, e.g. for rlMultMatrixf
+Matrix TransformToMatrix(const Transform2d& xform);
+
+/* Batched renderer for many axis systems drawn with the same style
+ *
+ * One axis mesh (lines as quads, arrow heads and the origin dot) is built in
+ * local coordinates and only rebuilt when the scale or line thickness
+ * changes.  Each axis system is then just its transform: with OpenGL 3.3 the
+ * transforms are uploaded as 2x3 per-instance matrices and everything goes
+ * out in one instanced draw; otherwise each axis is replayed through the
+ * rlgl batch under rlPushMatrix/rlMultMatrixf.
+ *
+ * Mirrored transforms flip the winding, so face culling is off while drawing.
+ * `init` and `unload` must run while the window (GL context) exists.
+ */
+class AxisRenderer {
+   public:
+    AxisRenderer();
+    void init();
+    void unload();
+    // Replace the axis systems; uploads immediately when instancing is in use
+    void set_axes(const Transform2d* xforms, size_t n);
+    void set_axes(const std::vector<Transform2d>& xforms);
+    // Draw every axis system; call inside BeginMode2D
+    void draw(float scale, float thk);
+    size_t size() const;
+
+   private:
+    struct Vertex {
+        Vector2 position;
+        Color color;
+    };
+    // Rows of the local-to-world matrix
+    struct Instance {
+        float row0[3];
+        float row1[3];
+    };
+
+    bool instanced;
+    Shader shader;
+    int mvp_loc;
+    int instance_attribs[2];
+    unsigned int vao;
+    unsigned int mesh_vbo;
+    unsigned int instance_vbo;
+    size_t instance_capacity;
+    size_t count;
+    float mesh_scale;
+    float mesh_thk;
+    std::vector<Vertex> mesh;
+    // CPU copy, only kept for the rlgl fallback path
+    std::vector<Matrix> matrices;
+
+    void build_mesh(float scale, float thk);
+    void reserve_instances(size_t n);
+    void draw_batched() const;
+};
+
+#endif /* AXIS_RENDERER_HPP */
@@ -0,0 +1,118 @@
+#include "density.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Budget for the private per-slice histograms of the parallel path
+static const size_t kSliceHistogramBytes = 64u << 20;
+// Fewest points worth giving a slice of their own
+static const size_t kMinSlicePoints = 1u << 18;
+
+static inline void bin_one(
+    const cv::Point2f pt, const DensityBins& bins, const float inv_bin, u32* counts) {
+    float fx = (pt.x - bins.origin_x) * inv_bin;
+    float fy = (pt.y - bins.origin_y) * inv_bin;
+    if (fx >= 0.0f && fx < bins.width && fy >= 0.0f && fy < bins.height) {
+        ++counts[(size_t)(int)fy * bins.width + (int)fx];
+    }
+}
+
+void bin_density(
+    const cv::Point2f* pts, const size_t n, const DensityBins& bins, u32* counts) {
+    const float inv_bin = 1.0f / bins.bin_size;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 origin_x = _mm_set1_ps(bins.origin_x);
+    const __m128 origin_y = _mm_set1_ps(bins.origin_y);
+    const __m128 scale = _mm_set1_ps(inv_bin);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 width = _mm_set1_ps((float)bins.width);
+    const __m128 height = _mm_set1_ps((float)bins.height);
+    const float* raw = reinterpret_cast<const float*>(pts);
+    alignas(16) int bx[4];
+    alignas(16) int by[4];
+    for (; i + 4 <= n; i += 4) {
+        // De-interleave four (x, y) pairs into x and y lanes
+        __m128 a = _mm_loadu_ps(raw + 2 * i);
+        __m128 b = _mm_loadu_ps(raw + 2 * i + 4);
+        __m128 xs = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 ys = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 fx = _mm_mul_ps(_mm_sub_ps(xs, origin_x), scale);
+        __m128 fy = _mm_mul_ps(_mm_sub_ps(ys, origin_y), scale);
+        __m128 inside = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmplt_ps(fx, width)),
+            _mm_and_ps(_mm_cmpge_ps(fy, zero), _mm_cmplt_ps(fy, height)));
+        int mask = _mm_movemask_ps(inside);
+        if (mask == 0) {
+            continue;
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(bx), _mm_cvttps_epi32(fx));
+        _mm_store_si128(reinterpret_cast<__m128i*>(by), _mm_cvttps_epi32(fy));
+        for (int k = 0; k < 4; ++k) {
+            if (mask & (1 << k)) {
+                ++counts[(size_t)by[k] * bins.width + bx[k]];
+            }
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        bin_one(pts[i], bins, inv_bin, counts);
+    }
+}
+
+/* Parallel binning
+ *
+ * Each slice of the points fills a private histogram, then the histograms are
+ * summed into `counts` in parallel over pixel ranges.  The slice count is
+ * capped by the pool size and by the memory budget for the histograms.
+ */
+void bin_density(
+    const cv::Point2f* pts,
+    const size_t n,
+    const DensityBins& bins,
+    u32* counts,
+    ThreadPool& pool) {
+    const size_t pixels = (size_t)bins.width * bins.height;
+    size_t slices = std::min(pool.concurrency(), n / kMinSlicePoints);
+    slices = std::min(slices, kSliceHistogramBytes / std::max<size_t>(1, pixels * 4));
+    if (slices <= 1) {
+        bin_density(pts, n, bins, counts);
+        return;
+    }
+    // Slice 0 bins straight into `counts`
+    std::vector<std::vector<u32>> partial(slices - 1);
+    const size_t per_slice = (n + slices - 1) / slices;
+    pool.parallel_for(
+        0,
+        slices,
+        [&](size_t first, size_t last) {
+            for (size_t s = first; s < last; ++s) {
+                u32* target = counts;
+                if (s > 0) {
+                    partial[s - 1].assign(pixels, 0);
+                    target = partial[s - 1].data();
+                }
+                size_t begin = s * per_slice;
+                size_t end = std::min(n, begin + per_slice);
+                bin_density(pts + begin, end - begin, bins, target);
+            }
+        },
+        1);
+    pool.parallel_for(
+        0,
+        pixels,
+        [&](size_t first, size_t last) {
+            for (const std::vector<u32>& part : partial) {
+                for (size_t p = first; p < last; ++p) {
+                    counts[p] += part[p];
+                }
+            }
+        },
+        1 << 16);
+}
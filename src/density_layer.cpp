@@ -0,0 +1,116 @@
+#include "density_layer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "render_stats.hpp"
+#include "thread_pool.hpp"
+
+// Screen pixels covered by one bin at the low end of a zoom level
+static const float kBinPixels = 2.0f;
+// Largest heatmap texture side
+static const int kMaxTextureSide = 4096;
+// Zoom levels kept as textures
+static const size_t kMaxCachedLevels = 8;
+
+DensityLayer::DensityLayer()
+    : pts(nullptr), count(0), current(0), clock(0) {}
+
+void DensityLayer::set_points(
+    const cv::Point2f* pts, const size_t n, const cv::Rect2f& bounds) {
+    this->unload();
+    this->pts = pts;
+    this->count = n;
+    this->bounds = bounds;
+}
+
+/* Bin the points for a zoom level and upload the heatmap
+ *
+ * Counts are mapped to color on a log scale, from faint purple for a single
+ * point to opaque yellow for the densest bin.
+ */
+DensityLayer::Level DensityLayer::build_level(const int level) const {
+    float bin = kBinPixels / std::ldexp(1.0f, level);
+    int width = 0;
+    int height = 0;
+    for (;;) {
+        width = (int)(this->bounds.width / bin) + 1;
+        height = (int)(this->bounds.height / bin) + 1;
+        if (width <= kMaxTextureSide && height <= kMaxTextureSide) break;
+        bin *= 2.0f;
+    }
+    DensityBins bins = {this->bounds.x, this->bounds.y, bin, width, height};
+    std::vector<u32> counts((size_t)width * height, 0);
+    bin_density(this->pts, this->count, bins, counts.data(), ThreadPool::global());
+
+    u32 max_count = *std::max_element(counts.begin(), counts.end());
+    float inv_log_max = max_count > 0 ? 1.0f / std::log1p((float)max_count) : 0.0f;
+    std::vector<Color> pixels(counts.size(), BLANK);
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] == 0) continue;
+        float t = std::log1p((float)counts[i]) * inv_log_max;
+        pixels[i] = {
+            (unsigned char)(PURPLE.r + (YELLOW.r - PURPLE.r) * t),
+            (unsigned char)(PURPLE.g + (YELLOW.g - PURPLE.g) * t),
+            (unsigned char)(PURPLE.b + (YELLOW.b - PURPLE.b) * t),
+            (unsigned char)(90.0f + 165.0f * t)};
+    }
+    Image image = {
+        pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    Level out;
+    out.texture = LoadTextureFromImage(image);
+    SetTextureFilter(out.texture, TEXTURE_FILTER_POINT);
+    out.bins = bins;
+    out.last_used = 0;
+    return out;
+}
+
+void DensityLayer::update(const float zoom) {
+    if (this->count == 0) {
+        return;
+    }
+    this->current = (int)std::floor(std::log2(zoom));
+    auto it = this->levels.find(this->current);
+    if (it == this->levels.end()) {
+        if (this->levels.size() >= kMaxCachedLevels) {
+            auto oldest = std::min_element(
+                this->levels.begin(),
+                this->levels.end(),
+                [](const auto& a, const auto& b) {
+                    return a.second.last_used < b.second.last_used;
+                });
+            UnloadTexture(oldest->second.texture);
+            this->levels.erase(oldest);
+        }
+        it = this->levels.emplace(this->current, this->build_level(this->current)).first;
+    }
+    it->second.last_used = ++this->clock;
+}
+
+void DensityLayer::draw() const {
+    auto it = this->levels.find(this->current);
+    if (it == this->levels.end()) {
+        return;
+    }
+    const Level& level = it->second;
+    const DensityBins& bins = level.bins;
+    CountDrawCalls(1);
+    DrawTexturePro(
+        level.texture,
+        {0.0f, 0.0f, (float)bins.width, (float)bins.height},
+        {bins.origin_x,
+         bins.origin_y,
+         bins.width * bins.bin_size,
+         bins.height * bins.bin_size},
+        {0.0f, 0.0f},
+        0.0f,
+        WHITE);
+}
+
+void DensityLayer::unload() {
+    for (auto& entry : this->levels) {
+        UnloadTexture(entry.second.texture);
+    }
+    this->levels.clear();
+}
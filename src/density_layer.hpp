@@ -0,0 +1,47 @@
+#ifndef DENSITY_LAYER_HPP
+#define DENSITY_LAYER_HPP
+
+#include <raylib.h>
+
+#include <map>
+#include <opencv2/core.hpp>
+
+#include "density.hpp"
+#include "types.hpp"
+
+/* Heatmap of point density for zoomed-out views
+ *
+ * Points are binned at a resolution of a few screen pixels per bin for the
+ * current power-of-two zoom level, on the thread pool, and the result is kept
+ * as a texture per level.  Zooming within a level, or back to a recently
+ * used one, costs nothing but the blit.
+ */
+class DensityLayer {
+   public:
+    DensityLayer();
+    // Points must outlive the layer or the next set_points call
+    void set_points(const cv::Point2f* pts, size_t n, const cv::Rect2f& bounds);
+    // Make the heatmap for `zoom` current, binning it if not cached
+    void update(float zoom);
+    // Call inside BeginMode2D
+    void draw() const;
+    void unload();
+
+   private:
+    struct Level {
+        Texture2D texture;
+        DensityBins bins;
+        u64 last_used;
+    };
+
+    const cv::Point2f* pts;
+    size_t count;
+    cv::Rect2f bounds;
+    std::map<int, Level> levels;
+    int current;
+    u64 clock;
+
+    Level build_level(int level) const;
+};
+
+#endif /* DENSITY_LAYER_HPP */
@@ -0,0 +1,9 @@
+#include "event_wake.hpp"
+
+/* Not declared by any raylib header: part of the GLFW compiled into raylib.
+ * It resolves only because the visualizer links the static libraylib.a (see
+ * CMakeLists.txt); libraylib.so keeps its GLFW symbols private.
+ */
+extern "C" void glfwPostEmptyEvent(void);
+
+void WakeEventLoop() { glfwPostEmptyEvent(); }
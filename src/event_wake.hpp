@@ -0,0 +1,12 @@
+#ifndef EVENT_WAKE_HPP
+#define EVENT_WAKE_HPP
+
+/* Wake a render loop blocked in raylib's event wait (EnableEventWaiting)
+ *
+ * Safe to call from any thread.  raylib has no call for this, so it goes to
+ * the GLFW that raylib bundles, whose symbols only the static libraylib.a
+ * exports; see event_wake.cpp.
+ */
+void WakeEventLoop();
+
+#endif /* EVENT_WAKE_HPP */
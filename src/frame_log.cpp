@@ -0,0 +1,326 @@
+#include "frame_log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// How far ahead of the read cursor the OS is asked to read
+static const size_t kReadAhead = 16 << 20;
+
+static FrameLogHeader MakeHeader() {
+    FrameLogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kFrameLogMagic, sizeof(header.magic));
+    header.version = kFrameLogVersion;
+    return header;
+}
+
+FrameLogWriter::FrameLogWriter() : file(nullptr), failed(false), offset(0) {}
+
+FrameLogWriter::~FrameLogWriter() { this->close(); }
+
+bool FrameLogWriter::open(const std::string& path) {
+    this->close();
+    this->file = std::fopen(path.c_str(), "wb");
+    if (this->file == nullptr) {
+        return false;
+    }
+    this->index.clear();
+    FrameLogHeader header = MakeHeader();
+    this->failed = std::fwrite(&header, sizeof(header), 1, this->file) != 1;
+    this->offset = sizeof(header);
+    return !this->failed;
+}
+
+bool FrameLogWriter::append(
+    const u64 timestamp_ns, const cv::Point2f* pts, const size_t n) {
+    if (this->file == nullptr || this->failed ||
+        n > std::numeric_limits<u32>::max() ||
+        (!this->index.empty() && timestamp_ns < this->index.back().timestamp_ns)) {
+        return false;
+    }
+    FrameRecord record = {timestamp_ns, (u32)n, 0};
+    if (std::fwrite(&record, sizeof(record), 1, this->file) != 1 ||
+        std::fwrite(pts, sizeof(cv::Point2f), n, this->file) != n) {
+        this->failed = true;
+        return false;
+    }
+    this->index.push_back({timestamp_ns, this->offset});
+    this->offset += sizeof(record) + n * sizeof(cv::Point2f);
+    return true;
+}
+
+bool FrameLogWriter::append(
+    const u64 timestamp_ns, const std::vector<cv::Point2f>& pts) {
+    return this->append(timestamp_ns, pts.data(), pts.size());
+}
+
+/* The index goes after the last frame, on an 8-byte boundary, and the header
+ * is rewritten last so a crash anywhere before leaves a log without an index
+ * rather than a broken one.
+ */
+bool FrameLogWriter::close() {
+    if (this->file == nullptr) {
+        return !this->failed;
+    }
+    static const u8 zeros[8] = {0};
+    const size_t pad = (8 - this->offset % 8) % 8;
+    FrameLogHeader header = MakeHeader();
+    header.index_offset = this->offset + pad;
+    header.frame_count = this->index.size();
+    const size_t n = this->index.size();
+    if (std::fwrite(zeros, 1, pad, this->file) != pad ||
+        std::fwrite(this->index.data(), sizeof(FrameLogEntry), n, this->file) != n ||
+        std::fflush(this->file) != 0 ||
+        std::fseek(this->file, 0, SEEK_SET) != 0 ||
+        std::fwrite(&header, sizeof(header), 1, this->file) != 1) {
+        this->failed = true;
+    }
+    if (std::fclose(this->file) != 0) {
+        this->failed = true;
+    }
+    this->file = nullptr;
+    return !this->failed;
+}
+
+size_t FrameLogWriter::size() const { return this->index.size(); }
+
+FrameLogReader::FrameLogReader()
+    : base(nullptr),
+      length(0),
+      entries(nullptr),
+      count(0),
+      frames_end(0),
+      cursor(0),
+      prefetched(0) {}
+
+FrameLogReader::~FrameLogReader() { this->close(); }
+
+bool FrameLogReader::open(const std::string& path) {
+    this->close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameLogHeader)) {
+        ::close(fd);
+        return false;
+    }
+    this->length = (size_t)st.st_size;
+    void* map = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        this->length = 0;
+        return false;
+    }
+    this->base = (const u8*)map;
+    madvise(map, this->length, MADV_SEQUENTIAL);
+
+    FrameLogHeader header;
+    memcpy(&header, this->base, sizeof(header));
+    if (memcmp(header.magic, kFrameLogMagic, sizeof(header.magic)) != 0 ||
+        header.version != kFrameLogVersion) {
+        this->close();
+        return false;
+    }
+    const size_t max_entries = this->length / sizeof(FrameLogEntry);
+    if (header.index_offset != 0 && header.index_offset % 8 == 0 &&
+        header.index_offset <= this->length &&
+        header.frame_count <= max_entries &&
+        header.frame_count * sizeof(FrameLogEntry) <=
+            this->length - header.index_offset) {
+        this->entries = (const FrameLogEntry*)(this->base + header.index_offset);
+        this->count = header.frame_count;
+        this->frames_end = header.index_offset;
+        // Only the ends are checked here, so opening stays constant time;
+        // every other frame is checked when it is read
+        FrameRecord first;
+        FrameRecord last;
+        if (this->count == 0 ||
+            (this->record_at(this->entries[0], first) &&
+             this->record_at(this->entries[this->count - 1], last) &&
+             first.timestamp_ns <= last.timestamp_ns)) {
+            return true;
+        }
+        this->entries = nullptr;
+        this->count = 0;
+    }
+    this->frames_end = this->length;
+    this->scan();
+    return true;
+}
+
+/* Read the record `entry` points at, if it is a whole frame before the index
+ * with the entry's timestamp
+ */
+bool FrameLogReader::record_at(const FrameLogEntry& entry, FrameRecord& out) const {
+    if (entry.offset < sizeof(FrameLogHeader) || entry.offset % 8 != 0 ||
+        entry.offset > this->frames_end ||
+        this->frames_end - entry.offset < sizeof(FrameRecord)) {
+        return false;
+    }
+    memcpy(&out, this->base + entry.offset, sizeof(out));
+    const size_t room = this->frames_end - entry.offset - sizeof(out);
+    return out.timestamp_ns == entry.timestamp_ns &&
+           (size_t)out.count <= room / sizeof(cv::Point2f);
+}
+
+/* Rebuild the index of a log whose writer did not close it
+ *
+ * Stops at the first frame that is cut off or out of order, which is where an
+ * interrupted writer left the file.
+ */
+void FrameLogReader::scan() {
+    size_t offset = sizeof(FrameLogHeader);
+    u64 last_timestamp = 0;
+    while (this->length - offset >= sizeof(FrameRecord)) {
+        FrameRecord record;
+        memcpy(&record, this->base + offset, sizeof(record));
+        const size_t bytes = sizeof(record) + (size_t)record.count * sizeof(cv::Point2f);
+        if (bytes > this->length - offset || record.timestamp_ns < last_timestamp) {
+            break;
+        }
+        this->scanned.push_back({record.timestamp_ns, offset});
+        last_timestamp = record.timestamp_ns;
+        offset += bytes;
+    }
+    this->entries = this->scanned.data();
+    this->count = this->scanned.size();
+}
+
+void FrameLogReader::close() {
+    if (this->base != nullptr) {
+        munmap((void*)this->base, this->length);
+    }
+    this->base = nullptr;
+    this->length = 0;
+    this->entries = nullptr;
+    this->count = 0;
+    this->frames_end = 0;
+    this->scanned.clear();
+    this->cursor = 0;
+    this->prefetched = 0;
+}
+
+size_t FrameLogReader::size() const { return this->count; }
+
+u64 FrameLogReader::timestamp(const size_t i) const {
+    return this->entries[i].timestamp_ns;
+}
+
+FrameView FrameLogReader::frame(const size_t i) const {
+    const FrameLogEntry& entry = this->entries[i];
+    FrameRecord record;
+    if (!this->record_at(entry, record)) {
+        return FrameView{entry.timestamp_ns, nullptr, 0};
+    }
+    return FrameView{
+        record.timestamp_ns,
+        (const cv::Point2f*)(this->base + entry.offset + sizeof(record)),
+        record.count,
+    };
+}
+
+size_t FrameLogReader::find(const u64 timestamp_ns) const {
+    const FrameLogEntry* it = std::lower_bound(
+        this->entries,
+        this->entries + this->count,
+        timestamp_ns,
+        [](const FrameLogEntry& e, u64 t) { return e.timestamp_ns < t; });
+    return (size_t)(it - this->entries);
+}
+
+void FrameLogReader::seek(const size_t i) {
+    this->cursor = std::min(i, this->count);
+    this->prefetched = 0;
+}
+
+size_t FrameLogReader::tell() const { return this->cursor; }
+
+bool FrameLogReader::next(FrameView& out) {
+    if (this->cursor >= this->count) {
+        return false;
+    }
+    this->read_ahead(this->entries[this->cursor].offset);
+    out = this->frame(this->cursor++);
+    if (out.points == nullptr) {
+        // The index points outside the log: treat it as ending here
+        this->cursor = this->count;
+        return false;
+    }
+    return true;
+}
+
+/* Keep at least half a read-ahead window requested past `offset`
+ *
+ * Requests go out a whole window at a time, so this is one madvise call per
+ * several megabytes read.
+ */
+void FrameLogReader::read_ahead(const size_t offset) {
+    if (offset < this->prefetched && this->prefetched - offset >= kReadAhead / 2) {
+        return;
+    }
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t begin = std::max(offset, this->prefetched) / page * page;
+    const size_t end = std::min(this->length, offset + kReadAhead);
+    if (begin < end) {
+        madvise((void*)(this->base + begin), end - begin, MADV_WILLNEED);
+    }
+    this->prefetched = end;
+}
+
+FramePlayer::FramePlayer(FrameLogReader& log)
+    : log(log), rate(1.0), anchor_wall(Clock::now()), anchor_log(0) {
+    if (log.tell() < log.size()) {
+        this->anchor_log = log.timestamp(log.tell());
+    }
+}
+
+void FramePlayer::set_speed(const double speed, const Clock::time_point now) {
+    if (std::isinf(this->rate)) {
+        // Everything was due; continue from the frame at the cursor
+        const size_t i = std::min(this->log.tell(), this->log.size() - 1);
+        this->anchor_log = this->log.size() > 0 ? this->log.timestamp(i) : 0;
+    } else {
+        this->anchor_log = this->position(now);
+    }
+    this->anchor_wall = now;
+    this->rate = std::max(speed, 0.0);
+}
+
+double FramePlayer::speed() const { return this->rate; }
+
+void FramePlayer::seek(const u64 timestamp_ns, const Clock::time_point now) {
+    this->log.seek(this->log.find(timestamp_ns));
+    this->anchor_log = timestamp_ns;
+    this->anchor_wall = now;
+}
+
+u64 FramePlayer::position(const Clock::time_point now) const {
+    if (std::isinf(this->rate)) {
+        return std::numeric_limits<u64>::max();
+    }
+    const double elapsed_ns =
+        std::chrono::duration<double, std::nano>(now - this->anchor_wall).count();
+    const double advance = std::max(elapsed_ns, 0.0) * this->rate;
+    const double limit = (double)(std::numeric_limits<u64>::max() - this->anchor_log);
+    return advance >= limit ? std::numeric_limits<u64>::max()
+                            : this->anchor_log + (u64)advance;
+}
+
+bool FramePlayer::next(const Clock::time_point now, FrameView& out) {
+    const size_t i = this->log.tell();
+    if (i >= this->log.size() || this->log.timestamp(i) > this->position(now)) {
+        return false;
+    }
+    return this->log.next(out);
+}
+
+bool FramePlayer::finished() const { return this->log.tell() >= this->log.size(); }
@@ -0,0 +1,165 @@
+#include "grid_layer.hpp"
+
+#include <rlgl.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "render_stats.hpp"
+#include "soft_raster.hpp"
+#include "trace.hpp"
+
+// Minimum on-screen distance between adjacent grid lines
+static const float kMinPixels = 8.0f;
+// Minor lines per major line, and the factor between spacing levels
+static const float kMajorEvery = 5.0f;
+
+GridLayer::GridLayer(Vector2 extent, float base_spacing, Color color)
+    : extent(extent),
+      base_spacing(base_spacing),
+      major_color(color),
+      minor_color(Fade(color, 0.45f)),
+      target{},
+      valid(false),
+      cached_camera{},
+      minor(base_spacing) {}
+
+/* Smallest spacing of the form base * 5^k that is at least kMinPixels apart
+ */
+float GridLayer::spacing_for_zoom(const float base, const float zoom) {
+    float spacing = base;
+    while (spacing * zoom < kMinPixels) {
+        spacing *= kMajorEvery;
+    }
+    while (spacing / kMajorEvery * zoom >= kMinPixels) {
+        spacing /= kMajorEvery;
+    }
+    return spacing;
+}
+
+void GridLayer::update(const Camera2D& camera) {
+    TRACE_SCOPE("GridLayer/update");
+    const Camera2D& c = this->cached_camera;
+    bool camera_changed = camera.zoom != c.zoom ||
+                          camera.target.x != c.target.x ||
+                          camera.target.y != c.target.y ||
+                          camera.offset.x != c.offset.x ||
+                          camera.offset.y != c.offset.y ||
+                          camera.rotation != c.rotation;
+    bool size_changed = this->target.texture.width != GetScreenWidth() ||
+                        this->target.texture.height != GetScreenHeight();
+    if (!this->valid || camera_changed || size_changed) {
+        this->regenerate(camera);
+    }
+}
+
+bool GridLayer::is_major(const float pos, const float minor) {
+    return std::fabs(std::remainder(pos, minor * kMajorEvery)) < minor * 0.5f;
+}
+
+/* Redraw the visible part of the grid into the render texture
+ *
+ * All lines go into one RL_LINES batch.
+ */
+void GridLayer::regenerate(const Camera2D& camera) {
+    const int width = GetScreenWidth();
+    const int height = GetScreenHeight();
+    if (this->target.texture.width != width ||
+        this->target.texture.height != height) {
+        if (this->target.id != 0) {
+            UnloadRenderTexture(this->target);
+        }
+        this->target = LoadRenderTexture(width, height);
+    }
+    this->minor = spacing_for_zoom(this->base_spacing, camera.zoom);
+
+    Vector2 tl = GetScreenToWorld2D({0.0f, 0.0f}, camera);
+    Vector2 br = GetScreenToWorld2D({(float)width, (float)height}, camera);
+    float x_lo = std::max(0.0f, tl.x);
+    float x_hi = std::min(this->extent.x, br.x);
+    float y_lo = std::max(0.0f, tl.y);
+    float y_hi = std::min(this->extent.y, br.y);
+
+    BeginTextureMode(this->target);
+    ClearBackground(BLANK);
+    if (x_lo <= x_hi && y_lo <= y_hi) {
+        BeginMode2D(camera);
+        rlBegin(RL_LINES);
+        auto set_color = [&](float pos) {
+            Color col = is_major(pos, this->minor) ? this->major_color
+                                                   : this->minor_color;
+            rlColor4ub(col.r, col.g, col.b, col.a);
+        };
+        for (float x = std::ceil(x_lo / this->minor) * this->minor; x < x_hi;
+             x += this->minor) {
+            set_color(x);
+            rlVertex2f(x, y_lo);
+            rlVertex2f(x, y_hi);
+        }
+        for (float y = std::ceil(y_lo / this->minor) * this->minor; y < y_hi;
+             y += this->minor) {
+            set_color(y);
+            rlVertex2f(x_lo, y);
+            rlVertex2f(x_hi, y);
+        }
+        rlEnd();
+        EndMode2D();
+    }
+    EndTextureMode();
+    this->cached_camera = camera;
+    this->valid = true;
+}
+
+/* Blit the cached grid
+ *
+ * Render textures are stored bottom-up, hence the negative source height.
+ */
+void GridLayer::draw() const {
+    TRACE_SCOPE("draw/grid");
+    if (!this->valid) {
+        return;
+    }
+    const Texture2D& tex = this->target.texture;
+    CountDrawCalls(1);
+    DrawTextureRec(
+        tex, {0.0f, 0.0f, (float)tex.width, -(float)tex.height}, {0.0f, 0.0f}, WHITE);
+}
+
+/* Same lines as regenerate, one pixel wide, into a software frame
+ */
+void GridLayer::rasterize(SoftRasterizer& raster, const Camera2D& camera) const {
+    const float minor = spacing_for_zoom(this->base_spacing, camera.zoom);
+    Vector2 tl = GetScreenToWorld2D({0.0f, 0.0f}, camera);
+    Vector2 br = GetScreenToWorld2D(
+        {(float)raster.width(), (float)raster.height()}, camera);
+    float x_lo = std::max(0.0f, tl.x);
+    float x_hi = std::min(this->extent.x, br.x);
+    float y_lo = std::max(0.0f, tl.y);
+    float y_hi = std::min(this->extent.y, br.y);
+    if (x_lo > x_hi || y_lo > y_hi) {
+        return;
+    }
+    const float thk = 1.0f / camera.zoom;
+    for (float x = std::ceil(x_lo / minor) * minor; x < x_hi; x += minor) {
+        raster.line(
+            {x, y_lo},
+            {x, y_hi},
+            thk,
+            is_major(x, minor) ? this->major_color : this->minor_color);
+    }
+    for (float y = std::ceil(y_lo / minor) * minor; y < y_hi; y += minor) {
+        raster.line(
+            {x_lo, y},
+            {x_hi, y},
+            thk,
+            is_major(y, minor) ? this->major_color : this->minor_color);
+    }
+}
+
+void GridLayer::unload() {
+    if (this->target.id != 0) {
+        UnloadRenderTexture(this->target);
+    }
+    this->target = RenderTexture2D{};
+    this->valid = false;
+}
@@ -0,0 +1,43 @@
+#ifndef GRID_LAYER_HPP
+#define GRID_LAYER_HPP
+
+#include <raylib.h>
+
+class SoftRasterizer;
+
+/* Background grid cached in a render texture
+ *
+ * The grid is redrawn into a window-sized RenderTexture2D only when the camera
+ * or window size changes; other frames cost a single textured quad.  Spacing
+ * adapts to the zoom so that minor lines stay 8 to 40 pixels apart on
+ * screen, with a major line every fifth minor line.
+ * Line count per frame is therefore bounded by the window size, not the
+ * grid extent or zoom.
+ */
+class GridLayer {
+   public:
+    GridLayer(Vector2 extent, float base_spacing, Color color);
+    // Regenerate the cache if needed; call outside BeginMode2D/BeginDrawing
+    void update(const Camera2D& camera);
+    // Draw the cached grid in screen space (outside BeginMode2D)
+    void draw() const;
+    // Record the grid as seen through `camera` for a headless frame
+    void rasterize(SoftRasterizer& raster, const Camera2D& camera) const;
+    void unload();
+
+   private:
+    Vector2 extent;
+    float base_spacing;
+    Color major_color;
+    Color minor_color;
+    RenderTexture2D target;
+    bool valid;
+    Camera2D cached_camera;
+    float minor;
+
+    void regenerate(const Camera2D& camera);
+    static bool is_major(float pos, float minor);
+    static float spacing_for_zoom(float base, float zoom);
+};
+
+#endif /* GRID_LAYER_HPP */
@@ -0,0 +1,717 @@
+#include "homography.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include "metrics.hpp"
+#include "thread_pool.hpp"
+
+/* Points and duration of each batch warp, by direction
+ *
+ * Shares transform_batch_points_total with the Transform2d kernels.
+ */
+struct WarpMetrics {
+    MetricCounter points;
+    MetricHistogram latency;
+};
+
+static const WarpMetrics& Warp(const bool to_world) {
+    static const WarpMetrics metrics[2] = {
+        {MetricsRegistry::global().counter(
+             "transform_batch_points_total",
+             "Points mapped by the Transform2d batch kernels",
+             "kernel=\"homography_world_to_local\""),
+         MetricsRegistry::global().histogram(
+             "homography_warp_seconds",
+             "Duration of Homography2d batch warps",
+             "direction=\"world_to_local\"")},
+        {MetricsRegistry::global().counter(
+             "transform_batch_points_total",
+             "Points mapped by the Transform2d batch kernels",
+             "kernel=\"homography_local_to_world\""),
+         MetricsRegistry::global().histogram(
+             "homography_warp_seconds",
+             "Duration of Homography2d batch warps",
+             "direction=\"local_to_world\"")},
+    };
+    return metrics[to_world ? 1 : 0];
+}
+
+/* Second-smallest over largest eigenvalue of the DLT normal matrix below
+ * which the solution is not unique; float inputs that are exactly collinear
+ * leave it around 1e-14
+ */
+static const double kDegenerateEigenRatio = 1e-10;
+
+namespace {
+
+/* Row-major 3x3 matrix used for the estimation math
+ *
+ * Estimation runs in double precision and only the final result is stored in
+ * the column-major float layout shared with Transform2d.
+ */
+typedef std::array<double, 9> Mat3d;
+
+/* Hartley normalization of a point set
+ *
+ * p' = s * p + t, chosen so the centroid moves to the origin and the mean
+ * distance from it becomes sqrt(2).
+ */
+struct Normalization {
+    double s;
+    double tx;
+    double ty;
+};
+
+/* Both sides of the correspondence set after normalization
+ *
+ * Stored as separate coordinate arrays so scoring streams through memory.
+ */
+struct NormalizedPairs {
+    std::vector<float> lx;
+    std::vector<float> ly;
+    std::vector<float> wx;
+    std::vector<float> wy;
+    Normalization local;
+    Normalization world;
+};
+
+}  // namespace
+
+/* Compute the Hartley normalization for a set of points
+ */
+static Normalization normalization_of(const std::vector<cv::Point2f>& pts) {
+    double cx = 0.0;
+    double cy = 0.0;
+    for (const cv::Point2f& pt : pts) {
+        cx += pt.x;
+        cy += pt.y;
+    }
+    cx /= pts.size();
+    cy /= pts.size();
+    double mean_dist = 0.0;
+    for (const cv::Point2f& pt : pts) {
+        mean_dist += std::hypot(pt.x - cx, pt.y - cy);
+    }
+    mean_dist /= pts.size();
+    double s = mean_dist > 0.0 ? M_SQRT2 / mean_dist : 1.0;
+    return {s, -s * cx, -s * cy};
+}
+
+static NormalizedPairs normalize_pairs(
+    const std::vector<cv::Point2f>& local,
+    const std::vector<cv::Point2f>& world) {
+    NormalizedPairs pairs;
+    pairs.local = normalization_of(local);
+    pairs.world = normalization_of(world);
+    const size_t n = local.size();
+    pairs.lx.resize(n);
+    pairs.ly.resize(n);
+    pairs.wx.resize(n);
+    pairs.wy.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        pairs.lx[i] = pairs.local.s * local[i].x + pairs.local.tx;
+        pairs.ly[i] = pairs.local.s * local[i].y + pairs.local.ty;
+        pairs.wx[i] = pairs.world.s * world[i].x + pairs.world.tx;
+        pairs.wy[i] = pairs.world.s * world[i].y + pairs.world.ty;
+    }
+    return pairs;
+}
+
+/* Eigen-decomposition of a symmetric 9x9 matrix by cyclic Jacobi rotations
+ *
+ * For the DLT normal matrix A^T A this is the SVD of A: eigenvalues are the
+ * squared singular values and the eigenvectors are the right singular vectors.
+ * On return `a` is diagonal and the columns of `v` are the eigenvectors.
+ */
+static void jacobi_eigen9(double a[9][9], double v[9][9]) {
+    for (int i = 0; i < 9; ++i) {
+        for (int j = 0; j < 9; ++j) {
+            v[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; ++sweep) {
+        double off = 0.0;
+        double diag = 0.0;
+        for (int p = 0; p < 9; ++p) {
+            diag += a[p][p] * a[p][p];
+            for (int q = p + 1; q < 9; ++q) {
+                off += a[p][q] * a[p][q];
+            }
+        }
+        if (off <= 1e-30 * diag) {
+            return;
+        }
+        for (int p = 0; p < 8; ++p) {
+            for (int q = p + 1; q < 9; ++q) {
+                if (a[p][q] == 0.0) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) /
+                           (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < 9; ++k) {
+                    double akp = a[k][p];
+                    double akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 9; ++k) {
+                    double apk = a[p][k];
+                    double aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 9; ++k) {
+                    double vkp = v[k][p];
+                    double vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+/* Direct Linear Transform over normalized pairs
+ *
+ * Accumulates the 9x9 normal matrix of the DLT system and takes the right
+ * singular vector with the smallest singular value.  `subset` selects the pairs
+ * to use; when empty, all pairs are used.  Returns false when a second singular
+ * value is (nearly) zero too: the pairs then fit a whole family of matrices,
+ * as when the points on either side are collinear.
+ */
+static bool solve_dlt(
+    const NormalizedPairs& pairs, const std::vector<u32>& subset, Mat3d& h) {
+    double ata[9][9] = {{0.0}};
+    auto accumulate = [&](size_t i) {
+        double x = pairs.lx[i];
+        double y = pairs.ly[i];
+        double u = pairs.wx[i];
+        double v = pairs.wy[i];
+        const double r1[9] = {-x, -y, -1.0, 0.0, 0.0, 0.0, u * x, u * y, u};
+        const double r2[9] = {0.0, 0.0, 0.0, -x, -y, -1.0, v * x, v * y, v};
+        for (int p = 0; p < 9; ++p) {
+            for (int q = p; q < 9; ++q) {
+                ata[p][q] += r1[p] * r1[q] + r2[p] * r2[q];
+            }
+        }
+    };
+    size_t count = subset.empty() ? pairs.lx.size() : subset.size();
+    if (count < 4) {
+        return false;
+    }
+    if (subset.empty()) {
+        for (size_t i = 0; i < count; ++i) accumulate(i);
+    } else {
+        for (u32 i : subset) accumulate(i);
+    }
+    for (int p = 0; p < 9; ++p) {
+        for (int q = 0; q < p; ++q) {
+            ata[p][q] = ata[q][p];
+        }
+    }
+
+    double v[9][9];
+    jacobi_eigen9(ata, v);
+    int min_idx = 0;
+    int max_idx = 0;
+    for (int i = 1; i < 9; ++i) {
+        if (ata[i][i] < ata[min_idx][min_idx]) min_idx = i;
+        if (ata[i][i] > ata[max_idx][max_idx]) max_idx = i;
+    }
+    int next_idx = min_idx == 0 ? 1 : 0;
+    for (int i = 0; i < 9; ++i) {
+        if (i != min_idx && ata[i][i] < ata[next_idx][next_idx]) next_idx = i;
+    }
+    if (!(ata[next_idx][next_idx] > kDegenerateEigenRatio * ata[max_idx][max_idx])) {
+        return false;
+    }
+    for (int i = 0; i < 9; ++i) {
+        h[i] = v[i][min_idx];
+    }
+    return std::isfinite(h[8]);
+}
+
+/* Exact homography through four normalized pairs
+ *
+ * Fixes h22 = 1 and solves the resulting 8x8 system by Gaussian elimination
+ * with partial pivoting.  Returns false for (near-)singular samples.
+ */
+static bool solve_minimal(const NormalizedPairs& pairs, const u32 idx[4], Mat3d& h) {
+    double m[8][9];
+    for (int k = 0; k < 4; ++k) {
+        double x = pairs.lx[idx[k]];
+        double y = pairs.ly[idx[k]];
+        double u = pairs.wx[idx[k]];
+        double v = pairs.wy[idx[k]];
+        double r1[9] = {x, y, 1.0, 0.0, 0.0, 0.0, -u * x, -u * y, u};
+        double r2[9] = {0.0, 0.0, 0.0, x, y, 1.0, -v * x, -v * y, v};
+        std::copy(r1, r1 + 9, m[2 * k]);
+        std::copy(r2, r2 + 9, m[2 * k + 1]);
+    }
+    for (int col = 0; col < 8; ++col) {
+        int pivot = col;
+        for (int row = col + 1; row < 8; ++row) {
+            if (std::fabs(m[row][col]) > std::fabs(m[pivot][col])) pivot = row;
+        }
+        if (std::fabs(m[pivot][col]) < 1e-10) {
+            return false;
+        }
+        if (pivot != col) {
+            std::swap(m[pivot], m[col]);
+        }
+        for (int row = col + 1; row < 8; ++row) {
+            double f = m[row][col] / m[col][col];
+            for (int k = col; k < 9; ++k) {
+                m[row][k] -= f * m[col][k];
+            }
+        }
+    }
+    for (int row = 7; row >= 0; --row) {
+        double acc = m[row][8];
+        for (int k = row + 1; k < 8; ++k) {
+            acc -= m[row][k] * h[k];
+        }
+        h[row] = acc / m[row][row];
+    }
+    h[8] = 1.0;
+    return true;
+}
+
+/* Twice the signed area of the triangle (a, b, c)
+ */
+static float cross3(
+    float ax, float ay, float bx, float by, float cx, float cy) {
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+/* Reject samples with three (nearly) collinear points on either side
+ */
+static bool sample_is_degenerate(const NormalizedPairs& pairs, const u32 idx[4]) {
+    static const int triples[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+    const float eps = 1e-5f;
+    for (const auto& t : triples) {
+        u32 a = idx[t[0]];
+        u32 b = idx[t[1]];
+        u32 c = idx[t[2]];
+        float cl = cross3(
+            pairs.lx[a], pairs.ly[a], pairs.lx[b], pairs.ly[b], pairs.lx[c], pairs.ly[c]);
+        float cw = cross3(
+            pairs.wx[a], pairs.wy[a], pairs.wx[b], pairs.wy[b], pairs.wx[c], pairs.wy[c]);
+        if (std::fabs(cl) < eps || std::fabs(cw) < eps) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* SplitMix64 step, used to derive an independent stream per hypothesis
+ *
+ * Seeding by hypothesis index keeps results independent of which worker
+ * thread happens to evaluate a given hypothesis.
+ */
+static u64 splitmix64(u64& state) {
+    u64 z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void draw_sample(u64 seed, u64 iteration, u32 n, u32 idx[4]) {
+    u64 state = seed ^ (iteration * 0xd1b54a32d192ed03ull);
+    for (int k = 0; k < 4;) {
+        u32 candidate = (u32)(((splitmix64(state) >> 32) * n) >> 32);
+        bool repeated = false;
+        for (int j = 0; j < k; ++j) {
+            repeated |= idx[j] == candidate;
+        }
+        if (!repeated) idx[k++] = candidate;
+    }
+}
+
+/* Count pairs whose forward transfer error is below the threshold
+ *
+ * Stops early once the hypothesis can no longer reach `to_beat` inliers.
+ */
+static int count_inliers(
+    const NormalizedPairs& pairs, const Mat3d& h, float thresh_sq, int to_beat) {
+    const float h0 = h[0], h1 = h[1], h2 = h[2];
+    const float h3 = h[3], h4 = h[4], h5 = h[5];
+    const float h6 = h[6], h7 = h[7], h8 = h[8];
+    const int n = (int)pairs.lx.size();
+    const float* lx = pairs.lx.data();
+    const float* ly = pairs.ly.data();
+    const float* wx = pairs.wx.data();
+    const float* wy = pairs.wy.data();
+    int count = 0;
+    const int block = 256;
+    for (int start = 0; start < n; start += block) {
+        if (count + (n - start) < to_beat) {
+            return -1;
+        }
+        const int end = std::min(n, start + block);
+        for (int i = start; i < end; ++i) {
+            float w = h6 * lx[i] + h7 * ly[i] + h8;
+            float inv_w = 1.0f / w;
+            float dx = (h0 * lx[i] + h1 * ly[i] + h2) * inv_w - wx[i];
+            float dy = (h3 * lx[i] + h4 * ly[i] + h5) * inv_w - wy[i];
+            count += (dx * dx + dy * dy < thresh_sq) ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+static std::vector<u32> collect_inliers(
+    const NormalizedPairs& pairs, const Mat3d& h, float thresh_sq) {
+    std::vector<u32> inliers;
+    for (size_t i = 0; i < pairs.lx.size(); ++i) {
+        double w = h[6] * pairs.lx[i] + h[7] * pairs.ly[i] + h[8];
+        double dx = (h[0] * pairs.lx[i] + h[1] * pairs.ly[i] + h[2]) / w - pairs.wx[i];
+        double dy = (h[3] * pairs.lx[i] + h[4] * pairs.ly[i] + h[5]) / w - pairs.wy[i];
+        if (dx * dx + dy * dy < thresh_sq) {
+            inliers.push_back((u32)i);
+        }
+    }
+    return inliers;
+}
+
+/* Number of RANSAC iterations needed for the given inlier ratio
+ */
+static int required_iterations(double inlier_ratio, double confidence, int max_iterations) {
+    double p_good_sample = std::pow(inlier_ratio, 4.0);
+    if (p_good_sample >= 1.0) return 1;
+    if (p_good_sample <= 0.0) return max_iterations;
+    double k = std::log(1.0 - confidence) / std::log(1.0 - p_good_sample);
+    return (int)std::min<double>(max_iterations, std::ceil(k));
+}
+
+/* Undo the normalization: H = T_world^-1 * Hn * T_local
+ *
+ * Returns the column-major float layout with h22 scaled to 1.0, falling back
+ * to unit Frobenius norm for (near-)affine-at-infinity solutions.
+ */
+static SqMatrix3 denormalize(const NormalizedPairs& pairs, const Mat3d& hn) {
+    const Normalization& l = pairs.local;
+    const Normalization& w = pairs.world;
+    const Mat3d t_local = {l.s, 0.0, l.tx, 0.0, l.s, l.ty, 0.0, 0.0, 1.0};
+    const Mat3d t_world_inv = {
+        1.0 / w.s, 0.0, -w.tx / w.s, 0.0, 1.0 / w.s, -w.ty / w.s, 0.0, 0.0, 1.0};
+    auto matmul = [](const Mat3d& a, const Mat3d& b) {
+        Mat3d c = {0.0};
+        for (int r = 0; r < 3; ++r) {
+            for (int col = 0; col < 3; ++col) {
+                for (int k = 0; k < 3; ++k) {
+                    c[r * 3 + col] += a[r * 3 + k] * b[k * 3 + col];
+                }
+            }
+        }
+        return c;
+    };
+    Mat3d h = matmul(matmul(t_world_inv, hn), t_local);
+    double scale = h[8];
+    if (std::fabs(scale) < 1e-12) {
+        scale = 0.0;
+        for (double value : h) scale += value * value;
+        scale = std::sqrt(scale);
+    }
+    SqMatrix3 out;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            out[c * 3 + r] = (float)(h[r * 3 + c] / scale);
+        }
+    }
+    return out;
+}
+
+static void check_correspondences(
+    const std::vector<cv::Point2f>& local, const std::vector<cv::Point2f>& world) {
+    if (local.size() != world.size()) {
+        throw std::invalid_argument(
+            "Homography2d: local and world point counts differ");
+    }
+    if (local.size() < 4) {
+        throw std::invalid_argument(
+            "Homography2d: at least 4 correspondences are required");
+    }
+}
+
+/* Default Constructor - Identity Matrix
+ */
+Homography2d::Homography2d()
+    : data({1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}),
+      inv_data({1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}) {}
+
+/* Conversion Constructor
+ */
+Homography2d::Homography2d(const SqMatrix3 matrix)
+    : data(matrix), inv_data(Homography2d::inv(matrix)) {}
+
+/* Normalized DLT estimate from 4 or more correspondences
+ *
+ * Every pair contributes equally, so this should only be used on data that is
+ * already free of outliers.  See `from_correspondences_ransac` otherwise.
+ */
+Homography2d Homography2d::from_correspondences(
+    const std::vector<cv::Point2f>& local,
+    const std::vector<cv::Point2f>& world) {
+    check_correspondences(local, world);
+    NormalizedPairs pairs = normalize_pairs(local, world);
+    Mat3d hn;
+    if (!solve_dlt(pairs, {}, hn)) {
+        throw std::runtime_error("Homography2d: degenerate correspondences");
+    }
+    return Homography2d(denormalize(pairs, hn));
+}
+
+/* Robust estimate from correspondences containing outliers
+ *
+ * Hypotheses come from random minimal (4-pair) samples and are scored in
+ * parallel by counting pairs within `reproj_threshold`.  The hypothesis range
+ * is spread over the pool; the iteration limit shrinks as better hypotheses
+ * are found.  The best hypothesis is refined with a normalized DLT over its
+ * inliers.
+ */
+Homography2d Homography2d::from_correspondences_ransac(
+    const std::vector<cv::Point2f>& local,
+    const std::vector<cv::Point2f>& world,
+    const RansacParams& params,
+    std::vector<u8>* inlier_mask) {
+    return Homography2d::from_correspondences_ransac(
+        local, world, params, inlier_mask, ThreadPool::global());
+}
+
+Homography2d Homography2d::from_correspondences_ransac(
+    const std::vector<cv::Point2f>& local,
+    const std::vector<cv::Point2f>& world,
+    const RansacParams& params,
+    std::vector<u8>* inlier_mask,
+    ThreadPool& pool) {
+    check_correspondences(local, world);
+    const NormalizedPairs pairs = normalize_pairs(local, world);
+    const u32 n = (u32)local.size();
+    const float thresh = params.reproj_threshold * pairs.world.s;
+    const float thresh_sq = thresh * thresh;
+
+    const int max_iterations = std::max(1, params.max_iterations);
+    std::atomic<int> iteration_limit{max_iterations};
+    std::atomic<int> best_count{-1};
+    std::mutex best_mutex;
+    int best_iteration = std::numeric_limits<int>::max();
+    Mat3d best_h = {0.0};
+
+    auto evaluate = [&](size_t first, size_t last) {
+        for (int it = (int)first; it < (int)last; ++it) {
+            if (it >= iteration_limit.load(std::memory_order_relaxed)) {
+                return;
+            }
+            u32 idx[4];
+            draw_sample(params.seed, (u64)it, n, idx);
+            Mat3d h;
+            if (sample_is_degenerate(pairs, idx) || !solve_minimal(pairs, idx, h)) {
+                continue;
+            }
+            int to_beat = best_count.load(std::memory_order_relaxed);
+            int count = count_inliers(pairs, h, thresh_sq, to_beat);
+            if (count < 4 || count < to_beat) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(best_mutex);
+            int current = best_count.load(std::memory_order_relaxed);
+            if (count > current || (count == current && it < best_iteration)) {
+                best_count.store(count, std::memory_order_relaxed);
+                best_iteration = it;
+                best_h = h;
+                int needed = required_iterations(
+                    (double)count / n, params.confidence, max_iterations);
+                if (needed < iteration_limit.load(std::memory_order_relaxed)) {
+                    iteration_limit.store(needed, std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    // Fanning out costs more than scoring a small problem serially
+    size_t grain = (u64)n * max_iterations < (1u << 18) ? max_iterations : 1;
+    pool.parallel_for(0, max_iterations, evaluate, grain);
+
+    if (best_count.load() < 4) {
+        throw std::runtime_error("Homography2d: no consensus among correspondences");
+    }
+
+    // Local refinement: refit on the consensus set while it keeps growing
+    std::vector<u32> inliers = collect_inliers(pairs, best_h, thresh_sq);
+    for (int round = 0; round < 3; ++round) {
+        Mat3d refined;
+        if (!solve_dlt(pairs, inliers, refined)) break;
+        std::vector<u32> refined_inliers = collect_inliers(pairs, refined, thresh_sq);
+        if (refined_inliers.size() < inliers.size()) break;
+        bool converged = refined_inliers.size() == inliers.size();
+        best_h = refined;
+        inliers.swap(refined_inliers);
+        if (converged) break;
+    }
+
+    if (inlier_mask != nullptr) {
+        inlier_mask->assign(n, 0);
+        for (u32 i : inliers) {
+            (*inlier_mask)[i] = 1;
+        }
+    }
+    return Homography2d(denormalize(pairs, best_h));
+}
+
+/* Transform a 2D point from world to local coordinates
+ *
+ * (H^-1) p_world = p_local, followed by the perspective divide.
+ */
+cv::Point2f Homography2d::world_to_local(const cv::Point2f pt) const {
+    return Homography2d::mul(this->inv_data, pt);
+}
+
+/* Transform a 2D point from local to world coordinates
+ *
+ * H * p_local = p_world, followed by the perspective divide.
+ */
+cv::Point2f Homography2d::local_to_world(const cv::Point2f pt) const {
+    return Homography2d::mul(this->data, pt);
+}
+
+/* Batch world-to-local mapping of `n` points from `in` into `out`
+ */
+void Homography2d::world_to_local(
+    const cv::Point2f* in, cv::Point2f* out, const size_t n) const {
+    const WarpMetrics& metrics = Warp(false);
+    metrics.points.add(n);
+    ScopedLatency latency(metrics.latency);
+    Homography2d::mul(this->inv_data, in, out, n);
+}
+
+void Homography2d::world_to_local(
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n,
+    ThreadPool& pool) const {
+    const WarpMetrics& metrics = Warp(false);
+    metrics.points.add(n);
+    ScopedLatency latency(metrics.latency);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Homography2d::mul(this->inv_data, in + first, out + first, last - first);
+        },
+        kPointBatchGrain);
+}
+
+/* Batch local-to-world mapping (point warp) of `n` points from `in` into `out`
+ */
+void Homography2d::local_to_world(
+    const cv::Point2f* in, cv::Point2f* out, const size_t n) const {
+    const WarpMetrics& metrics = Warp(true);
+    metrics.points.add(n);
+    ScopedLatency latency(metrics.latency);
+    Homography2d::mul(this->data, in, out, n);
+}
+
+void Homography2d::local_to_world(
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n,
+    ThreadPool& pool) const {
+    const WarpMetrics& metrics = Warp(true);
+    metrics.points.add(n);
+    ScopedLatency latency(metrics.latency);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Homography2d::mul(this->data, in + first, out + first, last - first);
+        },
+        kPointBatchGrain);
+}
+
+const SqMatrix3& Homography2d::matrix() const { return this->data; }
+
+/* Multiply a 3x3 matrix and a 2D point in homogeneous coordinates
+ *
+ * Unlike Transform2d::mul, the third row is applied and the result divided by
+ * the homogeneous coordinate.
+ */
+cv::Point2f Homography2d::mul(const SqMatrix3& matrix, const cv::Point2f pt) {
+    float w = matrix[2] * pt.x + matrix[5] * pt.y + matrix[8];
+    float inv_w = 1.0f / w;
+    return {
+        (matrix[0] * pt.x + matrix[3] * pt.y + matrix[6]) * inv_w,
+        (matrix[1] * pt.x + matrix[4] * pt.y + matrix[7]) * inv_w,
+    };
+}
+
+void Homography2d::mul(
+    const SqMatrix3& matrix,
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n) {
+    const float h00 = matrix[0], h10 = matrix[1], h20 = matrix[2];
+    const float h01 = matrix[3], h11 = matrix[4], h21 = matrix[5];
+    const float h02 = matrix[6], h12 = matrix[7], h22 = matrix[8];
+    for (size_t i = 0; i < n; ++i) {
+        const float x = in[i].x;
+        const float y = in[i].y;
+        const float inv_w = 1.0f / (h20 * x + h21 * y + h22);
+        out[i].x = (h00 * x + h01 * y + h02) * inv_w;
+        out[i].y = (h10 * x + h11 * y + h12) * inv_w;
+    }
+}
+
+/* Inverse of a 3x3 projective matrix
+ *
+ * Computed in double precision from the adjugate and scaled so the last
+ * element is 1.0 when it is not (near) zero.
+ */
+SqMatrix3 Homography2d::inv(const SqMatrix3 m) {
+    // Cofactors of the column-major matrix, laid out column-major
+    double a[9] = {
+        (double)m[4] * m[8] - (double)m[7] * m[5],
+        (double)m[7] * m[2] - (double)m[1] * m[8],
+        (double)m[1] * m[5] - (double)m[4] * m[2],
+        (double)m[6] * m[5] - (double)m[3] * m[8],
+        (double)m[0] * m[8] - (double)m[6] * m[2],
+        (double)m[3] * m[2] - (double)m[0] * m[5],
+        (double)m[3] * m[7] - (double)m[6] * m[4],
+        (double)m[6] * m[1] - (double)m[0] * m[7],
+        (double)m[0] * m[4] - (double)m[3] * m[1],
+    };
+    double det = m[0] * a[0] + m[3] * a[1] + m[6] * a[2];
+    double scale = std::fabs(a[8]) > 1e-12 * std::fabs(det) ? a[8] : det;
+    SqMatrix3 inverse;
+    for (int i = 0; i < 9; ++i) {
+        inverse[i] = (float)(a[i] / scale);
+    }
+    return inverse;
+}
+
+/* Serialize as a string
+ *
+ * Useful for debugging.
+ */
+std::string Homography2d::to_string() const {
+    std::stringstream ss;
+    ss << "Homography\n"
+       << "[\n"
+       << "  col_0: [" << this->data[0] << ", " << this->data[1] << ", "
+       << this->data[2] << "],\n"
+       << "  col_1: [" << this->data[3] << ", " << this->data[4] << ", "
+       << this->data[5] << "],\n"
+       << "  col_2: [" << this->data[6] << ", " << this->data[7] << ", "
+       << this->data[8] << "],\n"
+       << "]";
+    return ss.str();
+}
@@ -0,0 +1,104 @@
+#include "incremental_fit.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+SlidingLineFit::SlidingLineFit(const SlidingFitParams& params)
+    : params(params),
+      evictions_since_refresh(0),
+      have_reference(false),
+      reference(0.0f, 0.0f),
+      have_transform(false),
+      fitted(0.0f, 1.0f, 0.0f, 0.0f) {}
+
+/* Add a point and refit
+ *
+ * Evicts points that fell out of the window, updates the moments and rebuilds
+ * the transform only if the fit moved beyond the configured tolerances.
+ */
+bool SlidingLineFit::add(const cv::Point2f pt, const double timestamp) {
+    if (!this->have_reference) {
+        this->reference = pt;
+        this->have_reference = true;
+    }
+    this->window.push_back({pt, timestamp});
+    this->moments.add(pt);
+    if (this->params.max_points > 0) {
+        while (this->window.size() > this->params.max_points) {
+            this->evict_front();
+        }
+    }
+    if (this->params.max_age > 0.0) {
+        while (!this->window.empty() &&
+               timestamp - this->window.front().timestamp > this->params.max_age) {
+            this->evict_front();
+        }
+    }
+
+    if (this->moments.n < 2.0 || this->moments.sxx + this->moments.syy <= 0.0) {
+        return false;
+    }
+    cv::Vec4f fit = this->moments.fit();
+    if (this->have_transform && !this->fit_changed(fit)) {
+        return false;
+    }
+    this->fitted = fit;
+    this->tform = Transform2d(fit, this->reference);
+    this->have_transform = true;
+    return true;
+}
+
+/* Change the reference point and rebuild the transform if one exists
+ */
+void SlidingLineFit::set_reference(const cv::Point2f pt) {
+    this->reference = pt;
+    this->have_reference = true;
+    if (this->have_transform) {
+        this->tform = Transform2d(this->fitted, this->reference);
+    }
+}
+
+void SlidingLineFit::clear() {
+    *this = SlidingLineFit(this->params);
+}
+
+const Transform2d& SlidingLineFit::transform() const { return this->tform; }
+
+bool SlidingLineFit::has_transform() const { return this->have_transform; }
+
+cv::Vec4f SlidingLineFit::transform_fit() const { return this->fitted; }
+
+size_t SlidingLineFit::size() const { return this->window.size(); }
+
+/* Drop the oldest point
+ *
+ * Removal undoes the Welford update exactly in real arithmetic, but rounding
+ * accumulates over a long run.  The moments are recomputed from the window
+ * once per window length of evictions, which keeps the amortized cost O(1).
+ */
+void SlidingLineFit::evict_front() {
+    this->moments.remove(this->window.front().pt);
+    this->window.pop_front();
+    if (++this->evictions_since_refresh >= std::max<size_t>(this->window.size(), 64)) {
+        this->moments = LineMoments();
+        for (const Sample& sample : this->window) {
+            this->moments.add(sample.pt);
+        }
+        this->evictions_since_refresh = 0;
+    }
+}
+
+/* Whether `fit` differs materially from the line behind the transform
+ *
+ * Compares the sine of the angle between the directions, and the distance of
+ * the new centroid from the old line.
+ */
+bool SlidingLineFit::fit_changed(const cv::Vec4f fit) const {
+    const cv::Vec4f& old = this->fitted;
+    float sin_angle = std::fabs(old[0] * fit[1] - old[1] * fit[0]);
+    if (sin_angle > std::sin(this->params.angle_tolerance)) {
+        return true;
+    }
+    float offset = std::fabs(old[1] * (fit[2] - old[2]) - old[0] * (fit[3] - old[3]));
+    return offset > this->params.offset_tolerance;
+}
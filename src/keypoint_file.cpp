@@ -0,0 +1,299 @@
+#include "keypoint_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include "thread_pool.hpp"
+
+// Text is split into chunks of at least this many bytes
+static const size_t kMinTextChunk = 1 << 20;
+
+static size_t AlignUp(const size_t n, const size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+/* Map a whole file read-only
+ *
+ * Returns nullptr for missing or empty files.
+ */
+static const u8* MapFile(const std::string& path, size_t& length) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    length = (size_t)st.st_size;
+    void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    return map == MAP_FAILED ? nullptr : (const u8*)map;
+}
+
+KeypointFile::KeypointFile()
+    : base(nullptr), length(0), x(nullptr), y(nullptr), count(0) {}
+
+KeypointFile::~KeypointFile() { this->close(); }
+
+bool KeypointFile::open(const std::string& path) {
+    this->close();
+    size_t length = 0;
+    const u8* base = MapFile(path, length);
+    if (base == nullptr) {
+        return false;
+    }
+    this->base = base;
+    this->length = length;
+
+    KeypointFileHeader header;
+    bool ok = length >= sizeof(header);
+    if (ok) {
+        memcpy(&header, base, sizeof(header));
+        const size_t max_count = length / sizeof(float);
+        ok = memcmp(header.magic, kKeypointFileMagic, sizeof(header.magic)) == 0 &&
+             header.version == kKeypointFileVersion && header.count <= max_count &&
+             header.x_offset % 64 == 0 && header.y_offset % 64 == 0 &&
+             header.x_offset <= length &&
+             header.count * sizeof(float) <= length - header.x_offset &&
+             header.y_offset <= length &&
+             header.count * sizeof(float) <= length - header.y_offset;
+    }
+    if (!ok) {
+        this->close();
+        return false;
+    }
+    this->x = (const float*)(base + header.x_offset);
+    this->y = (const float*)(base + header.y_offset);
+    this->count = header.count;
+    return true;
+}
+
+void KeypointFile::close() {
+    if (this->base != nullptr) {
+        munmap((void*)this->base, this->length);
+    }
+    this->base = nullptr;
+    this->length = 0;
+    this->x = nullptr;
+    this->y = nullptr;
+    this->count = 0;
+}
+
+/* Ask the OS to start reading both columns of [first, last) in the background
+ */
+void KeypointFile::prefetch(size_t first, size_t last) const {
+    last = std::min(last, this->count);
+    if (first >= last) {
+        return;
+    }
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (const float* column : {this->x, this->y}) {
+        const size_t begin = (size_t)((const u8*)(column + first) - this->base);
+        const size_t end = (size_t)((const u8*)(column + last) - this->base);
+        const size_t aligned = begin / page * page;
+        madvise((void*)(this->base + aligned), end - aligned, MADV_WILLNEED);
+    }
+}
+
+size_t KeypointFile::size() const { return this->count; }
+
+const float* KeypointFile::xs() const { return this->x; }
+
+const float* KeypointFile::ys() const { return this->y; }
+
+cv::Point2f KeypointFile::at(const size_t i) const {
+    return cv::Point2f(this->x[i], this->y[i]);
+}
+
+/* Write one column followed by zero padding up to the next 64-byte boundary
+ *
+ * `stride` is the distance between values in floats, so interleaved points can
+ * be written as columns without an intermediate copy.
+ */
+static bool WriteColumn(
+    std::FILE* file, const float* values, const size_t stride, const size_t n) {
+    float buffer[1024];
+    for (size_t first = 0; first < n; first += 1024) {
+        const size_t m = std::min<size_t>(1024, n - first);
+        for (size_t i = 0; i < m; ++i) {
+            buffer[i] = values[(first + i) * stride];
+        }
+        if (std::fwrite(buffer, sizeof(float), m, file) != m) {
+            return false;
+        }
+    }
+    static const u8 zeros[64] = {0};
+    const size_t pad = AlignUp(n * sizeof(float), 64) - n * sizeof(float);
+    return std::fwrite(zeros, 1, pad, file) == pad;
+}
+
+static bool WriteKeypoints(
+    const std::string& path,
+    const float* xs,
+    const float* ys,
+    const size_t stride,
+    const size_t n) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    KeypointFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kKeypointFileMagic, sizeof(header.magic));
+    header.version = kKeypointFileVersion;
+    header.count = n;
+    header.x_offset = sizeof(header);
+    header.y_offset = header.x_offset + AlignUp(n * sizeof(float), 64);
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              WriteColumn(file, xs, stride, n) && WriteColumn(file, ys, stride, n);
+    ok = std::fclose(file) == 0 && ok;
+    return ok;
+}
+
+bool KeypointFile::write(
+    const std::string& path, const float* xs, const float* ys, const size_t n) {
+    return WriteKeypoints(path, xs, ys, 1, n);
+}
+
+bool KeypointFile::write(
+    const std::string& path, const cv::Point2f* pts, const size_t n) {
+    static_assert(sizeof(cv::Point2f) == 2 * sizeof(float), "packed points");
+    const float* xy = (const float*)pts;
+    return WriteKeypoints(path, xy, xy + 1, 2, n);
+}
+
+static bool IsBlank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static bool IsSeparator(const char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == ';';
+}
+
+/* Parse the lines in [first, last) into `out`
+ *
+ * `header` allows the first non-blank line to be something other than a
+ * point; only the chunk at the start of the file passes it.
+ */
+static bool ParseLines(
+    const char* first,
+    const char* last,
+    bool header,
+    std::vector<cv::Point2f>& out) {
+    const char* pos = first;
+    while (pos < last) {
+        const char* eol = (const char*)memchr(pos, '\n', last - pos);
+        if (eol == nullptr) eol = last;
+        const char* p = pos;
+        pos = eol + 1;
+        while (p < eol && IsBlank(*p)) ++p;
+        if (p == eol || *p == '#') {
+            continue;
+        }
+        cv::Point2f pt;
+        std::from_chars_result res = std::from_chars(p, eol, pt.x);
+        if (res.ec != std::errc()) {
+            if (header) {
+                header = false;
+                continue;
+            }
+            return false;
+        }
+        header = false;
+        // Each number must end at a separator or the line end, so "1-2" and
+        // "1.5.5" are not read as two numbers run together
+        p = res.ptr;
+        if (p == eol || !IsSeparator(*p)) {
+            return false;
+        }
+        while (p < eol && IsSeparator(*p)) ++p;
+        res = std::from_chars(p, eol, pt.y);
+        if (res.ec != std::errc() ||
+            (res.ptr != eol && !IsSeparator(*res.ptr) && *res.ptr != '\r')) {
+            return false;
+        }
+        out.push_back(pt);
+    }
+    return true;
+}
+
+bool parse_keypoints_text(
+    const std::string& path, std::vector<cv::Point2f>& out, ThreadPool& pool) {
+    out.clear();
+    size_t length = 0;
+    const u8* base = MapFile(path, length);
+    if (base == nullptr) {
+        // An empty file is an empty set; anything else is an error
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && st.st_size == 0;
+    }
+    madvise((void*)base, length, MADV_SEQUENTIAL);
+    const char* text = (const char*)base;
+
+    // Chunk boundaries, each moved forward to just after a line break
+    const size_t chunks = std::max<size_t>(
+        1, std::min(length / kMinTextChunk, pool.concurrency() * 4));
+    std::vector<size_t> bounds(chunks + 1, length);
+    bounds[0] = 0;
+    for (size_t k = 1; k < chunks; ++k) {
+        size_t at = std::max(length / chunks * k, bounds[k - 1]);
+        const void* eol = memchr(text + at, '\n', length - at);
+        bounds[k] = eol == nullptr ? length : (const char*)eol - text + 1;
+    }
+
+    std::vector<std::vector<cv::Point2f>> parsed(chunks);
+    std::vector<char> ok(chunks, 0);
+    pool.parallel_for(
+        0,
+        chunks,
+        [&](size_t first, size_t last) {
+            for (size_t k = first; k < last; ++k) {
+                ok[k] = ParseLines(
+                    text + bounds[k], text + bounds[k + 1], k == 0, parsed[k]);
+            }
+        },
+        1);
+    munmap((void*)base, length);
+
+    size_t total = 0;
+    for (size_t k = 0; k < chunks; ++k) {
+        if (!ok[k]) {
+            return false;
+        }
+        total += parsed[k].size();
+    }
+    out.reserve(total);
+    for (const std::vector<cv::Point2f>& pts : parsed) {
+        out.insert(out.end(), pts.begin(), pts.end());
+    }
+    return true;
+}
+
+bool load_keypoints(
+    const std::string& path, std::vector<cv::Point2f>& out, ThreadPool& pool) {
+    KeypointFile file;
+    if (!file.open(path)) {
+        return parse_keypoints_text(path, out, pool);
+    }
+    out.resize(file.size());
+    pool.parallel_for(
+        0,
+        file.size(),
+        [&](size_t first, size_t last) {
+            // One readahead request for the batch's pages of both columns
+            // instead of a fault per page
+            file.prefetch(first, last);
+            for (size_t i = first; i < last; ++i) {
+                out[i] = file.at(i);
+            }
+        },
+        kPointBatchGrain);
+    return true;
+}
@@ -0,0 +1,109 @@
+#include "keypoint_layer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "trace.hpp"
+
+// Estimated visible points above which the density heatmap is drawn instead
+static const double kLodPointThreshold = 200000.0;
+
+KeypointLayer::KeypointLayer()
+    : index(std::make_shared<PointGrid>()),
+      has_reference(false),
+      reference{0.0f, 0.0f},
+      dirty(true),
+      all_uploaded(false),
+      lod(false) {}
+
+void KeypointLayer::init() {
+    this->renderer.init();
+    this->dirty = true;
+}
+
+void KeypointLayer::unload() {
+    this->renderer.unload();
+    this->density.unload();
+}
+
+void KeypointLayer::set_grid(
+    std::shared_ptr<const PointGrid> grid,
+    const bool has_reference,
+    const Vector2 reference) {
+    this->index = std::move(grid);
+    this->has_reference = has_reference;
+    this->reference = reference;
+    const std::vector<cv::Point2f>& sorted = this->index->sorted_points();
+    this->density.set_points(sorted.data(), sorted.size(), this->index->bounds());
+    this->dirty = true;
+}
+
+/* Upload the keypoints in grid cells overlapping `view`
+ *
+ * Whole runs of cells are copied at once, so the cost scales with what is
+ * visible rather than with the dataset.  The visible count is first estimated
+ * from the overlap with the dataset bounds to decide on the heatmap.
+ */
+void KeypointLayer::update_view(const cv::Rect2f& view, const float zoom) {
+    TRACE_SCOPE("KeypointLayer/update_view");
+    const cv::Rect2f b = this->index->bounds();
+    const float bw = std::max(b.width, 1.0f);
+    const float bh = std::max(b.height, 1.0f);
+    const float ox = std::min(view.x + view.width, b.x + bw) - std::max(view.x, b.x);
+    const float oy = std::min(view.y + view.height, b.y + bh) - std::max(view.y, b.y);
+    const double overlap =
+        ox > 0.0f && oy > 0.0f ? (double)ox * oy / ((double)bw * bh) : 0.0;
+    this->lod = this->index->size() * overlap > kLodPointThreshold;
+    if (this->lod) {
+        this->density.update(zoom);
+        this->dirty = true;
+        return;
+    }
+
+    const bool contains_all = view.x <= b.x && view.y <= b.y &&
+                              view.x + view.width >= b.x + b.width &&
+                              view.y + view.height >= b.y + b.height;
+    if (!this->dirty) {
+        if (contains_all && this->all_uploaded) return;
+        if (view.x == this->last_view.x && view.y == this->last_view.y &&
+            view.width == this->last_view.width &&
+            view.height == this->last_view.height) {
+            return;
+        }
+    }
+    this->last_view = view;
+    this->dirty = false;
+
+    const std::vector<cv::Point2f>& pts = this->index->sorted_points();
+    this->index->query_runs(view, this->runs);
+    this->visible.clear();
+    for (const PointGrid::Run& run : this->runs) {
+        for (u32 i = run.first; i < run.second; ++i) {
+            this->visible.push_back({pts[i].x, pts[i].y});
+        }
+    }
+    this->renderer.set_points(this->visible);
+    this->all_uploaded = contains_all;
+}
+
+void KeypointLayer::draw(const float radius) const {
+    TRACE_SCOPE("draw/keypoints");
+    if (this->lod) {
+        this->density.draw();
+    } else {
+        this->renderer.draw(radius, PURPLE);
+    }
+    if (this->has_reference) {
+        DrawCircleV(this->reference, radius, YELLOW);
+    }
+}
+
+size_t KeypointLayer::drawn() const {
+    return this->lod ? 0 : this->renderer.size();
+}
+
+size_t KeypointLayer::culled() const {
+    return this->index->size() - this->drawn();
+}
+
+bool KeypointLayer::lod_active() const { return this->lod; }
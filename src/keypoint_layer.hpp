@@ -0,0 +1,58 @@
+#ifndef KEYPOINT_LAYER_HPP
+#define KEYPOINT_LAYER_HPP
+
+#include <raylib.h>
+
+#include <memory>
+#include <opencv2/core.hpp>
+#include <vector>
+
+#include "density_layer.hpp"
+#include "point_grid.hpp"
+#include "point_renderer.hpp"
+
+/* Keypoints of the current frame, culled to the view and drawn in batch
+ *
+ * The first keypoint is the reference point and is highlighted; the rest are
+ * indexed by a PointGrid.  When the view changes, only the grid rows that
+ * overlap it are gathered and uploaded, and nothing is re-uploaded while the
+ * view keeps containing the whole set.
+ *
+ * When more points would be visible than can usefully be drawn one by one,
+ * the layer switches to a density heatmap (level of detail) and skips the
+ * per-point gather entirely.
+ */
+class KeypointLayer {
+   public:
+    KeypointLayer();
+    // GL resources; call after InitWindow and before CloseWindow
+    void init();
+    void unload();
+    // Use an index built elsewhere, e.g. on the scene worker
+    void set_grid(
+        std::shared_ptr<const PointGrid> grid,
+        bool has_reference,
+        Vector2 reference);
+    // Re-cull against a world-space view rectangle if it changed
+    void update_view(const cv::Rect2f& view, float zoom);
+    // Call inside BeginMode2D
+    void draw(float radius) const;
+    size_t drawn() const;
+    size_t culled() const;
+    bool lod_active() const;
+
+   private:
+    PointRenderer renderer;
+    DensityLayer density;
+    std::shared_ptr<const PointGrid> index;
+    std::vector<PointGrid::Run> runs;
+    std::vector<Vector2> visible;
+    bool has_reference;
+    Vector2 reference;
+    bool dirty;
+    bool all_uploaded;
+    bool lod;
+    cv::Rect2f last_view;
+};
+
+#endif /* KEYPOINT_LAYER_HPP */
@@ -0,0 +1,100 @@
+#include "keypoint_stage.hpp"
+
+#include "line_fit.hpp"
+#include "thread_pool.hpp"
+
+KeypointStage::KeypointStage(
+    ThreadPool& pool, const size_t capacity, const size_t max_batch)
+    : pool(pool),
+      max_batch(max_batch > 0 ? max_batch : 1),
+      input(capacity),
+      output(capacity) {
+    this->dispatcher = std::thread(&KeypointStage::run, this);
+}
+
+/* Destructor
+ *
+ * Closes both queues so a dispatcher blocked on a full output queue (nobody
+ * popping) can exit; unconsumed results are dropped.
+ */
+KeypointStage::~KeypointStage() {
+    this->input.close();
+    this->output.close();
+    this->dispatcher.join();
+}
+
+bool KeypointStage::push(KeypointFrame frame) {
+    return this->input.push(std::move(frame));
+}
+
+bool KeypointStage::try_push(KeypointFrame& frame) {
+    return this->input.try_push(frame);
+}
+
+bool KeypointStage::pop(LocalFrame& out) { return this->output.pop(out); }
+
+void KeypointStage::close() { this->input.close(); }
+
+/* Fit, build the transform and map one frame
+ *
+ * The keypoint buffer is reused for the local coordinates, so a frame costs no
+ * allocation beyond its input.  Frames large enough to matter on their own are
+ * split across `pool` as well.  Frames with fewer than two keypoints are
+ * passed through unchanged with an identity transform.
+ */
+LocalFrame KeypointStage::process(KeypointFrame frame, ThreadPool* pool) {
+    LocalFrame out;
+    out.id = frame.id;
+    out.timestamp = frame.timestamp;
+    const size_t n = frame.keypoints.size();
+    const bool split = pool != nullptr && n >= 4 * kPointBatchGrain;
+    if (n >= 2) {
+        const cv::Point2f* pts = frame.keypoints.data();
+        out.line_fit = split ? fit_line(pts, n, *pool) : fit_line(pts, n);
+        out.tform = Transform2d(out.line_fit, frame.keypoints[0]);
+        out.valid = true;
+    }
+    out.local = std::move(frame.keypoints);
+    if (out.valid) {
+        cv::Point2f* pts = out.local.data();
+        if (split) {
+            out.tform.world_to_local(pts, pts, n, *pool);
+        } else {
+            out.tform.world_to_local(pts, pts, n);
+        }
+    }
+    return out;
+}
+
+/* Dispatcher loop
+ *
+ * Frames within a batch run in parallel; results are published in order and
+ * publishing blocks while the output queue is full.
+ */
+void KeypointStage::run() {
+    std::vector<KeypointFrame> batch;
+    std::vector<LocalFrame> results;
+    for (;;) {
+        batch.clear();
+        if (this->input.pop_batch(batch, this->max_batch) == 0) {
+            break;
+        }
+        results.resize(batch.size());
+        this->pool.parallel_for(
+            0,
+            batch.size(),
+            [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    results[i] = process(std::move(batch[i]), &this->pool);
+                }
+            },
+            1);
+        for (LocalFrame& result : results) {
+            if (!this->output.push(std::move(result))) {
+                return;
+            }
+        }
+        results.clear();
+    }
+    this->output.close();
+}
@@ -0,0 +1,153 @@
+#include "line_fit.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "metrics.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+static const MetricHistogram& FitLatency() {
+    static const MetricHistogram histogram = MetricsRegistry::global().histogram(
+        "transform_line_fit_seconds", "Duration of fit_line calls");
+    return histogram;
+}
+
+/* Add a point (Welford update)
+ */
+void LineMoments::add(const cv::Point2f pt) {
+    this->n += 1.0;
+    double dx = pt.x - this->mean_x;
+    double dy = pt.y - this->mean_y;
+    this->mean_x += dx / this->n;
+    this->mean_y += dy / this->n;
+    this->sxx += dx * (pt.x - this->mean_x);
+    this->syy += dy * (pt.y - this->mean_y);
+    this->sxy += dx * (pt.y - this->mean_y);
+}
+
+/* Remove a previously added point
+ *
+ * Exact inverse of `add`, so a sliding window costs O(1) per point.
+ */
+void LineMoments::remove(const cv::Point2f pt) {
+    if (this->n <= 1.0) {
+        *this = LineMoments();
+        return;
+    }
+    double old_mean_x = this->mean_x;
+    double old_mean_y = this->mean_y;
+    this->n -= 1.0;
+    this->mean_x = old_mean_x + (old_mean_x - pt.x) / this->n;
+    this->mean_y = old_mean_y + (old_mean_y - pt.y) / this->n;
+    this->sxx -= (pt.x - this->mean_x) * (pt.x - old_mean_x);
+    this->syy -= (pt.y - this->mean_y) * (pt.y - old_mean_y);
+    this->sxy -= (pt.x - this->mean_x) * (pt.y - old_mean_y);
+}
+
+/* Combine with the moments of a disjoint point set (Chan et al.)
+ */
+void LineMoments::merge(const LineMoments& other) {
+    if (other.n == 0.0) {
+        return;
+    }
+    if (this->n == 0.0) {
+        *this = other;
+        return;
+    }
+    double total = this->n + other.n;
+    double dx = other.mean_x - this->mean_x;
+    double dy = other.mean_y - this->mean_y;
+    double w = this->n * other.n / total;
+    this->sxx += other.sxx + dx * dx * w;
+    this->syy += other.syy + dy * dy * w;
+    this->sxy += other.sxy + dx * dy * w;
+    this->mean_x += dx * other.n / total;
+    this->mean_y += dy * other.n / total;
+    this->n = total;
+}
+
+/* Principal axis of the point covariance
+ *
+ * The direction is the major eigenvector of the 2x2 covariance matrix, found
+ * in closed form from its orientation angle.
+ */
+cv::Vec4f LineMoments::fit() const {
+    double angle = 0.5 * std::atan2(2.0 * this->sxy, this->sxx - this->syy);
+    float vx = std::cos(angle);
+    float vy = std::sin(angle);
+    if (vy < 0.0f || (vy == 0.0f && vx < 0.0f)) {
+        vx = -vx;
+        vy = -vy;
+    }
+    return {vx, vy, (float)this->mean_x, (float)this->mean_y};
+}
+
+cv::Vec4f fit_line(const cv::Point2f* pts, const size_t n) {
+    ScopedLatency latency(FitLatency());
+    LineMoments moments;
+    for (size_t i = 0; i < n; ++i) {
+        moments.add(pts[i]);
+    }
+    return moments.fit();
+}
+
+/* Parallel line fit
+ *
+ * Moments are gathered over fixed-size blocks and merged in block order, so
+ * the result does not depend on the pool size or scheduling.
+ */
+cv::Vec4f fit_line(const cv::Point2f* pts, const size_t n, ThreadPool& pool) {
+    TRACE_SCOPE("fit_line");
+    ScopedLatency latency(FitLatency());
+    const size_t block = 1 << 16;
+    const size_t num_blocks = (n + block - 1) / block;
+    std::vector<LineMoments> partial(num_blocks);
+    pool.parallel_for(
+        0,
+        num_blocks,
+        [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; ++b) {
+                size_t end = std::min(n, (b + 1) * block);
+                for (size_t i = b * block; i < end; ++i) {
+                    partial[b].add(pts[i]);
+                }
+            }
+        },
+        1);
+    LineMoments moments;
+    for (const LineMoments& part : partial) {
+        moments.merge(part);
+    }
+    return moments.fit();
+}
+
+cv::Vec4f fit_line(const std::vector<cv::Point2f>& pts) {
+    return fit_line(pts.data(), pts.size());
+}
+
+void line_residuals(
+    const cv::Vec4f line, const cv::Point2f* pts, float* out, const size_t n) {
+    const float vx = line[0];
+    const float vy = line[1];
+    const float x0 = line[2];
+    const float y0 = line[3];
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = vy * (pts[i].x - x0) - vx * (pts[i].y - y0);
+    }
+}
+
+void line_residuals(
+    const cv::Vec4f line,
+    const cv::Point2f* pts,
+    float* out,
+    const size_t n,
+    ThreadPool& pool) {
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            line_residuals(line, pts + first, out + first, last - first);
+        },
+        kPointBatchGrain);
+}
@@ -0,0 +1,53 @@
+#include "local_coord_cache.hpp"
+
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+LocalCoordCache::LocalCoordCache()
+    : world(nullptr), count(0), version(0), stale(false) {}
+
+void LocalCoordCache::set_points(
+    const cv::Point2f* pts, const size_t n, const u64 version) {
+    if (pts == this->world && n == this->count && version == this->version) {
+        return;
+    }
+    this->world = pts;
+    this->count = n;
+    this->version = version;
+    this->coords.resize(n);
+    this->stale = true;
+}
+
+void LocalCoordCache::set_transform(const Transform2d& tform) {
+    if (tform.matrix() == this->tform.matrix()) {
+        return;
+    }
+    this->tform = tform;
+    this->stale = true;
+}
+
+size_t LocalCoordCache::update() {
+    if (!this->stale) {
+        return 0;
+    }
+    this->tform.world_to_local(this->world, this->coords.data(), this->count);
+    this->stale = false;
+    return this->count;
+}
+
+// Below the batch grain the points simply map on the calling thread
+size_t LocalCoordCache::update(ThreadPool& pool) {
+    TRACE_SCOPE("LocalCoordCache/update");
+    if (!this->stale) {
+        return 0;
+    }
+    this->tform.world_to_local(this->world, this->coords.data(), this->count, pool);
+    this->stale = false;
+    return this->count;
+}
+
+size_t LocalCoordCache::size() const { return this->count; }
+
+const std::vector<cv::Point2f>& LocalCoordCache::local() const {
+    return this->coords;
+}
@@ -3,140 +3,371 @@
 #include <rlgl.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <opencv2/core.hpp>
 #include <opencv2/core/types.hpp>
 
+#include "axis_renderer.hpp"
+#include "event_wake.hpp"
+#include "frame_log.hpp"
+#include "grid_layer.hpp"
+#include "keypoint_file.hpp"
+#include "keypoint_layer.hpp"
+#include "perf_overlay.hpp"
+#include "render_stats.hpp"
+#include "scene_worker.hpp"
+#include "shm_ring.hpp"
+#include "soft_raster.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include "transform.hpp"
 
 typedef std::array<float, 9> Matrix3;
 
-void DrawGrid2d(Vector2 screen, float spacing, Color color) {
-    float x_pos = 0;
-    while (x_pos < screen.x) {
-        DrawLineV({x_pos, 0.0f}, {x_pos, screen.y}, color);
-        x_pos += spacing;
+// Distance from the cursor, in screen pixels, within which keypoints are picked
+static const float kPickPixels = 12.0f;
+
+// Most keypoint fit labels drawn at once; any more would just overlap
+static const size_t kMaxFitLabels = 256;
+
+/* World-space rectangle currently visible through `camera`
+ */
+cv::Rect2f ViewRect(const Camera2D& camera) {
+    Vector2 tl = GetScreenToWorld2D({0.0f, 0.0f}, camera);
+    Vector2 br = GetScreenToWorld2D(
+        {(float)GetScreenWidth(), (float)GetScreenHeight()}, camera);
+    return cv::Rect2f(tl.x, tl.y, br.x - tl.x, br.y - tl.y);
+}
+
+/* Pan with the right mouse button and zoom about the cursor with the wheel
+ *
+ * Returns true if the camera changed.
+ */
+bool PanZoomCamera(Camera2D& camera) {
+    bool moved = false;
+    if (IsMouseButtonDown(MouseButton::MOUSE_BUTTON_RIGHT)) {
+        Vector2 delta = GetMouseDelta();
+        if (delta.x != 0.0f || delta.y != 0.0f) {
+            camera.target = Vector2Subtract(
+                camera.target, Vector2Scale(delta, 1.0f / camera.zoom));
+            moved = true;
+        }
     }
-    float y_pos = 0;
-    while (y_pos < screen.y) {
-        DrawLineV({0.0f, y_pos}, {screen.x, y_pos}, color);
-        y_pos += spacing;
+    float wheel = GetMouseWheelMove();
+    if (wheel != 0.0f) {
+        Vector2 mouse_pos = GetMousePosition();
+        camera.target = GetScreenToWorld2D(mouse_pos, camera);
+        camera.offset = mouse_pos;
+        camera.zoom = Clamp(camera.zoom * expf(0.1f * wheel), 0.02f, 50.0f);
+        moved = true;
     }
+    return moved;
 }
 
-void DrawAxis(Transform2d xform, float scale, float thk) {
-    float fthk = thk * 2.0f;
-    float arr_tip_offset = scale * 0.2f + fthk;
-    if (scale < 10.0f) {
-        arr_tip_offset = 2.0f;
-        scale = 10.0f;
+/* Whether any part of an axis drawn by AxisRenderer can fall inside `view`
+ *
+ * Tests the circle around the origin that bounds both arrows.
+ */
+bool AxisVisible(
+    const Transform2d& xform, float scale, float thk, const cv::Rect2f& view) {
+    cv::Point2f origin = xform.local_to_world(cv::Point2f(0.0f, 0.0f));
+    float reach = std::max(scale, 10.0f) + 20.0f + 4.0f * thk;
+    float dx = origin.x - Clamp(origin.x, view.x, view.x + view.width);
+    float dy = origin.y - Clamp(origin.y, view.y, view.y + view.height);
+    return dx * dx + dy * dy <= reach * reach;
+}
+
+/* Keypoint nearest to `pos`, no further than `max_dist`
+ *
+ * Returns its position in the ingested keypoint list (0 being the reference)
+ * and stores it in `out`, or returns -1 if there is none in range.
+ */
+long PickKeypoint(
+    const Scene& scene, Vector2 pos, float max_dist, Vector2& out) {
+    long picked = -1;
+    u32 slot = 0;
+    if (scene.grid->nearest({pos.x, pos.y}, slot, max_dist)) {
+        const cv::Point2f& kp = scene.grid->sorted_points()[slot];
+        out = {kp.x, kp.y};
+        max_dist = Vector2Distance(pos, out);
+        picked = (long)scene.grid->sorted_ids()[slot] + 1;
     }
-    arr_tip_offset =
-        arr_tip_offset > 20.0 + fthk ? 20.0 + fthk : arr_tip_offset;
-    float arr_side_offset = arr_tip_offset * 0.3f;
-    float z = xform.z_mag();
-    if (z > 0) {
-        arr_side_offset = -arr_side_offset;
+    if (scene.has_reference && Vector2Distance(pos, scene.reference) <= max_dist) {
+        out = scene.reference;
+        picked = 0;
     }
+    return picked;
+}
 
-    cv::Point2f origin = xform.local_to_world(cv::Point2f(0.0f, 0.0f));
-    Vector2 origin_v = {origin.x, origin.y};
-
-    cv::Point2f x_axis_end = xform.local_to_world(cv::Point2f(scale, 0.0f));
-    DrawLineEx(origin_v, {x_axis_end.x, x_axis_end.y}, thk, RED);
-    cv::Point2f x_arrow_tip[3] = {
-        xform.local_to_world(cv::Point2f(scale + arr_tip_offset, 0.0f)),
-        xform.local_to_world(cv::Point2f(scale, arr_side_offset)),
-        xform.local_to_world(cv::Point2f(scale, -arr_side_offset)),
-    };
-    DrawTriangle(
-        {x_arrow_tip[0].x, x_arrow_tip[0].y},
-        {x_arrow_tip[1].x, x_arrow_tip[1].y},
-        {x_arrow_tip[2].x, x_arrow_tip[2].y},
-        RED);
-
-    cv::Point2f y_axis_end = xform.local_to_world(cv::Point2f(0.0f, scale));
-    DrawLineEx(origin_v, {y_axis_end.x, y_axis_end.y}, thk, GREEN);
-    cv::Point2f y_arrow_tip[3] = {
-        xform.local_to_world(cv::Point2f(0.0f, scale + arr_tip_offset)),
-        xform.local_to_world(cv::Point2f(-arr_side_offset, scale)),
-        xform.local_to_world(cv::Point2f(arr_side_offset, scale)),
-    };
-    cv::Point2f y_test[3] = {
-        cv::Point2f(0.0f, scale + arr_tip_offset),
-        cv::Point2f(-arr_side_offset, scale),
-        cv::Point2f(arr_side_offset, scale),
+/* Hand the newest frame that is due to the scene worker
+ *
+ * Frames that fell due since the last call and were overtaken are skipped; a
+ * display only needs the latest.  Returns true if a frame was posted.
+ */
+bool PostReplayFrame(FramePlayer& player, SceneWorker& worker) {
+    FrameView frame;
+    bool due = false;
+    FrameView latest = {0, nullptr, 0};
+    while (player.next(FramePlayer::Clock::now(), frame)) {
+        latest = frame;
+        due = true;
+    }
+    if (!due) {
+        return false;
+    }
+    worker.set_keypoints(latest.points, latest.count);
+    return true;
+}
+
+/* Hand the newest frame in a shared-memory ring to the scene worker
+ *
+ * Older frames are released unread so the producer never stalls on the
+ * display.  The points are mapped to world coordinates by the frame's
+ * transform, if it carries one, straight out of the slot and into the
+ * worker's buffer, and the slot is released as soon as that is done.
+ * Returns true if a frame was posted.
+ */
+bool PostShmFrame(ShmRing& ring, SceneWorker& worker) {
+    if (ring.available() == 0) {
+        return false;
+    }
+    while (ring.available() > 1) {
+        ring.peek(0);
+        ring.release();
+    }
+    const ShmFrame* frame = ring.peek(0);
+    if (frame->flags & kFrameHasTransform) {
+        const Transform2d to_world = frame->transform();
+        worker.set_keypoints(frame->points(), frame->count, &to_world);
+    } else {
+        worker.set_keypoints(frame->points(), frame->count);
+    }
+    ring.release();
+    return true;
+}
+
+/* Label every keypoint inside `view` with its fit coordinates
+ *
+ * Reads the coordinates the scene worker cached, so a frame only pays for the
+ * text.  Draws nothing when more than kMaxFitLabels keypoints are in view.
+ * Call outside BeginMode2D; `runs` is scratch space.
+ */
+void DrawFitLabels(
+    const Scene& scene,
+    const cv::Rect2f& view,
+    const Camera2D& camera,
+    std::vector<PointGrid::Run>& runs) {
+    const std::vector<cv::Point2f>& world = scene.grid->sorted_points();
+    const std::vector<cv::Point2f>& local = *scene.local;
+    if (local.size() != world.size()) {
+        return;
+    }
+    scene.grid->query_runs(view, runs);
+    size_t candidates = 0;
+    for (const PointGrid::Run& run : runs) {
+        candidates += run.second - run.first;
+    }
+    if (candidates > kMaxFitLabels) {
+        return;
+    }
+    auto label = [&camera](const cv::Point2f& kp, const cv::Point2f& l) {
+        Vector2 at = GetWorldToScreen2D({kp.x, kp.y}, camera);
+        DrawText(
+            TextFormat("(%.2f, %.2f)", l.x, l.y), at.x + 8, at.y + 8, 10, GRAY);
     };
-    DrawTriangle(
-        {y_arrow_tip[0].x, y_arrow_tip[0].y},
-        {y_arrow_tip[1].x, y_arrow_tip[1].y},
-        {y_arrow_tip[2].x, y_arrow_tip[2].y},
-        GREEN);
+    for (const PointGrid::Run& run : runs) {
+        for (u32 i = run.first; i < run.second; ++i) {
+            if (view.contains(world[i])) {
+                label(world[i], local[i]);
+            }
+        }
+    }
+    const cv::Point2f reference(scene.reference.x, scene.reference.y);
+    if (scene.has_reference && view.contains(reference)) {
+        label(reference, scene.reference_l);
+    }
+}
 
-    DrawCircleV(origin_v, 5.0f, LIGHTGRAY);
+void RasterAxis(
+    SoftRasterizer& raster, const Transform2d& xform, float scale, float thk) {
+    AxisShape axis = AxisGeometry(xform, scale, thk);
+    raster.line(axis.origin, axis.x_end, thk, RED);
+    raster.triangle(axis.x_tip[0], axis.x_tip[1], axis.x_tip[2], RED);
+    raster.line(axis.origin, axis.y_end, thk, GREEN);
+    raster.triangle(axis.y_tip[0], axis.y_tip[1], axis.y_tip[2], GREEN);
+    raster.circle(axis.origin, 5.0f, LIGHTGRAY);
 }
 
-void DrawKeypoints(std::vector<Vector2>& keypoints, float radius) {
-    bool first_done = false;
-    for (auto it = keypoints.begin(); it != keypoints.end(); ++it) {
-        if (!first_done) {
-            first_done = true;
-            continue;
+/* Stop tracing and write the trace to `path`, if tracing was requested
+ */
+bool FinishTrace(const char* path) {
+    if (path == nullptr) {
+        return true;
+    }
+    trace_stop();
+    if (!trace_write_json(path)) {
+        fprintf(stderr, "Could not write trace %s\n", path);
+        return false;
+    }
+    printf(
+        "Trace: %zu events (%zu dropped) in %s\n",
+        trace_event_count(),
+        trace_dropped_count(),
+        path);
+    return true;
+}
+
+/* Render the default view at native resolution without a window
+ *
+ * The frame is rasterized `frames` times, to measure throughput, and the
+ * last one is written to `path` as PNG.  Returns the process exit code.
+ */
+int RenderHeadless(
+    const char* path,
+    int frames,
+    Vector2 size,
+    const GridLayer& grid_layer,
+    const Scene& scene) {
+    const Camera2D native = {
+        .offset = {0.0f, 0.0f},
+        .target = {0.0f, 0.0f},
+        .rotation = 0.0f,
+        .zoom = 1.0f,
+    };
+    SoftRasterizer raster((int)size.x, (int)size.y);
+    raster.set_camera(native);
+    Transform2d world;
+    const cv::Point2f& pt = scene.pt;
+    const cv::Point2f& pt_l = scene.pt_l;
+    const float pt_radius = 5.0f;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        TRACE_SCOPE("frame");
+        raster.begin(Color{.r = 18, .g = 18, .b = 18, .a = 255});
+        grid_layer.rasterize(raster, native);
+        RasterAxis(raster, world, 500.0f, 4.0f);
+        RasterAxis(raster, scene.tform, 200.0f, 2.0f);
+        raster.circle({pt.x, pt.y}, pt_radius, PINK);
+        for (const cv::Point2f& kp : scene.grid->sorted_points()) {
+            raster.circle({kp.x, kp.y}, pt_radius, PURPLE);
         }
-        DrawCircleV({(*it).x, (*it).y}, radius, PURPLE);
+        if (scene.has_reference) {
+            raster.circle(scene.reference, pt_radius, YELLOW);
+        }
+        raster.line(scene.line_start, scene.line_end, 1.0f, LIGHTGRAY);
+        raster.text(
+            TextFormat("FIT: (%.4f, %.4f)", pt_l.x, pt_l.y),
+            {pt.x + 20.0f, pt.y + 20.0f},
+            20.0f,
+            SKYBLUE);
+        raster.text(
+            TextFormat("WORLD: (%.4f, %.4f)", pt.x, pt.y),
+            {20.0f, 20.0f},
+            20.0f,
+            SKYBLUE);
+        raster.end(ThreadPool::global());
+    }
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    printf(
+        "Rasterized %d frame(s) in %.3f s (%.1f fps)\n",
+        frames,
+        secs,
+        frames / std::max(secs, 1e-9));
+    if (!raster.export_png(path)) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return 1;
     }
-    DrawCircleV({keypoints[0].x, keypoints[0].y}, radius, YELLOW);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
     int screen_w = 960;
     int screen_h = 540;
 
-    cv::Vec4f fit_line = {0.020584, 0.999788, 1233.198242, 1766.562988};
+    // --event-driven: redraw only when something changed, sleep otherwise
+    bool event_driven = false;
+    // --headless out.png [--frames N]: render on the CPU, without a window
+    const char* headless_path = nullptr;
+    int headless_frames = 1;
+    // --keypoints path: binary keypoint file or CSV instead of the built-in set
+    const char* keypoints_path = nullptr;
+    // --replay log [--speed X]: play back a frame log at X times real time
+    const char* replay_path = nullptr;
+    double replay_speed = 1.0;
+    // --shm name: show frames published to a shared-memory ring
+    const char* shm_name = nullptr;
+    // --trace out.json: record TRACE_SCOPEs, written out on exit
+    const char* trace_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--event-driven") == 0) {
+            event_driven = true;
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless_path = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headless_frames = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--keypoints") == 0 && i + 1 < argc) {
+            keypoints_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            replay_speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+    }
+    if (trace_path != nullptr) {
+        trace_set_thread_name("main");
+        trace_start();
+    }
+
+    // The line fit is computed from these on the scene worker, unless
+    // --keypoints replaces them
     cv::Point2f ht_ref_pt = {1216.782104, 969.212341};
-    const Transform2d tform(fit_line, ht_ref_pt);
-    std::vector<Vector2> keypoints = {
+    std::vector<cv::Point2f> keypoints = {
         {ht_ref_pt.x, ht_ref_pt.y},
-        {.x = 1217.944702, .y = 969.188354},
-        {.x = 1217.968872, .y = 1038.283081},
-        {.x = 1220.063477, .y = 1110.561890},
-        {.x = 1221.548340, .y = 1179.118530},
-        {.x = 1221.904907, .y = 1247.586548},
-        {.x = 1224.523560, .y = 1319.157227},
-        {.x = 1225.589844, .y = 1386.809692},
-        {.x = 1225.723633, .y = 1454.988647},
-        {.x = 1228.762207, .y = 1525.779541},
-        {.x = 1229.764893, .y = 1592.691284},
-        {.x = 1229.559692, .y = 1637.239380},
-        {.x = 1231.335327, .y = 1707.557983},
-        {.x = 1234.042847, .y = 1775.953735},
-        {.x = 1233.513062, .y = 1841.752197},
-        {.x = 1236.902100, .y = 1911.643311},
-        {.x = 1237.816406, .y = 1977.321167},
-        {.x = 1236.614990, .y = 2020.174194},
-        {.x = 1239.232544, .y = 2088.850830},
-        {.x = 1241.805298, .y = 2154.531494},
-        {.x = 1240.922241, .y = 2217.188721},
-        {.x = 1244.093628, .y = 2284.854004},
-        {.x = 1246.845093, .y = 2350.178711},
-        {.x = 1246.509521, .y = 2391.842041},
-        {.x = 1246.901855, .y = 2457.331299},
-        {.x = 1250.066284, .y = 2523.489746},
+        {1217.944702, 969.188354},
+        {1217.968872, 1038.283081},
+        {1220.063477, 1110.561890},
+        {1221.548340, 1179.118530},
+        {1221.904907, 1247.586548},
+        {1224.523560, 1319.157227},
+        {1225.589844, 1386.809692},
+        {1225.723633, 1454.988647},
+        {1228.762207, 1525.779541},
+        {1229.764893, 1592.691284},
+        {1229.559692, 1637.239380},
+        {1231.335327, 1707.557983},
+        {1234.042847, 1775.953735},
+        {1233.513062, 1841.752197},
+        {1236.902100, 1911.643311},
+        {1237.816406, 1977.321167},
+        {1236.614990, 2020.174194},
+        {1239.232544, 2088.850830},
+        {1241.805298, 2154.531494},
+        {1240.922241, 2217.188721},
+        {1244.093628, 2284.854004},
+        {1246.845093, 2350.178711},
+        {1246.509521, 2391.842041},
+        {1246.901855, 2457.331299},
+        {1250.066284, 2523.489746},
     };
 
-    float min_x = 5000.0f;
-    float min_y = 5000.0f;
-    float max_x = 0.0f;
-    float max_y = 0.0f;
-    for (auto& kp : keypoints) {
-        if (kp.x < min_x) min_x = kp.x;
-        if (kp.x > max_x) max_x = kp.x;
-        if (kp.y < min_y) min_y = kp.y;
-        if (kp.y > max_y) max_y = kp.y;
+    if (keypoints_path != nullptr &&
+        !load_keypoints(keypoints_path, keypoints, ThreadPool::global())) {
+        fprintf(stderr, "Could not load keypoints from %s\n", keypoints_path);
+        return 1;
     }
 
-    cv::Point2f pt(100.0f, 100.0f);
-    cv::Point2f pt_l = tform.world_to_local(pt);
+    const cv::Point2f initial_pt(100.0f, 100.0f);
 
     screen_w = 2160;
     screen_h = 3840;
@@ -148,30 +379,203 @@ int main(int argc, char* argv[]) {
         .zoom = 0.4f,
     };
 
+    GridLayer grid_layer(screen, 10.0f, DARKGRAY);
+    if (headless_path != nullptr) {
+        Scene scene;
+        scene.ingest(keypoints.data(), keypoints.size());
+        scene.set_probe(initial_pt);
+        int status = RenderHeadless(
+            headless_path, headless_frames, screen, grid_layer, scene);
+        if (!FinishTrace(trace_path)) status = 1;
+        return status;
+    }
+
+    FrameLogReader replay_log;
+    std::unique_ptr<FramePlayer> player;
+    if (replay_path != nullptr) {
+        if (!replay_log.open(replay_path)) {
+            fprintf(stderr, "Could not open frame log %s\n", replay_path);
+            return 1;
+        }
+        player = std::make_unique<FramePlayer>(replay_log);
+        player->set_speed(replay_speed, FramePlayer::Clock::now());
+    }
+    ShmRing shm_ring;
+    if (shm_name != nullptr && !shm_ring.attach(shm_name)) {
+        fprintf(stderr, "Could not attach to shared-memory ring %s\n", shm_name);
+        return 1;
+    }
+    const bool live = shm_name != nullptr;
+    // Speed to resume at when replay is paused with space
+    double paused_speed = 0.0;
+
     Transform2d world;
     InitWindow(screen_w * camera.zoom, screen_h * camera.zoom, "Visualizer 2D");
     SetTargetFPS(60);
-    bool move_pt;
+    KeypointLayer kp_layer;
+    kp_layer.init();
+    AxisRenderer world_axes;
+    world_axes.init();
+    world_axes.set_axes(&world, 1);
+    AxisRenderer fit_axes;
+    fit_axes.init();
+    // Whether raylib's PollInputEvents (and so EndDrawing) blocks for events
+    bool waiting_events = false;
+    // Fitting and mapping run on the worker; each new snapshot also wakes the
+    // loop if it is blocked waiting for events
+    std::unique_ptr<SceneWorker> worker =
+        std::make_unique<SceneWorker>([] { WakeEventLoop(); });
+    if (!player && !live) worker->set_keypoints(keypoints.data(), keypoints.size());
+    worker->set_probe(initial_pt);
+    cv::Point2f probe = initial_pt;
+    // Keypoint under the cursor, -1 for none
+    long hovered = -1;
+    Vector2 hovered_pt = {0.0f, 0.0f};
+    // L: label keypoints with their fit coordinates
+    bool show_fit_labels = false;
+    std::vector<PointGrid::Run> label_runs;
+    // P: frame time and per-stage statistics
+    bool show_perf = false;
+    PerfOverlay perf;
+    u64 keypoints_version = 0;
+    // Set by anything that changes what is on screen
+    bool dirty = true;
+    bool focused = IsWindowFocused();
+    bool minimized = IsWindowMinimized();
     while (!WindowShouldClose()) {
+        const PerfOverlay::Clock::time_point loop_start = PerfOverlay::Clock::now();
+        if (player) PostReplayFrame(*player, *worker);
+        if (live) PostShmFrame(shm_ring, *worker);
+        dirty |= worker->update();
+        const Scene& scene = worker->scene();
+        if (scene.keypoints_version != keypoints_version) {
+            keypoints_version = scene.keypoints_version;
+            kp_layer.set_grid(scene.grid, scene.has_reference, scene.reference);
+            fit_axes.set_axes(&scene.tform, 1);
+        }
+        const Transform2d& tform = scene.tform;
+        const cv::Point2f& pt = scene.pt;
+        const cv::Point2f& pt_l = scene.pt_l;
+
+        dirty |= PanZoomCamera(camera);
         if (IsMouseButtonDown(MouseButton::MOUSE_BUTTON_LEFT)) {
-            Vector2 mouse_pos = GetMousePosition();
-            pt.x = mouse_pos.x / camera.zoom;
-            pt.y = mouse_pos.y / camera.zoom;
-            pt_l = tform.world_to_local(pt);
+            Vector2 mouse_pos = GetScreenToWorld2D(GetMousePosition(), camera);
+            if (mouse_pos.x != probe.x || mouse_pos.y != probe.y) {
+                // Redrawn once the worker publishes the mapped point
+                probe = cv::Point2f(mouse_pos.x, mouse_pos.y);
+                worker->set_probe(probe);
+            }
+        }
+        {
+            Vector2 mouse_pos = GetScreenToWorld2D(GetMousePosition(), camera);
+            Vector2 pick_pt = hovered_pt;
+            long pick = PickKeypoint(
+                scene, mouse_pos, kPickPixels / camera.zoom, pick_pt);
+            bool moved =
+                pick_pt.x != hovered_pt.x || pick_pt.y != hovered_pt.y;
+            if (pick != hovered || (pick >= 0 && moved)) {
+                hovered = pick;
+                hovered_pt = pick_pt;
+                dirty = true;
+            }
+        }
+        if (IsKeyPressed(KEY_L)) {
+            show_fit_labels = !show_fit_labels;
+            dirty = true;
+        }
+        if (IsKeyPressed(KEY_P)) {
+            show_perf = !show_perf;
+            dirty = true;
+        }
+        if (player && IsKeyPressed(KEY_SPACE)) {
+            auto now = FramePlayer::Clock::now();
+            double resume = player->speed();
+            player->set_speed(paused_speed, now);
+            paused_speed = resume;
+            dirty = true;
+        }
+        if (player &&
+            (IsKeyPressed(KEY_RIGHT_BRACKET) || IsKeyPressed(KEY_LEFT_BRACKET))) {
+            // Faster or slower by factors of two
+            double factor = IsKeyPressed(KEY_RIGHT_BRACKET) ? 2.0 : 0.5;
+            if (player->speed() > 0.0) {
+                player->set_speed(
+                    player->speed() * factor, FramePlayer::Clock::now());
+            } else {
+                paused_speed *= factor;
+            }
+            dirty = true;
+        }
+        if (IsKeyPressed(KEY_E)) {
+            event_driven = !event_driven;
+            dirty = true;
+        }
+        if (IsWindowResized() || IsWindowFocused() != focused ||
+            IsWindowMinimized() != minimized) {
+            focused = IsWindowFocused();
+            minimized = IsWindowMinimized();
+            dirty = true;
+        }
+        // Replay and live frames do not arrive as window events, so while they
+        // stream the loop must not block waiting for events, neither here nor
+        // in EndDrawing
+        const bool streaming =
+            live || (player && !player->finished() && player->speed() > 0.0);
+        if (waiting_events != (event_driven && !streaming)) {
+            waiting_events = !waiting_events;
+            waiting_events ? EnableEventWaiting() : DisableEventWaiting();
+        }
+        if (event_driven && !dirty) {
+            // Nothing to redraw: block until the next input or window event,
+            // or just keep input current while frames stream in
+            PollInputEvents();
+            if (streaming) WaitTime(0.001);
+            continue;
+        }
+        // Input and snapshot handling of this iteration; skipped iterations
+        // are idle time, not frame work
+        perf.add_stage(
+            kStageCompute,
+            std::chrono::duration<double>(PerfOverlay::Clock::now() - loop_start).count());
+        dirty = false;
+        TRACE_SCOPE("frame");
+        perf.begin_frame();
+        const cv::Rect2f view = ViewRect(camera);
+        {
+            PerfOverlay::StageTimer timer(perf, kStageCompute);
+            kp_layer.update_view(view, camera.zoom);
+            grid_layer.update(camera);
         }
         BeginDrawing();
         {
             ClearBackground(Color{.r = 18, .g = 18, .b = 18, .a = 255});
+            {
+                PerfOverlay::StageTimer timer(perf, kStageGrid);
+                grid_layer.draw();
+            }
 
             BeginMode2D(camera);
             {
                 float pt_radius = 5.0f / camera.zoom;
-                DrawGrid2d(screen, 10.0f, DARKGRAY);
-                DrawAxis(world, 500.0f, 4.0f / camera.zoom);
-                DrawAxis(tform, 200.0f, 2.0f / camera.zoom);
-                DrawCircleV({pt.x, pt.y}, pt_radius, PINK);
-                DrawKeypoints(keypoints, pt_radius);
-                DrawLineV({min_x, min_y}, {max_x, max_y}, LIGHTGRAY);
+                {
+                    PerfOverlay::StageTimer timer(perf, kStageAxes);
+                    if (AxisVisible(world, 500.0f, 4.0f / camera.zoom, view)) {
+                        world_axes.draw(500.0f, 4.0f / camera.zoom);
+                    }
+                    if (AxisVisible(tform, 200.0f, 2.0f / camera.zoom, view)) {
+                        fit_axes.draw(200.0f, 2.0f / camera.zoom);
+                    }
+                }
+                {
+                    PerfOverlay::StageTimer timer(perf, kStageKeypoints);
+                    DrawCircleV({pt.x, pt.y}, pt_radius, PINK);
+                    kp_layer.draw(pt_radius);
+                    if (hovered >= 0) {
+                        DrawCircleLinesV(hovered_pt, 2.0f * pt_radius, RAYWHITE);
+                    }
+                    DrawLineV(scene.line_start, scene.line_end, LIGHTGRAY);
+                }
+                PerfOverlay::StageTimer timer(perf, kStageText);
                 const char* fit_lbl =
                     TextFormat("FIT: (%.4f, %.4f)", pt_l.x, pt_l.y);
                 DrawText(
@@ -182,11 +586,61 @@ int main(int argc, char* argv[]) {
                     SKYBLUE);
             }
             EndMode2D();
+            TRACE_SCOPE("draw/text");
+            PerfOverlay::StageTimer timer(perf, kStageText);
+            if (show_fit_labels && !kp_layer.lod_active()) {
+                DrawFitLabels(scene, view, camera, label_runs);
+            }
             const char* world_lbl =
                 TextFormat("WORLD: (%.4f, %.4f)", pt.x, pt.y);
             DrawText(world_lbl, 20, 20, 20, SKYBLUE);
+            if (player) {
+                // Time of the last frame handed out, from the start of the log
+                const size_t shown = replay_log.tell();
+                const double secs =
+                    shown > 0 ? (replay_log.timestamp(shown - 1) -
+                                 replay_log.timestamp(0)) * 1e-9
+                              : 0.0;
+                const bool paused = player->speed() == 0.0;
+                const char* replay_lbl = TextFormat(
+                    "REPLAY %.3f s  x%g%s  frame %zu/%zu",
+                    secs,
+                    paused ? paused_speed : player->speed(),
+                    paused ? " (paused)" : "",
+                    shown,
+                    replay_log.size());
+                DrawText(replay_lbl, 20, 48, 20, SKYBLUE);
+            }
+            if (hovered >= 0) {
+                cv::Point2f local =
+                    tform.world_to_local({hovered_pt.x, hovered_pt.y});
+                Vector2 at = GetWorldToScreen2D(hovered_pt, camera);
+                const char* kp_lbl = TextFormat(
+                    "KP %ld  WORLD: (%.4f, %.4f)  FIT: (%.4f, %.4f)",
+                    hovered,
+                    hovered_pt.x,
+                    hovered_pt.y,
+                    local.x,
+                    local.y);
+                DrawText(kp_lbl, at.x + 12, at.y - 28, 20, RAYWHITE);
+            }
         }
+        if (show_perf) {
+            perf.draw(GetScreenWidth() - 10, 10);
+        }
+        // Closed before EndDrawing, which also sleeps to hold the target FPS
+        // and, in event-driven mode, waits for the next event
+        perf.end_frame(kp_layer.drawn(), kp_layer.culled());
+        TRACE_SCOPE("EndDrawing");
+        // The batch of shapes and text that EndDrawing flushes
+        CountDrawCalls();
         EndDrawing();
     }
-    return 0;
+    worker.reset();
+    world_axes.unload();
+    fit_axes.unload();
+    kp_layer.unload();
+    grid_layer.unload();
+    CloseWindow();
+    return FinishTrace(trace_path) ? 0 : 1;
 }
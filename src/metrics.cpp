@@ -0,0 +1,236 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+
+thread_local MetricsShard* tl_metrics_shard = nullptr;
+
+// Returns the thread's shard to the registry when the thread exits
+struct MetricsShardOwner {
+    MetricsShard* shard = nullptr;
+    ~MetricsShardOwner() {
+        if (this->shard != nullptr) {
+            tl_metrics_shard = nullptr;
+            MetricsRegistry::global().detach(this->shard);
+        }
+    }
+};
+
+static thread_local MetricsShardOwner tl_owner;
+
+MetricsShard* attach_metrics_shard() {
+    MetricsShard* shard = MetricsRegistry::global().attach();
+    tl_metrics_shard = shard;
+    tl_owner.shard = shard;
+    return shard;
+}
+
+u64 histogram_bucket_low(const size_t bucket) {
+    const size_t sub_count = (size_t)1 << kHistogramSubBits;
+    if (bucket < sub_count) {
+        return bucket;
+    }
+    const int shift = (int)(bucket >> kHistogramSubBits) - 1;
+    return (u64)(sub_count + (bucket & (sub_count - 1))) << shift;
+}
+
+u64 histogram_bucket_high(const size_t bucket) {
+    const size_t sub_count = (size_t)1 << kHistogramSubBits;
+    if (bucket < sub_count) {
+        return bucket;
+    }
+    const int shift = (int)(bucket >> kHistogramSubBits) - 1;
+    return histogram_bucket_low(bucket) + ((u64)1 << shift) - 1;
+}
+
+u64 HistogramSnapshot::quantile(const double q) const {
+    if (this->count == 0) {
+        return 0;
+    }
+    // Rank of the value, 1-based
+    const double clamped = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+    u64 rank = (u64)(clamped * (double)this->count + 0.5);
+    if (rank < 1) rank = 1;
+    u64 seen = 0;
+    for (size_t b = 0; b < this->buckets.size(); ++b) {
+        seen += this->buckets[b];
+        if (seen >= rank) {
+            return histogram_bucket_low(b) +
+                   (histogram_bucket_high(b) - histogram_bucket_low(b)) / 2;
+        }
+    }
+    return histogram_bucket_high(this->buckets.size() - 1);
+}
+
+static void AppendHeader(
+    std::string& out, const std::string& name, const std::string& help, const char* type) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+// Metrics sharing a name (with different labels) share one HELP and TYPE
+template <typename Snapshot>
+static bool FirstOfName(const std::vector<Snapshot>& all, size_t i) {
+    for (size_t k = 0; k < i; ++k) {
+        if (all[k].name == all[i].name) return false;
+    }
+    return true;
+}
+
+std::string MetricsSnapshot::to_prometheus() const {
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::string out;
+    char line[64];
+    for (size_t i = 0; i < this->counters.size(); ++i) {
+        const CounterSnapshot& c = this->counters[i];
+        if (FirstOfName(this->counters, i)) {
+            AppendHeader(out, c.name, c.help, "counter");
+        }
+        snprintf(line, sizeof(line), " %llu\n", (unsigned long long)c.value);
+        out += c.name + (c.labels.empty() ? "" : "{" + c.labels + "}") + line;
+    }
+    for (size_t i = 0; i < this->histograms.size(); ++i) {
+        const HistogramSnapshot& h = this->histograms[i];
+        if (FirstOfName(this->histograms, i)) {
+            AppendHeader(out, h.name, h.help, "summary");
+        }
+        const std::string labels = h.labels.empty() ? "" : h.labels + ",";
+        for (double q : kQuantiles) {
+            snprintf(line, sizeof(line), "%g\"} %.9g\n", q, h.quantile(q) * 1e-9);
+            out += h.name + "{" + labels + "quantile=\"" + line;
+        }
+        const std::string braces = h.labels.empty() ? "" : "{" + h.labels + "}";
+        snprintf(line, sizeof(line), " %.9g\n", (double)h.sum * 1e-9);
+        out += h.name + "_sum" + braces + line;
+        snprintf(line, sizeof(line), " %llu\n", (unsigned long long)h.count);
+        out += h.name + "_count" + braces + line;
+    }
+    return out;
+}
+
+MetricsRegistry::MetricsRegistry() : retired(new MetricsShard()) {}
+
+MetricsRegistry& MetricsRegistry::global() {
+    // Never destroyed: threads may still record and exit during shutdown
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+MetricCounter MetricsRegistry::counter(
+    const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->counter_info.size(); ++i) {
+        const Info& info = this->counter_info[i];
+        if (info.name == name && info.labels == labels) {
+            return MetricCounter(i);
+        }
+    }
+    if (this->counter_info.size() >= kMaxCounters) {
+        return MetricCounter();
+    }
+    this->counter_info.push_back({name, help, labels});
+    return MetricCounter(this->counter_info.size() - 1);
+}
+
+MetricHistogram MetricsRegistry::histogram(
+    const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->histogram_info.size(); ++i) {
+        const Info& info = this->histogram_info[i];
+        if (info.name == name && info.labels == labels) {
+            return MetricHistogram(i);
+        }
+    }
+    if (this->histogram_info.size() >= kMaxHistograms) {
+        return MetricHistogram();
+    }
+    this->histogram_info.push_back({name, help, labels});
+    return MetricHistogram(this->histogram_info.size() - 1);
+}
+
+MetricsShard* MetricsRegistry::attach() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const std::unique_ptr<MetricsShard>& shard : this->shards) {
+        if (!shard->in_use) {
+            shard->in_use = true;
+            return shard.get();
+        }
+    }
+    this->shards.emplace_back(new MetricsShard());
+    this->shards.back()->in_use = true;
+    return this->shards.back().get();
+}
+
+static void Move(std::atomic<u64>& from, std::atomic<u64>& to) {
+    to.store(
+        to.load(std::memory_order_relaxed) + from.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    from.store(0, std::memory_order_relaxed);
+}
+
+/* Fold an exiting thread's counts into the retired totals and zero the shard
+ * for reuse; under the lock, so a snapshot sees them in exactly one place
+ */
+void MetricsRegistry::detach(MetricsShard* shard) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    MetricsShard& totals = *this->retired;
+    for (size_t c = 0; c < kMaxCounters; ++c) {
+        Move(shard->counters[c], totals.counters[c]);
+    }
+    for (size_t h = 0; h < kMaxHistograms; ++h) {
+        for (size_t b = 0; b < kHistogramBuckets; ++b) {
+            Move(shard->counts[h][b], totals.counts[h][b]);
+        }
+        Move(shard->sums[h], totals.sums[h]);
+    }
+    shard->in_use = false;
+}
+
+/* Counts recorded while the snapshot is taken may or may not be included, but
+ * each shard is read slot by slot, so no count is seen twice or lost.
+ */
+MetricsSnapshot MetricsRegistry::snapshot() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<const MetricsShard*> all = {this->retired.get()};
+    for (const std::unique_ptr<MetricsShard>& shard : this->shards) {
+        all.push_back(shard.get());
+    }
+    MetricsSnapshot snapshot;
+    for (size_t c = 0; c < this->counter_info.size(); ++c) {
+        const Info& info = this->counter_info[c];
+        CounterSnapshot value = {info.name, info.help, info.labels, 0};
+        for (const MetricsShard* shard : all) {
+            value.value += shard->counters[c].load(std::memory_order_relaxed);
+        }
+        snapshot.counters.push_back(value);
+    }
+    for (size_t h = 0; h < this->histogram_info.size(); ++h) {
+        const Info& info = this->histogram_info[h];
+        HistogramSnapshot value = {
+            info.name, info.help, info.labels, 0, 0, std::vector<u64>(kHistogramBuckets, 0)};
+        for (const MetricsShard* shard : all) {
+            for (size_t b = 0; b < kHistogramBuckets; ++b) {
+                const u64 n = shard->counts[h][b].load(std::memory_order_relaxed);
+                value.buckets[b] += n;
+                value.count += n;
+            }
+            value.sum += shard->sums[h].load(std::memory_order_relaxed);
+        }
+        snapshot.histograms.push_back(value);
+    }
+    return snapshot;
+}
+
+bool MetricsRegistry::write_prometheus(const std::string& path) {
+    const std::string text = this->snapshot().to_prometheus();
+    const std::string tmp = path + ".tmp";
+    std::FILE* file = std::fopen(tmp.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (std::fclose(file) != 0 || !written || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+#include "metrics_server.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "metrics.hpp"
+
+// How often the accept loop looks at `stopping`
+static const int kPollMs = 100;
+// Request headers beyond this are not read
+static const size_t kMaxRequest = 8192;
+// A client that sends nothing for this long is dropped
+static const int kReceiveTimeoutS = 2;
+
+static bool SendAll(const int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+static std::string Response(const char* status, const std::string& body) {
+    return std::string("HTTP/1.1 ") + status +
+           "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8"
+           "\r\nContent-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+
+/* Read the request line and headers, answer, close
+ */
+static void Serve(const int fd) {
+    struct timeval timeout = {kReceiveTimeoutS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequest) {
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        request.append(buffer, (size_t)n);
+    }
+    const size_t line_end = request.find("\r\n");
+    const std::string line = request.substr(0, line_end);
+    if (line.compare(0, 4, "GET ") != 0) {
+        SendAll(fd, Response("405 Method Not Allowed", "GET only\n"));
+        return;
+    }
+    const size_t path_end = line.find(' ', 4);
+    const std::string path = line.substr(
+        4, path_end == std::string::npos ? std::string::npos : path_end - 4);
+    if (path != "/metrics" && path != "/") {
+        SendAll(fd, Response("404 Not Found", "Not found\n"));
+        return;
+    }
+    SendAll(fd, Response("200 OK", MetricsRegistry::global().snapshot().to_prometheus()));
+}
+
+MetricsServer::MetricsServer() : listen_fd(-1), bound_port(0), stopping(false) {}
+
+MetricsServer::~MetricsServer() { this->stop(); }
+
+bool MetricsServer::start(const u16 port, const std::string& address) {
+    this->stop();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        return false;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    const int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t length = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &length) != 0) {
+        close(fd);
+        return false;
+    }
+    this->listen_fd = fd;
+    this->bound_port = ntohs(addr.sin_port);
+    this->stopping.store(false);
+    this->thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (this->thread.joinable()) {
+        this->stopping.store(true);
+        this->thread.join();
+    }
+    if (this->listen_fd >= 0) {
+        close(this->listen_fd);
+    }
+    this->listen_fd = -1;
+    this->bound_port = 0;
+}
+
+u16 MetricsServer::port() const { return this->bound_port; }
+
+void MetricsServer::run() {
+    while (!this->stopping.load()) {
+        struct pollfd pfd = {this->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, kPollMs) <= 0) {
+            continue;
+        }
+        const int client = accept4(this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        Serve(client);
+        close(client);
+    }
+}
@@ -0,0 +1,130 @@
+#include "perf_counters.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+#if defined(__linux__)
+struct EventSpec {
+    u32 type;
+    u64 config;
+};
+
+static const EventSpec kEvents[kPerfCounterCount] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int OpenEvent(const EventSpec& spec) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+static const char* const kCounterNames[kPerfCounterCount] = {
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+};
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+        this->fds[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() { this->close(); }
+
+bool PerfCounters::open() {
+    this->close();
+#if defined(__linux__)
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+        this->fds[i] = OpenEvent(kEvents[i]);
+    }
+#endif
+    return this->available();
+}
+
+void PerfCounters::close() {
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+#if defined(__linux__)
+        if (this->fds[i] >= 0) {
+            ::close(this->fds[i]);
+        }
+#endif
+        this->fds[i] = -1;
+    }
+}
+
+bool PerfCounters::available() const {
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+        if (this->fds[i] >= 0) return true;
+    }
+    return false;
+}
+
+bool PerfCounters::available(const PerfCounter counter) const {
+    return this->fds[counter] >= 0;
+}
+
+void PerfCounters::start() {
+#if defined(__linux__)
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+        if (this->fds[i] >= 0) {
+            ioctl(this->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(this->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::stop() {
+#if defined(__linux__)
+    for (int i = 0; i < kPerfCounterCount; ++i) {
+        if (this->fds[i] >= 0) {
+            ioctl(this->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+double PerfCounters::value(const PerfCounter counter) const {
+#if defined(__linux__)
+    // value, time enabled, time running
+    u64 data[3];
+    if (this->fds[counter] < 0 ||
+        read(this->fds[counter], data, sizeof(data)) != (ssize_t)sizeof(data) ||
+        data[2] == 0) {
+        return 0.0;
+    }
+    return (double)data[0] * ((double)data[1] / (double)data[2]);
+#else
+    (void)counter;
+    return 0.0;
+#endif
+}
+
+const char* PerfCounters::name(const PerfCounter counter) {
+    return kCounterNames[counter];
+}
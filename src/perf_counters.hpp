@@ -0,0 +1,56 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstddef>
+
+#include "types.hpp"
+
+enum PerfCounter {
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfL1dMisses,
+    kPerfLlcMisses,
+    kPerfBranchMisses,
+    kPerfCounterCount
+};
+
+/* Hardware performance counters of the calling process (Linux perf_event_open)
+ *
+ * Each counter is a separate event, so the kernel multiplexes them when the
+ * PMU has too few registers and `value` scales the count up by the fraction
+ * of time the event was actually scheduled.  Only user-space events are
+ * counted, which works at the default perf_event_paranoid level of 2.
+ *
+ * Events are inherited by threads created after `open`, and reading them adds
+ * up the live threads, so open the counters before starting a thread pool to
+ * include its workers.
+ *
+ * Counters that cannot be opened (no PMU in a VM, a stricter paranoid level,
+ * a non-Linux build) are simply unavailable; `open` fails only when none are.
+ */
+class PerfCounters {
+   public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // False if no counter is available
+    bool open();
+    void close();
+    bool available() const;
+    bool available(PerfCounter counter) const;
+
+    // Zero and enable every counter
+    void start();
+    void stop();
+    // Count between the last start and stop; 0 if unavailable
+    double value(PerfCounter counter) const;
+
+    static const char* name(PerfCounter counter);
+
+   private:
+    int fds[kPerfCounterCount];
+};
+
+#endif /* PERF_COUNTERS_HPP */
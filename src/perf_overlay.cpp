@@ -0,0 +1,150 @@
+#include "perf_overlay.hpp"
+
+#include <algorithm>
+
+#include "render_stats.hpp"
+
+static const char* const kStageNames[kStageCount] = {
+    "compute",
+    "grid",
+    "keypoints",
+    "axes",
+    "text",
+};
+
+static const int kPanelWidth = 300;
+static const int kGraphHeight = 60;
+static const int kLineHeight = 16;
+static const int kFontSize = 14;
+// Frame budget drawn across the graph
+static const float kBudgetMs = 1000.0f / 60.0f;
+
+PerfOverlay::StageTimer::StageTimer(PerfOverlay& overlay, const PerfStage stage)
+    : overlay(overlay), stage(stage), start(Clock::now()) {}
+
+PerfOverlay::StageTimer::~StageTimer() {
+    this->overlay.add_stage(
+        this->stage, std::chrono::duration<double>(Clock::now() - this->start).count());
+}
+
+PerfOverlay::PerfOverlay()
+    : next(0),
+      filled(0),
+      frame_start(Clock::now()),
+      window_draw_calls(0.0),
+      window_allocs(0.0),
+      window_alloc_bytes(0.0),
+      window_frames(0),
+      average_draw_calls(0.0),
+      average_allocs(0.0),
+      average_alloc_bytes(0.0),
+      last_drawn(0),
+      last_culled(0),
+      last_draw_calls(DrawCallCount()),
+      last_allocs(AllocationCount()),
+      last_alloc_bytes(AllocatedBytes()) {
+    std::fill(this->frame_ms, this->frame_ms + kPerfHistory, 0.0f);
+    std::fill(this->stage_s, this->stage_s + kStageCount, 0.0);
+    std::fill(this->window_stage_s, this->window_stage_s + kStageCount, 0.0);
+    std::fill(this->average_stage_ms, this->average_stage_ms + kStageCount, 0.0);
+}
+
+void PerfOverlay::begin_frame() { this->frame_start = Clock::now(); }
+
+void PerfOverlay::add_stage(const PerfStage stage, const double seconds) {
+    this->stage_s[stage] += seconds;
+}
+
+void PerfOverlay::end_frame(const size_t drawn, const size_t culled) {
+    const double secs =
+        std::chrono::duration<double>(Clock::now() - this->frame_start).count();
+    this->frame_ms[this->next] = (float)(secs * 1e3);
+    this->next = (this->next + 1) % kPerfHistory;
+    this->filled = std::min(this->filled + 1, kPerfHistory);
+    this->last_drawn = drawn;
+    this->last_culled = culled;
+
+    const u64 draw_calls = DrawCallCount();
+    const u64 allocs = AllocationCount();
+    const u64 alloc_bytes = AllocatedBytes();
+    this->window_draw_calls += (double)(draw_calls - this->last_draw_calls);
+    this->window_allocs += (double)(allocs - this->last_allocs);
+    this->window_alloc_bytes += (double)(alloc_bytes - this->last_alloc_bytes);
+    this->last_draw_calls = draw_calls;
+    this->last_allocs = allocs;
+    this->last_alloc_bytes = alloc_bytes;
+    for (int s = 0; s < kStageCount; ++s) {
+        this->window_stage_s[s] += this->stage_s[s];
+        this->stage_s[s] = 0.0;
+    }
+    if (++this->window_frames < kPerfAverageFrames) {
+        return;
+    }
+    const double n = (double)this->window_frames;
+    for (int s = 0; s < kStageCount; ++s) {
+        this->average_stage_ms[s] = this->window_stage_s[s] * 1e3 / n;
+        this->window_stage_s[s] = 0.0;
+    }
+    this->average_draw_calls = this->window_draw_calls / n;
+    this->average_allocs = this->window_allocs / n;
+    this->average_alloc_bytes = this->window_alloc_bytes / n;
+    this->window_draw_calls = 0.0;
+    this->window_allocs = 0.0;
+    this->window_alloc_bytes = 0.0;
+    this->window_frames = 0;
+}
+
+/* Text lines under a bar graph of the frame times, oldest on the left
+ *
+ * The graph scales to the slowest frame shown but never below twice the
+ * 60 FPS budget, whose level is marked with a line.
+ */
+void PerfOverlay::draw(const int right, const int top) const {
+    const int lines = 4 + kStageCount;
+    const int left = right - kPanelWidth;
+    const int height = kGraphHeight + 12 + lines * kLineHeight;
+    DrawRectangle(left, top, kPanelWidth, height, Color{0, 0, 0, 180});
+
+    float max_ms = 0.0f;
+    float sum_ms = 0.0f;
+    for (int i = 0; i < this->filled; ++i) {
+        max_ms = std::max(max_ms, this->frame_ms[i]);
+        sum_ms += this->frame_ms[i];
+    }
+    const float scale_ms = std::max(max_ms, 2.0f * kBudgetMs);
+    const float bar_w = (float)(kPanelWidth - 8) / kPerfHistory;
+    const float base = (float)(top + 4 + kGraphHeight);
+    for (int i = 0; i < this->filled; ++i) {
+        // Oldest frame first
+        const int at = (this->next - this->filled + i + kPerfHistory) % kPerfHistory;
+        const float ms = this->frame_ms[at];
+        const float h = ms / scale_ms * kGraphHeight;
+        const Color color = ms > kBudgetMs ? ORANGE : LIME;
+        DrawRectangleRec({left + 4 + i * bar_w, base - h, std::max(bar_w, 1.0f), h}, color);
+    }
+    const float budget_y = base - kBudgetMs / scale_ms * kGraphHeight;
+    DrawLineV({(float)left + 4, budget_y}, {(float)right - 4, budget_y}, GRAY);
+
+    const float last_ms =
+        this->filled > 0 ? this->frame_ms[(this->next + kPerfHistory - 1) % kPerfHistory] : 0.0f;
+    int y = (int)base + 8;
+    auto line = [&y, left](const char* text) {
+        DrawText(text, left + 6, y, kFontSize, RAYWHITE);
+        y += kLineHeight;
+    };
+    line(TextFormat(
+        "frame %.2f ms  avg %.2f ms  max %.2f ms",
+        last_ms,
+        this->filled > 0 ? sum_ms / this->filled : 0.0f,
+        max_ms));
+    for (int s = 0; s < kStageCount; ++s) {
+        line(TextFormat("  %-10s %7.3f ms", kStageNames[s], this->average_stage_ms[s]));
+    }
+    line(TextFormat("draw calls %.1f", this->average_draw_calls));
+    line(TextFormat(
+        "points %zu drawn  %zu culled", this->last_drawn, this->last_culled));
+    line(TextFormat(
+        "allocs %.1f/frame  %.1f KB/frame",
+        this->average_allocs,
+        this->average_alloc_bytes / 1024.0));
+}
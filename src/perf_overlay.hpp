@@ -0,0 +1,87 @@
+#ifndef PERF_OVERLAY_HPP
+#define PERF_OVERLAY_HPP
+
+#include <raylib.h>
+
+#include <chrono>
+#include <cstddef>
+
+#include "types.hpp"
+
+// CPU stages of a frame shown by the overlay
+enum PerfStage {
+    kStageCompute,
+    kStageGrid,
+    kStageKeypoints,
+    kStageAxes,
+    kStageText,
+    kStageCount
+};
+
+/* Frame-time graph and per-frame statistics drawn over the scene
+ *
+ * The main loop brackets each drawn frame with `begin_frame` and `end_frame`
+ * and times its stages with StageTimer; iterations that draw nothing are not
+ * accounted, and `end_frame` comes before the buffer swap, so neither the
+ * frame-rate limiter's sleep nor waiting for events counts as frame time.
+ * Draw calls and allocations come from the counters in
+ * render_stats.hpp and are taken from one end_frame to the next, so the
+ * allocations include those of the scene worker in between.  Stage times and
+ * counts are shown averaged over the last kPerfAverageFrames frames, the frame
+ * time as a graph of the last kPerfHistory frames.
+ */
+class PerfOverlay {
+   public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Adds the time until it goes out of scope to a stage
+    class StageTimer {
+       public:
+        StageTimer(PerfOverlay& overlay, PerfStage stage);
+        ~StageTimer();
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+       private:
+        PerfOverlay& overlay;
+        PerfStage stage;
+        Clock::time_point start;
+    };
+
+    static constexpr int kPerfHistory = 240;
+    static constexpr int kPerfAverageFrames = 30;
+
+    PerfOverlay();
+    void begin_frame();
+    // Close the frame; `drawn` and `culled` are the keypoints of the frame
+    void end_frame(size_t drawn, size_t culled);
+    void add_stage(PerfStage stage, double seconds);
+    // Draw the panel with its top-right corner at (`right`, `top`)
+    void draw(int right, int top) const;
+
+   private:
+    // Frame time in milliseconds, a ring of the last kPerfHistory frames
+    float frame_ms[kPerfHistory];
+    int next;
+    int filled;
+    Clock::time_point frame_start;
+    double stage_s[kStageCount];
+    // Sums over the current averaging window and the last complete window
+    double window_stage_s[kStageCount];
+    double window_draw_calls;
+    double window_allocs;
+    double window_alloc_bytes;
+    int window_frames;
+    double average_stage_ms[kStageCount];
+    double average_draw_calls;
+    double average_allocs;
+    double average_alloc_bytes;
+    size_t last_drawn;
+    size_t last_culled;
+    // Counter values at the end of the previous frame
+    u64 last_draw_calls;
+    u64 last_allocs;
+    u64 last_alloc_bytes;
+};
+
+#endif /* PERF_OVERLAY_HPP */
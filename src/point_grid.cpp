@@ -0,0 +1,299 @@
+#include "point_grid.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+#include "trace.hpp"
+
+// Upper bound on the cell count, to keep the cell table small for sparse data
+static const size_t kMaxCells = 1 << 24;
+
+PointGrid::PointGrid()
+    : cell(1.0f),
+      inv_cell(1.0f),
+      origin_x(0.0f),
+      origin_y(0.0f),
+      cols(0),
+      rows(0) {}
+
+/* Bucket the points into cells
+ *
+ * Two counting-sort passes: count per cell, then scatter into cell order.
+ */
+void PointGrid::build(const cv::Point2f* pts, const size_t n, float cell_size) {
+    TRACE_SCOPE("PointGrid/build");
+    this->points.clear();
+    this->ids.clear();
+    this->cell_start.clear();
+    this->cols = 0;
+    this->rows = 0;
+    this->extent = cv::Rect2f();
+    if (n == 0) {
+        return;
+    }
+
+    // Bounds of the finite points only; cell_x and cell_y clamp the rest
+    float min_x = std::numeric_limits<float>::infinity();
+    float min_y = min_x;
+    float max_x = -min_x;
+    float max_y = -min_x;
+    for (size_t i = 0; i < n; ++i) {
+        if (std::isfinite(pts[i].x) && std::isfinite(pts[i].y)) {
+            min_x = std::min(min_x, pts[i].x);
+            max_x = std::max(max_x, pts[i].x);
+            min_y = std::min(min_y, pts[i].y);
+            max_y = std::max(max_y, pts[i].y);
+        }
+    }
+    if (min_x > max_x) {
+        min_x = max_x = min_y = max_y = 0.0f;
+    }
+    // In double: the span of two finite floats can overflow a float
+    const double width = (double)max_x - min_x;
+    const double height = (double)max_y - min_y;
+    this->extent = cv::Rect2f(min_x, min_y, (float)width, (float)height);
+
+    if (!(cell_size > 0.0f)) {
+        // Aim for about 4 points per cell over the bounding box
+        double area = std::max(width, 1e-3) * std::max(height, 1e-3);
+        cell_size = (float)std::min(std::sqrt(area * 4.0 / n), (double)FLT_MAX);
+    }
+    cell_size = std::max(cell_size, 1e-3f);
+    for (;;) {
+        // Counted in double so the check comes before any conversion to int
+        const double cols = std::floor(width / cell_size) + 1.0;
+        const double rows = std::floor(height / cell_size) + 1.0;
+        if (cols * rows <= (double)std::max(kMaxCells, n)) {
+            this->cols = (int)cols;
+            this->rows = (int)rows;
+            break;
+        }
+        cell_size = std::min(cell_size * 2.0f, FLT_MAX);
+    }
+    this->cell = cell_size;
+    this->inv_cell = 1.0f / cell_size;
+    this->origin_x = min_x;
+    this->origin_y = min_y;
+
+    const size_t num_cells = (size_t)this->cols * this->rows;
+    std::vector<u32> cell_of(n);
+    this->cell_start.assign(num_cells + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        u32 c = (u32)(this->cell_y(pts[i].y) * this->cols + this->cell_x(pts[i].x));
+        cell_of[i] = c;
+        ++this->cell_start[c + 1];
+    }
+    for (size_t c = 0; c < num_cells; ++c) {
+        this->cell_start[c + 1] += this->cell_start[c];
+    }
+    std::vector<u32> cursor(this->cell_start.begin(), this->cell_start.end() - 1);
+    this->points.resize(n);
+    this->ids.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        u32 slot = cursor[cell_of[i]]++;
+        this->points[slot] = pts[i];
+        this->ids[slot] = (u32)i;
+    }
+}
+
+void PointGrid::build(const std::vector<cv::Point2f>& pts, const float cell_size) {
+    this->build(pts.data(), pts.size(), cell_size);
+}
+
+/* Clamped in float before the conversion, which is undefined for NaN and
+ * values out of int range; NaN fails both tests and lands in cell 0
+ */
+static int CellIndex(const float offset, const int cells) {
+    if (!(offset > 0.0f)) {
+        return 0;
+    }
+    if (offset >= (float)(cells - 1)) {
+        return cells - 1;
+    }
+    return (int)offset;
+}
+
+int PointGrid::cell_x(const float x) const {
+    return CellIndex((x - this->origin_x) * this->inv_cell, this->cols);
+}
+
+int PointGrid::cell_y(const float y) const {
+    return CellIndex((y - this->origin_y) * this->inv_cell, this->rows);
+}
+
+void PointGrid::query_runs(const cv::Rect2f& rect, std::vector<Run>& runs) const {
+    runs.clear();
+    if (this->points.empty()) {
+        return;
+    }
+    const cv::Rect2f& e = this->extent;
+    if (rect.x > e.x + e.width || rect.x + rect.width < e.x ||
+        rect.y > e.y + e.height || rect.y + rect.height < e.y) {
+        return;
+    }
+    const int cx0 = this->cell_x(rect.x);
+    const int cx1 = this->cell_x(rect.x + rect.width);
+    const int cy0 = this->cell_y(rect.y);
+    const int cy1 = this->cell_y(rect.y + rect.height);
+    for (int cy = cy0; cy <= cy1; ++cy) {
+        u32 first = this->cell_start[(size_t)cy * this->cols + cx0];
+        u32 last = this->cell_start[(size_t)cy * this->cols + cx1 + 1];
+        if (last == first) {
+            continue;
+        }
+        // Full-width rows are adjacent in storage; merge them
+        if (!runs.empty() && runs.back().second == first) {
+            runs.back().second = last;
+        } else {
+            runs.emplace_back(first, last);
+        }
+    }
+}
+
+void PointGrid::query_rect(const cv::Rect2f& rect, std::vector<u32>& out) const {
+    std::vector<Run> runs;
+    this->query_runs(rect, runs);
+    const float x1 = rect.x + rect.width;
+    const float y1 = rect.y + rect.height;
+    for (const Run& run : runs) {
+        for (u32 i = run.first; i < run.second; ++i) {
+            const cv::Point2f& pt = this->points[i];
+            if (pt.x >= rect.x && pt.x <= x1 && pt.y >= rect.y && pt.y <= y1) {
+                out.push_back(this->ids[i]);
+            }
+        }
+    }
+}
+
+void PointGrid::query_radius(
+    const cv::Point2f& center, const float radius, std::vector<u32>& out) const {
+    std::vector<Run> runs;
+    this->query_runs(
+        cv::Rect2f(center.x - radius, center.y - radius, 2.0f * radius, 2.0f * radius),
+        runs);
+    const float r2 = radius * radius;
+    for (const Run& run : runs) {
+        for (u32 i = run.first; i < run.second; ++i) {
+            const float dx = this->points[i].x - center.x;
+            const float dy = this->points[i].y - center.y;
+            if (dx * dx + dy * dy <= r2) {
+                out.push_back(this->ids[i]);
+            }
+        }
+    }
+}
+
+// Squared distance from `pt` to the block of cells [cx0, cx1] x [cy0, cy1]
+float PointGrid::cells_dist2(
+    const cv::Point2f& pt, const int cx0, const int cx1, const int cy0, const int cy1) const {
+    const float x0 = this->origin_x + cx0 * this->cell;
+    const float x1 = this->origin_x + (cx1 + 1) * this->cell;
+    const float y0 = this->origin_y + cy0 * this->cell;
+    const float y1 = this->origin_y + (cy1 + 1) * this->cell;
+    const float dx = std::max(std::max(x0 - pt.x, pt.x - x1), 0.0f);
+    const float dy = std::max(std::max(y0 - pt.y, pt.y - y1), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+void PointGrid::nearest_in(
+    const u32 first,
+    const u32 last,
+    const cv::Point2f& pt,
+    float& best_d2,
+    u32& slot) const {
+    for (u32 i = first; i < last; ++i) {
+        const float dx = this->points[i].x - pt.x;
+        const float dy = this->points[i].y - pt.y;
+        const float d2 = dx * dx + dy * dy;
+        if (d2 < best_d2) {
+            best_d2 = d2;
+            slot = i;
+        }
+    }
+}
+
+/* Ring search from the cell containing (or nearest to) `pt`
+ *
+ * After ring r, every cell within r cells of the start has been scanned.
+ * The distance to the nearest unscanned cell then bounds the distance to every
+ * unscanned point, which also ends the search quickly for query points far
+ * outside the grid.
+ */
+bool PointGrid::nearest(const cv::Point2f& pt, u32& slot, const float max_dist) const {
+    if (this->points.empty()) {
+        return false;
+    }
+    const u32 none = std::numeric_limits<u32>::max();
+    const int cx = this->cell_x(pt.x);
+    const int cy = this->cell_y(pt.y);
+    float best_d2 = max_dist * max_dist;
+    u32 best = none;
+    for (int r = 0;; ++r) {
+        const int x0 = cx - r;
+        const int x1 = cx + r;
+        const int y0 = cy - r;
+        const int y1 = cy + r;
+        const int row_x0 = std::max(x0, 0);
+        const int row_x1 = std::min(x1, this->cols - 1);
+        for (int y = std::max(y0, 0); y <= std::min(y1, this->rows - 1); ++y) {
+            const size_t row = (size_t)y * this->cols;
+            if (y == y0 || y == y1) {
+                // Top and bottom of the ring are one run of cells each
+                this->nearest_in(
+                    this->cell_start[row + row_x0],
+                    this->cell_start[row + row_x1 + 1],
+                    pt,
+                    best_d2,
+                    best);
+                continue;
+            }
+            if (x0 >= 0) {
+                this->nearest_in(
+                    this->cell_start[row + x0], this->cell_start[row + x0 + 1], pt, best_d2, best);
+            }
+            if (x1 < this->cols) {
+                this->nearest_in(
+                    this->cell_start[row + x1], this->cell_start[row + x1 + 1], pt, best_d2, best);
+            }
+        }
+
+        // Unscanned cells form up to four bands around the square
+        float bound = std::numeric_limits<float>::infinity();
+        if (x0 > 0) {
+            bound = std::min(bound, this->cells_dist2(pt, 0, x0 - 1, 0, this->rows - 1));
+        }
+        if (x1 < this->cols - 1) {
+            bound = std::min(
+                bound, this->cells_dist2(pt, x1 + 1, this->cols - 1, 0, this->rows - 1));
+        }
+        if (y0 > 0) {
+            bound = std::min(bound, this->cells_dist2(pt, row_x0, row_x1, 0, y0 - 1));
+        }
+        if (y1 < this->rows - 1) {
+            bound = std::min(
+                bound, this->cells_dist2(pt, row_x0, row_x1, y1 + 1, this->rows - 1));
+        }
+        if (bound >= best_d2) {
+            break;  // also once the whole grid has been scanned
+        }
+    }
+    if (best == none) {
+        return false;
+    }
+    slot = best;
+    return true;
+}
+
+size_t PointGrid::size() const { return this->points.size(); }
+
+cv::Rect2f PointGrid::bounds() const { return this->extent; }
+
+float PointGrid::cell_size() const { return this->cell; }
+
+const std::vector<cv::Point2f>& PointGrid::sorted_points() const {
+    return this->points;
+}
+
+const std::vector<u32>& PointGrid::sorted_ids() const { return this->ids; }
@@ -0,0 +1,185 @@
+#include "point_renderer.hpp"
+
+#include <raymath.h>
+#include <rlgl.h>
+
+#include <cmath>
+
+#include "render_stats.hpp"
+
+// Segments of the shared circle mesh; points are only a few pixels wide
+static const int kCircleSegments = 16;
+
+static const char* kPointVs = R"(#version 330
+in vec2 vertexPosition;
+in vec2 instanceOffset;
+uniform mat4 mvp;
+uniform float radius;
+void main() {
+    gl_Position = mvp * vec4(instanceOffset + vertexPosition * radius, 0.0, 1.0);
+}
+)";
+
+static const char* kPointFs = R"(#version 330
+uniform vec4 colDiffuse;
+out vec4 finalColor;
+void main() {
+    finalColor = colDiffuse;
+}
+)";
+
+PointRenderer::PointRenderer()
+    : instanced(false),
+      shader{0, nullptr},
+      mvp_loc(-1),
+      radius_loc(-1),
+      color_loc(-1),
+      offset_attrib(-1),
+      vao(0),
+      circle_vbo(0),
+      instance_vbo(0),
+      instance_capacity(0),
+      count(0) {}
+
+/* Build the unit circle and, where supported, the instancing resources
+ *
+ * Triangles use the same winding as raylib's DrawCircleSector so both paths
+ * survive the default back-face culling.
+ */
+void PointRenderer::init() {
+    this->unit_circle.clear();
+    const float step = 2.0f * PI / kCircleSegments;
+    for (int i = 0; i < kCircleSegments; ++i) {
+        float a0 = i * step;
+        float a1 = (i + 1) * step;
+        this->unit_circle.push_back({0.0f, 0.0f});
+        this->unit_circle.push_back({cosf(a1), sinf(a1)});
+        this->unit_circle.push_back({cosf(a0), sinf(a0)});
+    }
+
+    int version = rlGetVersion();
+    if (version != RL_OPENGL_33 && version != RL_OPENGL_43) {
+        return;
+    }
+    this->shader = LoadShaderFromMemory(kPointVs, kPointFs);
+    if (this->shader.id == rlGetShaderIdDefault()) {
+        return;
+    }
+    this->mvp_loc = rlGetLocationUniform(this->shader.id, "mvp");
+    this->radius_loc = rlGetLocationUniform(this->shader.id, "radius");
+    this->color_loc = rlGetLocationUniform(this->shader.id, "colDiffuse");
+    this->offset_attrib = rlGetLocationAttrib(this->shader.id, "instanceOffset");
+    int position_attrib = rlGetLocationAttrib(this->shader.id, "vertexPosition");
+
+    this->vao = rlLoadVertexArray();
+    rlEnableVertexArray(this->vao);
+    this->circle_vbo = rlLoadVertexBuffer(
+        this->unit_circle.data(),
+        (int)(this->unit_circle.size() * sizeof(Vector2)),
+        false);
+    rlSetVertexAttribute(position_attrib, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(position_attrib);
+    rlDisableVertexArray();
+    this->instanced = true;
+    this->reserve_instances(1024);
+}
+
+void PointRenderer::unload() {
+    if (this->instanced) {
+        rlUnloadVertexBuffer(this->instance_vbo);
+        rlUnloadVertexBuffer(this->circle_vbo);
+        rlUnloadVertexArray(this->vao);
+        UnloadShader(this->shader);
+    }
+    *this = PointRenderer();
+}
+
+/* Grow the per-instance buffer to hold at least `n` points
+ *
+ * Capacity doubles so a slowly growing point set reallocates rarely.
+ */
+void PointRenderer::reserve_instances(const size_t n) {
+    if (n <= this->instance_capacity) {
+        return;
+    }
+    size_t capacity = this->instance_capacity > 0 ? this->instance_capacity : 1;
+    while (capacity < n) capacity *= 2;
+    rlEnableVertexArray(this->vao);
+    if (this->instance_vbo != 0) {
+        rlUnloadVertexBuffer(this->instance_vbo);
+    }
+    this->instance_vbo =
+        rlLoadVertexBuffer(nullptr, (int)(capacity * sizeof(Vector2)), true);
+    rlSetVertexAttribute(this->offset_attrib, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(this->offset_attrib);
+    rlSetVertexAttributeDivisor(this->offset_attrib, 1);
+    rlDisableVertexArray();
+    this->instance_capacity = capacity;
+}
+
+void PointRenderer::set_points(const Vector2* pts, const size_t n) {
+    this->count = n;
+    if (!this->instanced) {
+        this->points.assign(pts, pts + n);
+        return;
+    }
+    this->reserve_instances(n);
+    if (n > 0) {
+        rlUpdateVertexBuffer(this->instance_vbo, pts, (int)(n * sizeof(Vector2)), 0);
+    }
+}
+
+void PointRenderer::set_points(const std::vector<Vector2>& pts) {
+    this->set_points(pts.data(), pts.size());
+}
+
+size_t PointRenderer::size() const { return this->count; }
+
+/* Draw every point as a filled circle of `radius` world units
+ *
+ * The pending rlgl batch is flushed first so earlier shapes keep their
+ * draw order, then all points go out in one instanced call.
+ */
+void PointRenderer::draw(const float radius, const Color color) const {
+    if (this->count == 0) {
+        return;
+    }
+    if (!this->instanced) {
+        this->draw_batched(radius, color);
+        CountDrawCalls(BatchedDrawCalls(this->count * this->unit_circle.size()));
+        return;
+    }
+    // The flush and the instanced draw
+    CountDrawCalls(2);
+    rlDrawRenderBatchActive();
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    float rgba[4] = {
+        color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f};
+    rlEnableShader(this->shader.id);
+    rlSetUniformMatrix(this->mvp_loc, mvp);
+    rlSetUniform(this->radius_loc, &radius, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(this->color_loc, rgba, RL_SHADER_UNIFORM_VEC4, 1);
+    rlEnableVertexArray(this->vao);
+    rlDrawVertexArrayInstanced(0, (int)this->unit_circle.size(), (int)this->count);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+/* Fallback: stream triangles through the rlgl batch
+ *
+ * rlgl flushes the batch when it fills, so this issues one draw per few
+ * thousand points rather than one per point.
+ */
+void PointRenderer::draw_batched(const float radius, const Color color) const {
+    const int verts = (int)this->unit_circle.size();
+    rlBegin(RL_TRIANGLES);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    for (const Vector2& pt : this->points) {
+        // Flushes a full batch; draw mode and color carry over
+        rlCheckRenderBatchLimit(verts);
+        for (const Vector2& v : this->unit_circle) {
+            rlVertex2f(pt.x + v.x * radius, pt.y + v.y * radius);
+        }
+    }
+    rlEnd();
+}
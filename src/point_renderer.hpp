@@ -0,0 +1,51 @@
+#ifndef POINT_RENDERER_HPP
+#define POINT_RENDERER_HPP
+
+#include <raylib.h>
+
+#include <cstddef>
+#include <vector>
+
+/* Batched renderer for large sets of same-sized filled circles
+ *
+ * The points are uploaded to a GPU buffer once per `set_points` call and drawn
+ * with a single instanced draw of a shared circle mesh, so a frame costs one
+ * draw call no matter how many points there are.  Where instancing is not
+ * available (OpenGL 1.1 / ES 2.0), points are streamed through the rlgl batch
+ * using a precomputed unit circle instead of per-point trigonometry.
+ *
+ * `init` and `unload` must run while the window (GL context) exists.
+ */
+class PointRenderer {
+   public:
+    PointRenderer();
+    void init();
+    void unload();
+    // Replace the point set; uploads immediately when instancing is in use
+    void set_points(const Vector2* pts, size_t n);
+    void set_points(const std::vector<Vector2>& pts);
+    // Draw all points; call inside BeginMode2D so the camera applies
+    void draw(float radius, Color color) const;
+    size_t size() const;
+
+   private:
+    bool instanced;
+    Shader shader;
+    int mvp_loc;
+    int radius_loc;
+    int color_loc;
+    int offset_attrib;
+    unsigned int vao;
+    unsigned int circle_vbo;
+    unsigned int instance_vbo;
+    size_t instance_capacity;
+    size_t count;
+    // CPU copy, only kept for the rlgl fallback path
+    std::vector<Vector2> points;
+    std::vector<Vector2> unit_circle;
+
+    void reserve_instances(size_t n);
+    void draw_batched(float radius, Color color) const;
+};
+
+#endif /* POINT_RENDERER_HPP */
@@ -0,0 +1,50 @@
+#include "render_stats.hpp"
+
+#include <rlgl.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static u64 draw_calls = 0;
+static std::atomic<u64> allocations(0);
+static std::atomic<u64> allocated_bytes(0);
+
+void CountDrawCalls(const size_t n) { draw_calls += n; }
+
+u64 DrawCallCount() { return draw_calls; }
+
+u64 AllocationCount() { return allocations.load(std::memory_order_relaxed); }
+
+u64 AllocatedBytes() { return allocated_bytes.load(std::memory_order_relaxed); }
+
+size_t BatchedDrawCalls(const size_t vertices) {
+    const size_t per_batch = (size_t)RL_DEFAULT_BATCH_BUFFER_ELEMENTS * 4;
+    return (vertices + per_batch - 1) / per_batch;
+}
+
+/* Counting replacements for the global operator new
+ *
+ * The array, nothrow and sized forms of new and every form of delete fall
+ * back to these or to free, so replacing the plain and aligned forms covers
+ * all of them.  Two relaxed increments per allocation are lost in the cost
+ * of malloc itself.
+ */
+static void* CountedAlloc(std::size_t size, std::size_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    void* p = alignment > alignof(std::max_align_t)
+                  ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                  : std::malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(std::size_t size) { return CountedAlloc(size, 0); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return CountedAlloc(size, (std::size_t)alignment);
+}
@@ -0,0 +1,27 @@
+#ifndef RENDER_STATS_HPP
+#define RENDER_STATS_HPP
+
+#include <cstddef>
+
+#include "types.hpp"
+
+/* Running counters behind the performance overlay
+ *
+ * Draw calls are counted by the layers where they submit GPU work: one per
+ * instanced draw, texture blit or rlgl batch flush they cause.  They are only
+ * touched on the render thread.
+ *
+ * Allocations are every global operator new in the process, on any thread;
+ * render_stats.cpp replaces operator new in the visualizer to count them.
+ *
+ * All counts only grow; readers take differences between frames.
+ */
+void CountDrawCalls(size_t n = 1);
+u64 DrawCallCount();
+u64 AllocationCount();
+u64 AllocatedBytes();
+
+// Draw calls rlgl issues to stream `vertices` through its default batch
+size_t BatchedDrawCalls(size_t vertices);
+
+#endif /* RENDER_STATS_HPP */
@@ -0,0 +1,184 @@
+#include "scene_worker.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "line_fit.hpp"
+#include "local_coord_cache.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+Scene::Scene()
+    : version(0),
+      inputs(0),
+      keypoints_version(0),
+      grid(std::make_shared<PointGrid>()),
+      has_reference(false),
+      reference{0.0f, 0.0f},
+      local(std::make_shared<std::vector<cv::Point2f>>()),
+      reference_l(0.0f, 0.0f),
+      line_fit(0.0f, 0.0f, 0.0f, 0.0f),
+      line_start{0.0f, 0.0f},
+      line_end{0.0f, 0.0f},
+      pt(0.0f, 0.0f),
+      pt_l(0.0f, 0.0f) {}
+
+/* Fit a line through all keypoints and rebuild the transform and index
+ *
+ * The transform is anchored at the reference keypoint.  With fewer than two
+ * keypoints there is nothing to fit and the previous transform is kept.
+ */
+void Scene::ingest(const cv::Point2f* pts, const size_t n) {
+    TRACE_SCOPE("Scene/ingest");
+    ++this->keypoints_version;
+    this->has_reference = n > 0;
+    if (this->has_reference) {
+        this->reference = {pts[0].x, pts[0].y};
+    }
+
+    std::shared_ptr<PointGrid> grid = std::make_shared<PointGrid>();
+    if (n > 1) {
+        grid->build(pts + 1, n - 1);
+    }
+    this->grid = std::move(grid);
+
+    this->line_start = {0.0f, 0.0f};
+    this->line_end = {0.0f, 0.0f};
+    if (n > 0) {
+        this->line_start = this->reference;
+        this->line_end = this->reference;
+        for (size_t i = 0; i < n; ++i) {
+            this->line_start.x = std::min(this->line_start.x, pts[i].x);
+            this->line_start.y = std::min(this->line_start.y, pts[i].y);
+            this->line_end.x = std::max(this->line_end.x, pts[i].x);
+            this->line_end.y = std::max(this->line_end.y, pts[i].y);
+        }
+    }
+
+    if (n >= 2) {
+        this->line_fit = fit_line(pts, n, ThreadPool::global());
+        this->tform = Transform2d(this->line_fit, pts[0]);
+    }
+    this->pt_l = this->tform.world_to_local(this->pt);
+}
+
+void Scene::set_probe(const cv::Point2f pt) {
+    this->pt = pt;
+    this->pt_l = this->tform.world_to_local(pt);
+}
+
+/* Bring the scene's keypoint fit coordinates in line with its grid and
+ * transform
+ *
+ * The cache only remaps when the keypoints or the transform changed, and the
+ * published copy is only replaced then, so snapshots keep sharing it otherwise.
+ */
+static void RefreshLocal(Scene& scene, LocalCoordCache& cache) {
+    const std::vector<cv::Point2f>& pts = scene.grid->sorted_points();
+    cache.set_points(pts.data(), pts.size(), scene.keypoints_version);
+    cache.set_transform(scene.tform);
+    const size_t mapped = cache.update(ThreadPool::global());
+    if (mapped > 0 || scene.local->size() != cache.size()) {
+        scene.local =
+            std::make_shared<const std::vector<cv::Point2f>>(cache.local());
+    }
+    if (scene.has_reference) {
+        scene.reference_l = scene.tform.world_to_local(
+            cv::Point2f(scene.reference.x, scene.reference.y));
+    }
+}
+
+SceneWorker::SceneWorker(std::function<void()> on_publish)
+    : on_publish(std::move(on_publish)),
+      pending{0, false, {}, false, cv::Point2f(0.0f, 0.0f)},
+      posted(0),
+      stopping(false) {
+    this->thread = std::thread(&SceneWorker::run, this);
+}
+
+SceneWorker::~SceneWorker() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_one();
+    this->thread.join();
+}
+
+/* The copy (or mapping) happens before the lock is taken, so the worker is
+ * never held up by it
+ */
+void SceneWorker::set_keypoints(
+    const cv::Point2f* pts, const size_t n, const Transform2d* to_world) {
+    this->staging.resize(n);
+    if (to_world != nullptr) {
+        to_world->local_to_world(pts, this->staging.data(), n, ThreadPool::global());
+    } else {
+        std::copy(pts, pts + n, this->staging.begin());
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->pending.count = ++this->posted;
+        this->pending.has_keypoints = true;
+        std::swap(this->pending.keypoints, this->staging);
+    }
+    this->wake.notify_one();
+}
+
+void SceneWorker::set_probe(const cv::Point2f pt) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->pending.count = ++this->posted;
+        this->pending.has_probe = true;
+        this->pending.pt = pt;
+    }
+    this->wake.notify_one();
+}
+
+bool SceneWorker::update() { return this->snapshots.update(); }
+
+const Scene& SceneWorker::scene() const { return this->snapshots.read(); }
+
+/* Take all pending inputs at once, apply them to the worker's own scene and
+ * publish a copy
+ *
+ * A new keypoint set is applied before the probe so the probe is mapped with
+ * the new transform.
+ */
+void SceneWorker::run() {
+    trace_set_thread_name("scene worker");
+    Scene current;
+    LocalCoordCache local_cache;
+    Inputs inputs = {0, false, {}, false, cv::Point2f(0.0f, 0.0f)};
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [this] {
+                return this->stopping || this->pending.has_keypoints ||
+                       this->pending.has_probe;
+            });
+            if (this->stopping) {
+                return;
+            }
+            // Swapped, not moved, so both keypoint buffers keep their capacity
+            std::swap(inputs, this->pending);
+            this->pending.has_keypoints = false;
+            this->pending.has_probe = false;
+        }
+        if (inputs.has_keypoints) {
+            current.ingest(inputs.keypoints.data(), inputs.keypoints.size());
+            RefreshLocal(current, local_cache);
+        }
+        if (inputs.has_probe) {
+            current.set_probe(inputs.pt);
+        }
+        current.inputs = inputs.count;
+        ++current.version;
+        TRACE_SCOPE("SceneWorker/publish");
+        this->snapshots.write_slot() = current;
+        this->snapshots.publish();
+        if (this->on_publish) {
+            this->on_publish();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SCENE_WORKER_HPP
+#define SCENE_WORKER_HPP
+
+#include <raylib.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <thread>
+#include <vector>
+
+#include "point_grid.hpp"
+#include "transform.hpp"
+#include "triple_buffer.hpp"
+#include "types.hpp"
+
+/* Everything the render loop needs to draw one frame
+ *
+ * Snapshots are immutable once published; the keypoint data is shared between
+ * snapshots and only replaced when a new keypoint set is ingested.
+ */
+struct Scene {
+    // 0 until the first snapshot is published
+    u64 version;
+    // Number of SceneWorker inputs applied so far
+    u64 inputs;
+    // Changes whenever `grid` and `reference` are replaced
+    u64 keypoints_version;
+    // Keypoints other than the reference, indexed for culling
+    std::shared_ptr<const PointGrid> grid;
+    bool has_reference;
+    Vector2 reference;
+    // Fit coordinates of grid->sorted_points() and of the reference; only
+    // maintained by SceneWorker, and replaced only when either side changes
+    std::shared_ptr<const std::vector<cv::Point2f>> local;
+    cv::Point2f reference_l;
+    // Line fit of all keypoints and the transform built on it
+    cv::Vec4f line_fit;
+    Transform2d tform;
+    // Diagonal of the keypoints' bounding box
+    Vector2 line_start;
+    Vector2 line_end;
+    // Probe point in world and fit coordinates
+    cv::Point2f pt;
+    cv::Point2f pt_l;
+
+    Scene();
+    // Replace the keypoints and refit; the first keypoint is the reference
+    void ingest(const cv::Point2f* pts, size_t n);
+    void set_probe(cv::Point2f pt);
+};
+
+/* Compute thread that owns ingestion, fitting and transformation
+ *
+ * The render thread posts inputs, which only take a short lock to store them;
+ * the worker coalesces everything posted since its last pass (the newest
+ * keypoint set and probe position win), recomputes and publishes a Scene
+ * through a TripleBuffer.  The render thread picks up the newest snapshot
+ * without locking, so a slow refit never holds up a frame.
+ *
+ * `on_publish` runs on the worker after each snapshot, e.g. to wake an
+ * event-driven render loop.
+ */
+class SceneWorker {
+   public:
+    explicit SceneWorker(std::function<void()> on_publish = nullptr);
+    ~SceneWorker();
+    SceneWorker(const SceneWorker&) = delete;
+    SceneWorker& operator=(const SceneWorker&) = delete;
+
+    /* Copy `n` points, e.g. straight out of a frame buffer, mapping them with
+     * `to_world` if given; the points are not used after the call returns
+     */
+    void set_keypoints(
+        const cv::Point2f* pts, size_t n, const Transform2d* to_world = nullptr);
+    void set_probe(cv::Point2f pt);
+    // Render thread: switch to the newest snapshot; true if there was one
+    bool update();
+    // Render thread: snapshot picked up by the last update()
+    const Scene& scene() const;
+
+   private:
+    struct Inputs {
+        u64 count;
+        bool has_keypoints;
+        std::vector<cv::Point2f> keypoints;
+        bool has_probe;
+        cv::Point2f pt;
+    };
+
+    std::function<void()> on_publish;
+    TripleBuffer<Scene> snapshots;
+    std::mutex mutex;
+    std::condition_variable wake;
+    Inputs pending;
+    // Inputs posted so far; render thread only
+    u64 posted;
+    // Render thread: keypoints being copied in, swapped with `pending`'s so
+    // the buffers are reused rather than reallocated for every frame
+    std::vector<cv::Point2f> staging;
+    bool stopping;
+    std::thread thread;
+
+    void run();
+};
+
+#endif /* SCENE_WORKER_HPP */
@@ -0,0 +1,304 @@
+#include "shm_ring.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Polls of the other side's counter before falling back to a futex wait
+static const int kSpinIterations = 2000;
+
+static const char kRingMagic[8] = {'S', 'H', 'M', 'R', 'I', 'N', 'G', '1'};
+
+/* Control block at the start of the shared mapping
+ *
+ * The counters are shared between processes, so they must be lock-free
+ * atomics; the futex calls operate on their addresses directly.
+ */
+struct ShmRingControl {
+    char magic[8];
+    u32 slot_count;
+    u32 max_points;
+    u64 slot_bytes;
+    alignas(64) std::atomic<u32> head;
+    std::atomic<u32> consumer_waiting;
+    alignas(64) std::atomic<u32> tail;
+    std::atomic<u32> producer_waiting;
+    alignas(64) u8 end[1];
+};
+static_assert(std::atomic<u32>::is_always_lock_free, "shared counters");
+
+static size_t ControlBytes() { return (offsetof(ShmRingControl, end) + 63) / 64 * 64; }
+
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/* Sleep while `word` holds `expected`, for at most `timeout_ns` (< 0: no limit)
+ *
+ * Shared (not process-private) futex, so it works across processes.
+ */
+static void FutexWait(std::atomic<u32>& word, u32 expected, i64 timeout_ns) {
+    struct timespec ts;
+    struct timespec* timeout = nullptr;
+    if (timeout_ns >= 0) {
+        ts.tv_sec = timeout_ns / 1000000000;
+        ts.tv_nsec = timeout_ns % 1000000000;
+        timeout = &ts;
+    }
+    syscall(SYS_futex, (u32*)&word, FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+static void FutexWake(std::atomic<u32>& word) {
+    syscall(SYS_futex, (u32*)&word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+/* Wait until `ready()` holds, spinning first and then sleeping on `word`
+ *
+ * `waiting` tells the other side to wake us.  It is set before the final
+ * re-check, and the other side reads it after updating `word`, both
+ * sequentially consistent, so a wake-up cannot be missed.
+ */
+template <typename Ready>
+static bool WaitFor(
+    std::atomic<u32>& word,
+    std::atomic<u32>& waiting,
+    i64 timeout_ns,
+    const Ready& ready) {
+    for (int i = 0; i < kSpinIterations; ++i) {
+        if (ready()) return true;
+        if (timeout_ns == 0) return false;
+        CpuRelax();
+    }
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point deadline =
+        Clock::now() + std::chrono::nanoseconds(timeout_ns < 0 ? 0 : timeout_ns);
+    for (;;) {
+        u32 seen = word.load(std::memory_order_seq_cst);
+        waiting.store(1, std::memory_order_seq_cst);
+        if (ready()) {
+            waiting.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        i64 remaining = -1;
+        if (timeout_ns >= 0) {
+            remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            deadline - Clock::now())
+                            .count();
+            if (remaining <= 0) {
+                waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        FutexWait(word, seen, remaining);
+        waiting.store(0, std::memory_order_relaxed);
+        if (ready()) return true;
+    }
+}
+
+void ShmFrame::set_transform(const Transform2d& xform) {
+    this->tform = AffineRows::from_matrix(xform.matrix());
+    this->inverse = AffineRows::from_matrix(xform.inverse());
+    this->flags |= kFrameHasTransform;
+}
+
+Transform2d ShmFrame::transform() const {
+    if (!(this->flags & kFrameHasTransform)) {
+        return Transform2d();
+    }
+    return Transform2d(this->tform.to_matrix(), this->inverse.to_matrix());
+}
+
+ShmRing::ShmRing()
+    : control(nullptr),
+      slot_base(nullptr),
+      mapped(0),
+      slot_bytes(0),
+      slot_count(0),
+      point_limit(0) {}
+
+ShmRing::~ShmRing() { this->close(); }
+
+bool ShmRing::map(const int fd, const size_t length) {
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    this->control = (ShmRingControl*)base;
+    this->slot_base = (u8*)base + ControlBytes();
+    this->mapped = length;
+    return true;
+}
+
+bool ShmRing::create(const std::string& name, u32 slots, const u32 max_points) {
+    this->close();
+    // Power of two so the free-running counters wrap onto slot indices
+    u32 count = 1;
+    while (count < slots && count < (1u << 30)) count <<= 1;
+    const size_t slot_bytes =
+        (sizeof(ShmFrame) + (size_t)max_points * sizeof(cv::Point2f) + 63) / 64 * 64;
+    const size_t length = ControlBytes() + slot_bytes * count;
+
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, (off_t)length) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    if (!this->map(fd, length)) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    ShmRingControl* c = new (this->control) ShmRingControl();
+    c->slot_count = count;
+    c->max_points = max_points;
+    c->slot_bytes = slot_bytes;
+    c->head.store(0, std::memory_order_relaxed);
+    c->tail.store(0, std::memory_order_relaxed);
+    c->consumer_waiting.store(0, std::memory_order_relaxed);
+    c->producer_waiting.store(0, std::memory_order_relaxed);
+    // The magic goes in last: a consumer attaching early sees no ring yet
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(c->magic, kRingMagic, sizeof(kRingMagic));
+    this->slot_bytes = slot_bytes;
+    this->slot_count = count;
+    this->point_limit = max_points;
+    this->owned_name = name;
+    return true;
+}
+
+bool ShmRing::attach(const std::string& name) {
+    this->close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < ControlBytes()) {
+        ::close(fd);
+        return false;
+    }
+    if (!this->map(fd, (size_t)st.st_size)) {
+        return false;
+    }
+    // The control block belongs to another process: read each field once and
+    // keep local copies, so later writes to it cannot move a slot out of bounds
+    const ShmRingControl* c = this->control;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const u32 slot_count = c->slot_count;
+    const u64 slot_bytes = c->slot_bytes;
+    const u32 max_points = c->max_points;
+    const bool ok = memcmp(c->magic, kRingMagic, sizeof(kRingMagic)) == 0 && slot_count > 0 &&
+                    (slot_count & (slot_count - 1)) == 0 && slot_bytes >= sizeof(ShmFrame) &&
+                    slot_bytes <= (this->mapped - ControlBytes()) / slot_count &&
+                    max_points <= (slot_bytes - sizeof(ShmFrame)) / sizeof(cv::Point2f);
+    if (!ok) {
+        this->close();
+        return false;
+    }
+    this->slot_bytes = slot_bytes;
+    this->slot_count = slot_count;
+    this->point_limit = max_points;
+    return true;
+}
+
+void ShmRing::close() {
+    if (this->control != nullptr) {
+        munmap(this->control, this->mapped);
+    }
+    if (!this->owned_name.empty()) {
+        shm_unlink(this->owned_name.c_str());
+        this->owned_name.clear();
+    }
+    this->control = nullptr;
+    this->slot_base = nullptr;
+    this->mapped = 0;
+    this->slot_bytes = 0;
+    this->slot_count = 0;
+    this->point_limit = 0;
+}
+
+bool ShmRing::remove(const std::string& name) {
+    return shm_unlink(name.c_str()) == 0;
+}
+
+ShmFrame* ShmRing::slot(const u32 counter) const {
+    return (ShmFrame*)(this->slot_base +
+                       (size_t)(counter & (this->slot_count - 1)) * this->slot_bytes);
+}
+
+ShmFrame* ShmRing::acquire(const i64 timeout_ns) {
+    ShmRingControl* c = this->control;
+    const u32 head = c->head.load(std::memory_order_relaxed);
+    auto ready = [c, head, this] {
+        return head - c->tail.load(std::memory_order_acquire) < this->slot_count;
+    };
+    if (!WaitFor(c->tail, c->producer_waiting, timeout_ns, ready)) {
+        return nullptr;
+    }
+    ShmFrame* frame = this->slot(head);
+    frame->timestamp_ns = 0;
+    frame->count = 0;
+    frame->flags = 0;
+    return frame;
+}
+
+void ShmRing::publish() {
+    ShmRingControl* c = this->control;
+    c->head.store(c->head.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+    if (c->consumer_waiting.load(std::memory_order_seq_cst)) {
+        FutexWake(c->head);
+    }
+}
+
+ShmFrame* ShmRing::peek(const i64 timeout_ns) {
+    ShmRingControl* c = this->control;
+    const u32 tail = c->tail.load(std::memory_order_relaxed);
+    auto ready = [c, tail] {
+        return c->head.load(std::memory_order_acquire) != tail;
+    };
+    if (!WaitFor(c->head, c->consumer_waiting, timeout_ns, ready)) {
+        return nullptr;
+    }
+    ShmFrame* frame = this->slot(tail);
+    if (frame->count > this->point_limit) {
+        frame->count = this->point_limit;
+    }
+    return frame;
+}
+
+void ShmRing::release() {
+    ShmRingControl* c = this->control;
+    c->tail.store(c->tail.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+    if (c->producer_waiting.load(std::memory_order_seq_cst)) {
+        FutexWake(c->tail);
+    }
+}
+
+size_t ShmRing::available() const {
+    const ShmRingControl* c = this->control;
+    return c->head.load(std::memory_order_acquire) -
+           c->tail.load(std::memory_order_relaxed);
+}
+
+u32 ShmRing::max_points() const { return this->point_limit; }
+
+size_t ShmRing::slots() const { return this->slot_count; }
@@ -0,0 +1,400 @@
+#include "soft_raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+// Side of the square tiles the image is split into
+static const int kTileSize = 64;
+// Glyph cell in font pixels: 5x7 glyph plus one column and row of spacing
+static const int kGlyphW = 5;
+static const int kGlyphH = 7;
+static const int kCellW = kGlyphW + 1;
+static const int kCellH = kGlyphH + 1;
+
+/* 5x7 glyphs for ASCII 32 (space) to 95 (underscore)
+ *
+ * One byte per row, top to bottom, bit 4 being the leftmost column.  Lower
+ * case letters are drawn with the upper case glyphs.
+ */
+static const u8 kFont[64][kGlyphH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // ' '
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04},  // '!'
+    {0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00},  // '"'
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A},  // '#'
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04},  // '$'
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},  // '%'
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D},  // '&'
+    {0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00},  // '''
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02},  // '('
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08},  // ')'
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00},  // '*'
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00},  // '+'
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08},  // ','
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00},  // '-'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},  // '.'
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},  // '/'
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},  // '0'
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},  // '1'
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},  // '2'
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},  // '3'
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},  // '4'
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},  // '5'
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},  // '6'
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},  // '7'
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},  // '8'
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},  // '9'
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},  // ':'
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08},  // ';'
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02},  // '<'
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00},  // '='
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08},  // '>'
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04},  // '?'
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E},  // '@'
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11},  // 'A'
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},  // 'B'
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},  // 'C'
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},  // 'D'
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},  // 'E'
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},  // 'F'
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},  // 'G'
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},  // 'H'
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},  // 'I'
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},  // 'J'
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},  // 'K'
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},  // 'L'
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},  // 'M'
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},  // 'N'
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},  // 'O'
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},  // 'P'
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},  // 'Q'
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},  // 'R'
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},  // 'S'
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},  // 'T'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},  // 'U'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},  // 'V'
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},  // 'W'
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},  // 'X'
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},  // 'Y'
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},  // 'Z'
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E},  // '['
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00},  // '\'
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E},  // ']'
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00},  // '^'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F},  // '_'
+};
+
+static inline const u8* glyph(char c) {
+    if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    if (c < ' ' || c > '_') c = '?';
+    return kFont[c - ' '];
+}
+
+/* Source-over blending on packed RGBA8 pixels
+ *
+ * Red/blue and green/alpha are blended two channels at a time in 16-bit
+ * lanes of a 32-bit word, with the source terms precomputed once per shape
+ * and the division by 255 done with shifts (exact, with rounding).
+ */
+struct BlendTerms {
+    u32 rb;
+    u32 ga;
+    u32 ia;
+    u32 opaque;
+};
+
+static inline BlendTerms blend_terms(const Color src) {
+    const u32 a = src.a;
+    return {
+        (u32)src.r * a | (u32)src.b * a << 16,
+        (u32)src.g * a | a * 255 << 16,
+        255 - a,
+        a == 255 ? (u32)src.r | (u32)src.g << 8 | (u32)src.b << 16 | 0xFF000000u : 0};
+}
+
+static inline u32 blend_pixel(const u32 dst, const BlendTerms& t) {
+    u32 rb = (dst & 0x00FF00FF) * t.ia + t.rb + 0x00800080;
+    u32 ga = (dst >> 8 & 0x00FF00FF) * t.ia + t.ga + 0x00800080;
+    rb = (rb + (rb >> 8 & 0x00FF00FF)) >> 8 & 0x00FF00FF;
+    ga = (ga + (ga >> 8 & 0x00FF00FF)) & 0xFF00FF00;
+    return rb | ga;
+}
+
+static inline void blend(Color* dst, const BlendTerms& t) {
+    u32 px = t.opaque;
+    if (t.ia != 0) {
+        std::memcpy(&px, dst, sizeof(px));
+        px = blend_pixel(px, t);
+    }
+    std::memcpy(dst, &px, sizeof(px));
+}
+
+// Blend onto `n` consecutive pixels
+static inline void blend_span(Color* dst, const int n, const BlendTerms& t) {
+    u8* bytes = reinterpret_cast<u8*>(dst);
+    for (int i = 0; i < n; ++i) {
+        u32 px = t.opaque;
+        if (t.ia != 0) {
+            std::memcpy(&px, bytes + 4 * i, sizeof(px));
+            px = blend_pixel(px, t);
+        }
+        std::memcpy(bytes + 4 * i, &px, sizeof(px));
+    }
+}
+
+SoftRasterizer::SoftRasterizer(const int width, const int height)
+    : w(width),
+      h(height),
+      camera{{0.0f, 0.0f}, {0.0f, 0.0f}, 0.0f, 1.0f},
+      background(BLANK),
+      pixels((size_t)width * height, BLANK),
+      tiles_x((width + kTileSize - 1) / kTileSize),
+      tiles_y((height + kTileSize - 1) / kTileSize),
+      bins((size_t)tiles_x * tiles_y) {}
+
+void SoftRasterizer::set_camera(const Camera2D& camera) { this->camera = camera; }
+
+Vector2 SoftRasterizer::to_pixels(const Vector2 world) const {
+    return {
+        (world.x - this->camera.target.x) * this->camera.zoom + this->camera.offset.x,
+        (world.y - this->camera.target.y) * this->camera.zoom + this->camera.offset.y};
+}
+
+void SoftRasterizer::begin(const Color background) {
+    this->background = background;
+    this->shapes.clear();
+    this->strings.clear();
+    for (std::vector<u32>& bin : this->bins) {
+        bin.clear();
+    }
+}
+
+/* Clip a shape's pixel bounds to the image and file it in the tiles it covers
+ */
+void SoftRasterizer::add(
+    Shape& shape, const float x0, const float y0, const float x1, const float y1) {
+    if (!(x1 >= 0.0f && y1 >= 0.0f && x0 < this->w && y0 < this->h)) {
+        return;
+    }
+    shape.x0 = std::max(0, (int)std::floor(x0));
+    shape.y0 = std::max(0, (int)std::floor(y0));
+    shape.x1 = std::min(this->w - 1, (int)std::ceil(x1));
+    shape.y1 = std::min(this->h - 1, (int)std::ceil(y1));
+    const u32 index = (u32)this->shapes.size();
+    this->shapes.push_back(shape);
+    for (int ty = shape.y0 / kTileSize; ty <= shape.y1 / kTileSize; ++ty) {
+        for (int tx = shape.x0 / kTileSize; tx <= shape.x1 / kTileSize; ++tx) {
+            this->bins[(size_t)ty * this->tiles_x + tx].push_back(index);
+        }
+    }
+}
+
+void SoftRasterizer::line(
+    const Vector2 a, const Vector2 b, const float thickness, const Color color) {
+    const Vector2 pa = this->to_pixels(a);
+    const Vector2 pb = this->to_pixels(b);
+    // Never thinner than a pixel, like a GL line
+    const float r = std::max(thickness * this->camera.zoom, 1.0f) * 0.5f;
+    if (pa.x == pb.x || pa.y == pb.y) {
+        // Axis-aligned, as all grid lines are: a plain rectangle fill
+        const float x0 = std::min(pa.x, pb.x) - (pa.x == pb.x ? r : 0.0f);
+        const float y0 = std::min(pa.y, pb.y) - (pa.y == pb.y ? r : 0.0f);
+        const float x1 = std::max(pa.x, pb.x) + (pa.x == pb.x ? r : 0.0f);
+        const float y1 = std::max(pa.y, pb.y) + (pa.y == pb.y ? r : 0.0f);
+        Shape s = {Kind::kRect, color, {x0, y0, x1, y1}};
+        this->add(s, x0, y0, x1, y1);
+        return;
+    }
+    Shape s = {Kind::kLine, color, {pa.x, pa.y, pb.x, pb.y, r}};
+    this->add(
+        s,
+        std::min(pa.x, pb.x) - r,
+        std::min(pa.y, pb.y) - r,
+        std::max(pa.x, pb.x) + r,
+        std::max(pa.y, pb.y) + r);
+}
+
+void SoftRasterizer::triangle(
+    const Vector2 a, const Vector2 b, const Vector2 c, const Color color) {
+    const Vector2 pa = this->to_pixels(a);
+    const Vector2 pb = this->to_pixels(b);
+    const Vector2 pc = this->to_pixels(c);
+    Shape s = {Kind::kTriangle, color, {pa.x, pa.y, pb.x, pb.y, pc.x, pc.y}};
+    this->add(
+        s,
+        std::min({pa.x, pb.x, pc.x}),
+        std::min({pa.y, pb.y, pc.y}),
+        std::max({pa.x, pb.x, pc.x}),
+        std::max({pa.y, pb.y, pc.y}));
+}
+
+void SoftRasterizer::circle(const Vector2 center, const float radius, const Color color) {
+    const Vector2 pc = this->to_pixels(center);
+    const float r = radius * this->camera.zoom;
+    Shape s = {Kind::kCircle, color, {pc.x, pc.y, r}};
+    this->add(s, pc.x - r, pc.y - r, pc.x + r, pc.y + r);
+}
+
+void SoftRasterizer::text(
+    const char* str, const Vector2 pos, const float font_size, const Color color) {
+    const Vector2 p = this->to_pixels(pos);
+    // Pixel size of one font pixel
+    const float scale = std::max(1.0f, std::round(font_size * this->camera.zoom / kCellH));
+    const size_t len = std::char_traits<char>::length(str);
+    if (len == 0) {
+        return;
+    }
+    Shape s = {Kind::kText, color, {p.x, p.y, scale, (float)len}};
+    s.text = (u32)this->strings.size();
+    const size_t before = this->shapes.size();
+    this->add(s, p.x, p.y, p.x + len * kCellW * scale, p.y + kGlyphH * scale);
+    if (this->shapes.size() != before) {
+        this->strings.emplace_back(str, len);
+    }
+}
+
+/* Clear one tile and blend its shapes, in submission order
+ *
+ * The tile is drawn in a contiguous local buffer, which stays in L1, and
+ * copied out row by row at the end.  Coverage is tested at pixel centers, so
+ * shapes have hard edges.
+ */
+void SoftRasterizer::draw_tile(const int tile) {
+    const int tx0 = (tile % this->tiles_x) * kTileSize;
+    const int ty0 = (tile / this->tiles_x) * kTileSize;
+    const int tx1 = std::min(tx0 + kTileSize, this->w) - 1;
+    const int ty1 = std::min(ty0 + kTileSize, this->h) - 1;
+    // std::fill on Color goes byte by byte; copying whole rows does not
+    Color local[kTileSize * kTileSize];
+    std::fill(local, local + kTileSize, this->background);
+    for (int y = 1; y < kTileSize; ++y) {
+        std::memcpy(local + y * kTileSize, local, kTileSize * sizeof(Color));
+    }
+
+    for (const u32 index : this->bins[tile]) {
+        const Shape& s = this->shapes[index];
+        const int x0 = std::max(s.x0, tx0);
+        const int y0 = std::max(s.y0, ty0);
+        const int x1 = std::min(s.x1, tx1);
+        const int y1 = std::min(s.y1, ty1);
+        const float* p = s.p;
+        const BlendTerms terms = blend_terms(s.color);
+        switch (s.kind) {
+            case Kind::kRect: {
+                // Pixels whose centers fall inside the half-open rectangle
+                const int rx0 = std::max(x0, (int)std::ceil(p[0] - 0.5f));
+                const int ry0 = std::max(y0, (int)std::ceil(p[1] - 0.5f));
+                const int rx1 = std::min(x1, (int)std::ceil(p[2] - 0.5f) - 1);
+                const int ry1 = std::min(y1, (int)std::ceil(p[3] - 0.5f) - 1);
+                for (int y = ry0; rx0 <= rx1 && y <= ry1; ++y) {
+                    blend_span(local + (y - ty0) * kTileSize + rx0 - tx0, rx1 - rx0 + 1, terms);
+                }
+                break;
+            }
+            case Kind::kLine: {
+                // Distance from the pixel center to the segment
+                const float dx = p[2] - p[0];
+                const float dy = p[3] - p[1];
+                const float len2 = dx * dx + dy * dy;
+                const float inv_len2 = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+                const float r2 = p[4] * p[4];
+                for (int y = y0; y <= y1; ++y) {
+                    Color* row = local + (y - ty0) * kTileSize;
+                    const float py = y + 0.5f - p[1];
+                    for (int x = x0; x <= x1; ++x) {
+                        const float px = x + 0.5f - p[0];
+                        const float t =
+                            std::min(1.0f, std::max(0.0f, (px * dx + py * dy) * inv_len2));
+                        const float ex = px - t * dx;
+                        const float ey = py - t * dy;
+                        if (ex * ex + ey * ey <= r2) blend(row + x - tx0, terms);
+                    }
+                }
+                break;
+            }
+            case Kind::kTriangle: {
+                // Edge functions, flipped so either winding is accepted
+                const float area = (p[2] - p[0]) * (p[5] - p[1]) - (p[3] - p[1]) * (p[4] - p[0]);
+                if (area == 0.0f) break;
+                const float sign = area > 0.0f ? 1.0f : -1.0f;
+                for (int y = y0; y <= y1; ++y) {
+                    Color* row = local + (y - ty0) * kTileSize;
+                    const float py = y + 0.5f;
+                    for (int x = x0; x <= x1; ++x) {
+                        const float px = x + 0.5f;
+                        const float e0 = (p[2] - p[0]) * (py - p[1]) - (p[3] - p[1]) * (px - p[0]);
+                        const float e1 = (p[4] - p[2]) * (py - p[3]) - (p[5] - p[3]) * (px - p[2]);
+                        const float e2 = (p[0] - p[4]) * (py - p[5]) - (p[1] - p[5]) * (px - p[4]);
+                        if (e0 * sign >= 0.0f && e1 * sign >= 0.0f && e2 * sign >= 0.0f) {
+                            blend(row + x - tx0, terms);
+                        }
+                    }
+                }
+                break;
+            }
+            case Kind::kCircle: {
+                const float r2 = p[2] * p[2];
+                for (int y = y0; y <= y1; ++y) {
+                    Color* row = local + (y - ty0) * kTileSize;
+                    const float dy = y + 0.5f - p[1];
+                    for (int x = x0; x <= x1; ++x) {
+                        const float dx = x + 0.5f - p[0];
+                        if (dx * dx + dy * dy <= r2) blend(row + x - tx0, terms);
+                    }
+                }
+                break;
+            }
+            case Kind::kText: {
+                const std::string& str = this->strings[s.text];
+                const float inv_scale = 1.0f / p[2];
+                for (int y = y0; y <= y1; ++y) {
+                    Color* row = local + (y - ty0) * kTileSize;
+                    const int gy = (int)((y + 0.5f - p[1]) * inv_scale);
+                    if (gy < 0 || gy >= kGlyphH) continue;
+                    for (int x = x0; x <= x1; ++x) {
+                        const int col = (int)((x + 0.5f - p[0]) * inv_scale);
+                        const size_t ch = (size_t)col / kCellW;
+                        const int gx = col % kCellW;
+                        if (col < 0 || ch >= str.size() || gx >= kGlyphW) continue;
+                        if (glyph(str[ch])[gy] & (0x10 >> gx)) blend(row + x - tx0, terms);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    Color* const image = this->pixels.data();
+    for (int y = ty0; y <= ty1; ++y) {
+        std::memcpy(
+            image + (size_t)y * this->w + tx0,
+            local + (y - ty0) * kTileSize,
+            (tx1 - tx0 + 1) * sizeof(Color));
+    }
+}
+
+void SoftRasterizer::end(ThreadPool& pool) {
+    TRACE_SCOPE("SoftRasterizer/end");
+    pool.parallel_for(
+        0,
+        this->bins.size(),
+        [this](size_t first, size_t last) {
+            for (size_t tile = first; tile < last; ++tile) {
+                this->draw_tile((int)tile);
+            }
+        },
+        1);
+}
+
+Image SoftRasterizer::image() {
+    return {this->pixels.data(), this->w, this->h, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+}
+
+bool SoftRasterizer::export_png(const char* path) { return ExportImage(this->image(), path); }
+
+int SoftRasterizer::width() const { return this->w; }
+
+int SoftRasterizer::height() const { return this->h; }
@@ -0,0 +1,73 @@
+#ifndef SOFT_RASTER_HPP
+#define SOFT_RASTER_HPP
+
+#include <raylib.h>
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+class ThreadPool;
+
+/* CPU rasterizer for headless snapshots
+ *
+ * Mirrors the handful of raylib shapes the visualizer draws (lines, triangles,
+ * circles and text) without needing a GL context.  Shapes are recorded between
+ * begin() and end(), then binned into 64x64 pixel tiles; end() rasterizes the
+ * tiles in parallel on the pool, each tile blending its shapes in submission
+ * order, so the result does not depend on the thread count.
+ *
+ * Coordinates are world coordinates mapped through the camera (rotation is
+ * ignored).  Text uses a built-in 5x7 bitmap font, since raylib's default font
+ * lives in a texture.
+ */
+class SoftRasterizer {
+   public:
+    SoftRasterizer(int width, int height);
+    void set_camera(const Camera2D& camera);
+    // Start a frame; drops the shapes of the previous one
+    void begin(Color background);
+    void line(Vector2 a, Vector2 b, float thickness, Color color);
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color color);
+    void circle(Vector2 center, float radius, Color color);
+    // `font_size` is the line height in world units, as for DrawText
+    void text(const char* str, Vector2 pos, float font_size, Color color);
+    // Rasterize the recorded shapes into the image
+    void end(ThreadPool& pool);
+    // View onto the pixels, valid until the rasterizer is destroyed
+    Image image();
+    bool export_png(const char* path);
+    int width() const;
+    int height() const;
+
+   private:
+    enum class Kind : u8 { kRect, kLine, kTriangle, kCircle, kText };
+    struct Shape {
+        Kind kind;
+        Color color;
+        // Pixel-space parameters, meaning depends on kind
+        float p[7];
+        // Clipped pixel bounds, inclusive; set by add()
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        // Index into `strings`, kText only
+        u32 text = 0;
+    };
+
+    int w;
+    int h;
+    Camera2D camera;
+    Color background;
+    std::vector<Color> pixels;
+    std::vector<Shape> shapes;
+    std::vector<std::string> strings;
+    int tiles_x;
+    int tiles_y;
+    std::vector<std::vector<u32>> bins;
+
+    Vector2 to_pixels(Vector2 world) const;
+    void add(Shape& shape, float x0, float y0, float x1, float y1);
+    void draw_tile(int tile);
+};
+
+#endif /* SOFT_RASTER_HPP */
@@ -0,0 +1,243 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include "trace.hpp"
+
+namespace {
+
+/* Shared state of one parallel_for call
+ *
+ * Indices are handed out with guided scheduling: each claim takes a share of
+ * what is left, never less than `grain`, so early chunks are large and the
+ * tail is split finely for load balance.  Helper tasks that start after the
+ * range is exhausted never touch `fn`, which only lives until the caller
+ * returns.
+ */
+struct RangeJob {
+    std::atomic<size_t> next;
+    std::atomic<size_t> in_flight;
+    size_t end;
+    size_t grain;
+    size_t threads;
+    const ThreadPool::RangeFn* fn;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+thread_local const ThreadPool* tl_pool = nullptr;
+thread_local size_t tl_index = 0;
+
+}  // namespace
+
+static bool claim_chunk(RangeJob& job, size_t& begin, size_t& end) {
+    size_t current = job.next.load();
+    for (;;) {
+        if (current >= job.end) {
+            return false;
+        }
+        size_t remaining = job.end - current;
+        size_t chunk = std::max(job.grain, remaining / (2 * job.threads));
+        chunk = std::min(chunk, remaining);
+        if (job.next.compare_exchange_weak(current, current + chunk)) {
+            begin = current;
+            end = current + chunk;
+            return true;
+        }
+    }
+}
+
+/* Run chunks of `job` until the range is exhausted
+ *
+ * `in_flight` is raised before claiming, so once the caller sees the range
+ * exhausted and nothing in flight, every claimed chunk has completed.
+ */
+static void drain_range(RangeJob& job) {
+    for (;;) {
+        job.in_flight.fetch_add(1);
+        size_t begin;
+        size_t end;
+        if (!claim_chunk(job, begin, end)) {
+            job.in_flight.fetch_sub(1);
+            return;
+        }
+        try {
+            (*job.fn)(begin, end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.error_mutex);
+            if (!job.error) job.error = std::current_exception();
+            job.next.store(job.end);
+        }
+        job.in_flight.fetch_sub(1);
+    }
+}
+
+ThreadPool::ThreadPool(size_t num_workers)
+    : pending(0), next_queue(0), stopping(false) {
+    for (size_t i = 0; i < num_workers; ++i) {
+        this->queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        this->workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+}
+
+/* Process-wide pool
+ *
+ * One worker per hardware thread, minus the thread calling parallel_for.
+ */
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool(
+        std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+size_t ThreadPool::concurrency() const { return this->workers.size() + 1; }
+
+/* Queue a task
+ *
+ * From a worker of this pool the task goes to that worker's own deque,
+ * otherwise deques are filled round-robin.  Without workers the task runs
+ * immediately on the calling thread.
+ */
+void ThreadPool::submit(std::function<void()> task) {
+    if (this->queues.empty()) {
+        task();
+        return;
+    }
+    size_t index = tl_pool == this
+                       ? tl_index
+                       : this->next_queue.fetch_add(1) % this->queues.size();
+    {
+        WorkQueue& queue = *this->queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    this->pending.fetch_add(1);
+    // Taking the lock orders this wake-up after a sleeper's predicate check
+    { std::lock_guard<std::mutex> lock(this->sleep_mutex); }
+    this->wake.notify_one();
+}
+
+bool ThreadPool::try_pop(size_t index, std::function<void()>& task) {
+    WorkQueue& queue = *this->queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::try_steal(size_t thief, std::function<void()>& task) {
+    const size_t n = this->queues.size();
+    for (size_t offset = 1; offset <= n; ++offset) {
+        WorkQueue& queue = *this->queues[(thief + offset) % n];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || queue.tasks.empty()) {
+            continue;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+/* Run a single queued task, if any
+ *
+ * `index` is the worker's own deque, or queues.size() for outside threads,
+ * which can only steal.
+ */
+bool ThreadPool::run_one(size_t index) {
+    std::function<void()> task;
+    bool found = (index < this->queues.size() && this->try_pop(index, task)) ||
+                 this->try_steal(index, task);
+    if (!found) {
+        return false;
+    }
+    this->pending.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    tl_pool = this;
+    tl_index = index;
+    trace_set_thread_name("pool worker");
+    for (;;) {
+        if (this->run_one(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(this->sleep_mutex);
+        this->wake.wait(lock, [this] {
+            return this->stopping || this->pending.load() > 0;
+        });
+        if (this->stopping && this->pending.load() == 0) {
+            return;
+        }
+    }
+}
+
+/* Parallel loop over [begin, end)
+ *
+ * With `grain` of 0 the minimum chunk adapts to the range and the pool size.
+ * Small ranges run inline.  Once the range is exhausted, the caller only
+ * waits for chunks other threads are already running; a worker of this pool
+ * helps with queued tasks meanwhile, but an outside thread does not, since
+ * those may belong to another caller's loop and run for as long as that loop
+ * has work left (a render thread would otherwise end up running a background
+ * thread's whole job).  Rethrows the first exception thrown by `fn`.
+ */
+void ThreadPool::parallel_for(
+    size_t begin, size_t end, const RangeFn& fn, size_t grain) {
+    if (end <= begin) {
+        return;
+    }
+    const size_t n = end - begin;
+    const size_t threads = this->concurrency();
+    if (grain == 0) {
+        grain = std::max<size_t>(1, n / (threads * 64));
+    }
+    if (threads == 1 || n <= grain) {
+        fn(begin, end);
+        return;
+    }
+
+    std::shared_ptr<RangeJob> job = std::make_shared<RangeJob>();
+    job->next.store(begin);
+    job->in_flight.store(0);
+    job->end = end;
+    job->grain = grain;
+    job->threads = threads;
+    job->fn = &fn;
+
+    size_t helpers = std::min(this->workers.size(), (n + grain - 1) / grain - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        this->submit([job] { drain_range(*job); });
+    }
+    drain_range(*job);
+
+    const bool is_worker = tl_pool == this;
+    while (job->in_flight.load() != 0) {
+        if (!is_worker || !this->run_one(tl_index)) {
+            std::this_thread::yield();
+        }
+    }
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
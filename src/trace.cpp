@@ -0,0 +1,261 @@
+#include "trace.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char* name;
+    u64 begin;
+    u64 end;
+};
+
+/* Events of one thread
+ *
+ * Only the owning thread writes.  `count` is published with release order
+ * after each event, so a reader sees complete events up to it.
+ */
+struct TraceBuffer {
+    u32 tid;
+    u32 session;
+    std::atomic<size_t> count;
+    std::atomic<size_t> dropped;
+    std::unique_ptr<TraceEvent[]> events;
+    // Guarded by the registry mutex
+    std::string thread_name;
+    bool in_use;
+};
+
+/* Every buffer ever handed out, with the session's clock calibration
+ *
+ * Buffers outlive their threads so their events can still be written out; a
+ * buffer whose thread has exited is reused once its session is over.
+ */
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    u32 next_tid = 1;
+    u32 last_session = 0;
+    u64 start_ticks = 0;
+    u64 start_ns = 0;
+    u64 stop_ticks = 0;
+    u64 stop_ns = 0;
+    bool stopped = true;
+};
+
+std::atomic<u32> TraceScope::active(0);
+
+static TraceRegistry& Registry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+static u64 NowNs() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Releases the thread's buffer for reuse when the thread exits
+struct TraceBufferOwner {
+    TraceBuffer* buffer = nullptr;
+    ~TraceBufferOwner() {
+        if (this->buffer != nullptr) {
+            std::lock_guard<std::mutex> lock(Registry().mutex);
+            this->buffer->in_use = false;
+        }
+    }
+};
+
+static thread_local TraceBuffer* tl_buffer = nullptr;
+static thread_local TraceBufferOwner tl_owner;
+
+// Slow path: the calling thread's first event, or its first in a new session
+static TraceBuffer* AttachBuffer(const u32 session) {
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    TraceBuffer* buffer = tl_buffer;
+    if (buffer == nullptr) {
+        for (const std::unique_ptr<TraceBuffer>& b : registry.buffers) {
+            if (!b->in_use && b->session != registry.last_session) {
+                buffer = b.get();
+                buffer->thread_name.clear();
+                break;
+            }
+        }
+        if (buffer == nullptr) {
+            registry.buffers.push_back(std::make_unique<TraceBuffer>());
+            buffer = registry.buffers.back().get();
+            buffer->session = 0;
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+        buffer->tid = registry.next_tid++;
+        buffer->in_use = true;
+        tl_buffer = buffer;
+        tl_owner.buffer = buffer;
+    }
+    // A scope that began in an earlier session leaves the buffer alone
+    if (session != 0 && session == registry.last_session && buffer->session != session) {
+        if (!buffer->events) {
+            buffer->events.reset(new TraceEvent[kTraceBufferEvents]);
+        }
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->session = session;
+    }
+    return buffer;
+}
+
+void TraceScope::record(
+    const char* name, const u32 session, const u64 begin, const u64 end) {
+    TraceBuffer* buffer = tl_buffer;
+    if (buffer == nullptr || buffer->session != session) {
+        buffer = AttachBuffer(session);
+        if (buffer->session != session) {
+            return;
+        }
+    }
+    const size_t n = buffer->count.load(std::memory_order_relaxed);
+    if (n >= kTraceBufferEvents) {
+        buffer->dropped.store(
+            buffer->dropped.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[n] = TraceEvent{name, begin, end};
+    buffer->count.store(n + 1, std::memory_order_release);
+}
+
+void trace_start() {
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.start_ns = NowNs();
+    registry.start_ticks = trace_ticks();
+    registry.stopped = false;
+    // Session ids only grow, so no buffer mistakes an old session for this one
+    ++registry.last_session;
+    if (registry.last_session == 0) ++registry.last_session;
+    TraceScope::active.store(registry.last_session, std::memory_order_release);
+}
+
+void trace_stop() {
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.stopped) {
+        return;
+    }
+    TraceScope::active.store(0, std::memory_order_release);
+    registry.stop_ticks = trace_ticks();
+    registry.stop_ns = NowNs();
+    registry.stopped = true;
+}
+
+bool trace_active() { return TraceScope::active.load(std::memory_order_relaxed) != 0; }
+
+void trace_set_thread_name(const char* name) {
+    TraceBuffer* buffer = AttachBuffer(0);
+    std::lock_guard<std::mutex> lock(Registry().mutex);
+    buffer->thread_name = name;
+}
+
+size_t trace_event_count() {
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    size_t n = 0;
+    for (const std::unique_ptr<TraceBuffer>& b : registry.buffers) {
+        if (b->session == registry.last_session) {
+            n += b->count.load(std::memory_order_acquire);
+        }
+    }
+    return n;
+}
+
+size_t trace_dropped_count() {
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    size_t n = 0;
+    for (const std::unique_ptr<TraceBuffer>& b : registry.buffers) {
+        if (b->session == registry.last_session) {
+            n += b->dropped.load(std::memory_order_relaxed);
+        }
+    }
+    return n;
+}
+
+static void PutJsonString(std::FILE* file, const char* text) {
+    std::fputc('"', file);
+    for (const char* c = text; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+            std::fputc(*c, file);
+        } else if ((unsigned char)*c >= 0x20) {
+            std::fputc(*c, file);
+        }
+    }
+    std::fputc('"', file);
+}
+
+/* Timestamps are converted from ticks with the rate measured over the
+ * session (up to now if it is still running), and written in microseconds
+ * from the start of the session as the format expects.
+ */
+bool trace_write_json(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    TraceRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    const u64 end_ticks = registry.stopped ? registry.stop_ticks : trace_ticks();
+    const u64 end_ns = registry.stopped ? registry.stop_ns : NowNs();
+    const double ns_per_tick =
+        end_ticks > registry.start_ticks
+            ? (double)(end_ns - registry.start_ns) / (double)(end_ticks - registry.start_ticks)
+            : 1.0;
+    const int pid = (int)getpid();
+    size_t dropped = 0;
+    const char* separator = "\n";
+    std::fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (const std::unique_ptr<TraceBuffer>& b : registry.buffers) {
+        if (!b->thread_name.empty()) {
+            std::fprintf(
+                file,
+                "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                "\"tid\": %u, \"args\": {\"name\": ",
+                separator,
+                pid,
+                b->tid);
+            PutJsonString(file, b->thread_name.c_str());
+            std::fprintf(file, "}}");
+            separator = ",\n";
+        }
+        if (b->session != registry.last_session) {
+            continue;
+        }
+        dropped += b->dropped.load(std::memory_order_relaxed);
+        const size_t n = b->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            const TraceEvent& e = b->events[i];
+            const double ts = (double)(e.begin - registry.start_ticks) * ns_per_tick * 1e-3;
+            const double dur = (double)(e.end - e.begin) * ns_per_tick * 1e-3;
+            std::fprintf(file, "%s{\"name\": ", separator);
+            PutJsonString(file, e.name);
+            std::fprintf(
+                file,
+                ", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": %.3f, "
+                "\"dur\": %.3f}",
+                pid,
+                b->tid,
+                ts,
+                dur);
+            separator = ",\n";
+        }
+    }
+    std::fprintf(file, "\n], \"otherData\": {\"dropped\": %zu}}\n", dropped);
+    return std::fclose(file) == 0;
+}
@@ -1,5 +1,47 @@
 #include "transform.hpp"
 
+#include <charconv>
+#include <cstring>
+
+#include "metrics.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+// Axis names of the structured text layouts, one per matrix column
+static const char* const kAxisNames[3] = {"x_axis", "y_axis", "T_axis"};
+
+enum BatchKernel {
+    kWorldToLocal,
+    kLocalToWorld,
+    kWorldToLocalSoa,
+    kLocalToWorldSoa,
+    kBatchKernelCount
+};
+
+/* Points mapped by each batch kernel, counted once per call
+ *
+ * Pool variants count at the call, not per chunk.
+ */
+static void CountBatchPoints(const BatchKernel kernel, const size_t n) {
+    static const char* const kKernelLabels[kBatchKernelCount] = {
+        "kernel=\"world_to_local\"",
+        "kernel=\"local_to_world\"",
+        "kernel=\"world_to_local_soa\"",
+        "kernel=\"local_to_world_soa\"",
+    };
+    static const std::vector<MetricCounter> counters = [] {
+        std::vector<MetricCounter> all;
+        for (const char* labels : kKernelLabels) {
+            all.push_back(MetricsRegistry::global().counter(
+                "transform_batch_points_total",
+                "Points mapped by the Transform2d batch kernels",
+                labels));
+        }
+        return all;
+    }();
+    counters[kernel].add(n);
+}
+
 /* Default Constructor - Identity Matrix
  */
 Transform2d::Transform2d()
@@ -11,6 +53,14 @@ Transform2d::Transform2d()
 Transform2d::Transform2d(const SqMatrix3 matrix)
     : data(matrix), inv_data(Transform2d::inv(matrix)) {}
 
+/* Conversion Constructor with a known inverse
+ *
+ * Skips the inversion, e.g. for transforms stored along with their inverse.
+ * `inverse` is trusted to match `matrix`.
+ */
+Transform2d::Transform2d(const SqMatrix3& matrix, const SqMatrix3& inverse)
+    : data(matrix), inv_data(inverse) {}
+
 /* Image-to-Fitted Transform Constructor
  *
  * Constructor used to create a transform for mapping from from image
@@ -19,6 +69,7 @@ Transform2d::Transform2d(const SqMatrix3 matrix)
  */
 Transform2d::Transform2d(const cv::Vec4f line_fit, const cv::Point2f ref_pt)
     : Transform2d() {
+    TRACE_SCOPE("Transform2d/from_line_fit");
     float vx = line_fit[0];
     float vy = line_fit[1];
     float x0 = line_fit[2];
@@ -126,6 +177,159 @@ cv::Point2f Transform2d::local_to_world(const cv::Point2f pt) const {
     return Transform2d::mul(this->data, pt);
 }
 
+/* Batch world-to-local mapping of `n` points from `in` into `out`
+ *
+ * `in` and `out` may be the same buffer.
+ */
+void Transform2d::world_to_local(
+    const cv::Point2f* in, cv::Point2f* out, const size_t n) const {
+    CountBatchPoints(kWorldToLocal, n);
+    Transform2d::mul(this->inv_data, in, out, n);
+}
+
+void Transform2d::world_to_local(
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n,
+    ThreadPool& pool) const {
+    TRACE_SCOPE("world_to_local/batch");
+    CountBatchPoints(kWorldToLocal, n);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Transform2d::mul(this->inv_data, in + first, out + first, last - first);
+        },
+        kPointBatchGrain);
+}
+
+/* Batch local-to-world mapping of `n` points from `in` into `out`
+ *
+ * `in` and `out` may be the same buffer.
+ */
+void Transform2d::local_to_world(
+    const cv::Point2f* in, cv::Point2f* out, const size_t n) const {
+    CountBatchPoints(kLocalToWorld, n);
+    Transform2d::mul(this->data, in, out, n);
+}
+
+void Transform2d::local_to_world(
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n,
+    ThreadPool& pool) const {
+    TRACE_SCOPE("local_to_world/batch");
+    CountBatchPoints(kLocalToWorld, n);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Transform2d::mul(this->data, in + first, out + first, last - first);
+        },
+        kPointBatchGrain);
+}
+
+/* Structure-of-arrays batch mapping
+ *
+ * Same as the point variants with x and y in separate arrays, e.g. columns of
+ * a mapped KeypointFile.  Each output array may be the same as its input.
+ */
+void Transform2d::world_to_local(
+    const float* x,
+    const float* y,
+    float* out_x,
+    float* out_y,
+    const size_t n) const {
+    CountBatchPoints(kWorldToLocalSoa, n);
+    Transform2d::mul(this->inv_data, x, y, out_x, out_y, n);
+}
+
+void Transform2d::world_to_local(
+    const float* x,
+    const float* y,
+    float* out_x,
+    float* out_y,
+    const size_t n,
+    ThreadPool& pool) const {
+    TRACE_SCOPE("world_to_local/batch_soa");
+    CountBatchPoints(kWorldToLocalSoa, n);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Transform2d::mul(
+                this->inv_data,
+                x + first,
+                y + first,
+                out_x + first,
+                out_y + first,
+                last - first);
+        },
+        kPointBatchGrain);
+}
+
+void Transform2d::local_to_world(
+    const float* x,
+    const float* y,
+    float* out_x,
+    float* out_y,
+    const size_t n) const {
+    CountBatchPoints(kLocalToWorldSoa, n);
+    Transform2d::mul(this->data, x, y, out_x, out_y, n);
+}
+
+void Transform2d::local_to_world(
+    const float* x,
+    const float* y,
+    float* out_x,
+    float* out_y,
+    const size_t n,
+    ThreadPool& pool) const {
+    TRACE_SCOPE("local_to_world/batch_soa");
+    CountBatchPoints(kLocalToWorldSoa, n);
+    pool.parallel_for(
+        0,
+        n,
+        [&](size_t first, size_t last) {
+            Transform2d::mul(
+                this->data,
+                x + first,
+                y + first,
+                out_x + first,
+                out_y + first,
+                last - first);
+        },
+        kPointBatchGrain);
+}
+
+std::vector<cv::Point2f> Transform2d::world_to_local(
+    const std::vector<cv::Point2f>& pts) const {
+    std::vector<cv::Point2f> out(pts.size());
+    this->world_to_local(pts.data(), out.data(), pts.size());
+    return out;
+}
+
+std::vector<cv::Point2f> Transform2d::world_to_local(
+    const std::vector<cv::Point2f>& pts, ThreadPool& pool) const {
+    std::vector<cv::Point2f> out(pts.size());
+    this->world_to_local(pts.data(), out.data(), pts.size(), pool);
+    return out;
+}
+
+std::vector<cv::Point2f> Transform2d::local_to_world(
+    const std::vector<cv::Point2f>& pts) const {
+    std::vector<cv::Point2f> out(pts.size());
+    this->local_to_world(pts.data(), out.data(), pts.size());
+    return out;
+}
+
+std::vector<cv::Point2f> Transform2d::local_to_world(
+    const std::vector<cv::Point2f>& pts, ThreadPool& pool) const {
+    std::vector<cv::Point2f> out(pts.size());
+    this->local_to_world(pts.data(), out.data(), pts.size(), pool);
+    return out;
+}
+
 /* Create a transform that mirrors the y-axis about the x-axis
  */
 Transform2d Transform2d::mirror_about_x() const {
@@ -177,6 +381,10 @@ float Transform2d::z_mag() const {
     return this->data[0] * this->data[4] - this->data[1] * this->data[3];
 }
 
+const SqMatrix3& Transform2d::matrix() const { return this->data; }
+
+const SqMatrix3& Transform2d::inverse() const { return this->inv_data; }
+
 /* Adjoint of a 3x3 matrix
  *
  * Transpose of the cofactor matrix.  This is useful when finding the inverse.
@@ -211,11 +419,64 @@ cv::Point2f Transform2d::mul(
     };
 }
 
+/* Multiply a 3x3 matrix with each of `n` points
+ *
+ * Batch form of the above.  The matrix terms are hoisted into locals so the
+ * loop body is two multiply-adds per coordinate and vectorizes cleanly.
+ */
+void Transform2d::mul(
+    const SqMatrix3& matrix,
+    const cv::Point2f* in,
+    cv::Point2f* out,
+    const size_t n) {
+    const float xi = matrix[0];
+    const float xj = matrix[1];
+    const float yi = matrix[3];
+    const float yj = matrix[4];
+    const float Ti = matrix[6];
+    const float Tj = matrix[7];
+    for (size_t i = 0; i < n; ++i) {
+        const float x = in[i].x;
+        const float y = in[i].y;
+        out[i].x = xi * x + yi * y + Ti;
+        out[i].y = xj * x + yj * y + Tj;
+    }
+}
+
+/* Structure-of-arrays form of the batch multiply
+ *
+ * With unit-stride columns the loop maps straight onto full-width vector
+ * loads and stores.
+ */
+void Transform2d::mul(
+    const SqMatrix3& matrix,
+    const float* in_x,
+    const float* in_y,
+    float* out_x,
+    float* out_y,
+    const size_t n) {
+    const float xi = matrix[0];
+    const float xj = matrix[1];
+    const float yi = matrix[3];
+    const float yj = matrix[4];
+    const float Ti = matrix[6];
+    const float Tj = matrix[7];
+    for (size_t i = 0; i < n; ++i) {
+        const float x = in_x[i];
+        const float y = in_y[i];
+        out_x[i] = xi * x + yi * y + Ti;
+        out_y[i] = xj * x + yj * y + Tj;
+    }
+}
+
 /* Inverse of a 3x3 matrix
  *
  * M^-1 = adj(M) / det(A)
  */
 SqMatrix3 Transform2d::inv(const std::array<float, 9> matrix) {
+    static const MetricCounter inversions = MetricsRegistry::global().counter(
+        "transform_inversions_total", "Transform2d matrix inversions");
+    inversions.add();
     std::array<float, 9> adj = Transform2d::adj(matrix);
     float inv_det = 1.0f / Transform2d::det(matrix);
     std::array<float, 9> inverse = {0.0f};
@@ -232,8 +493,8 @@ SqMatrix3 Transform2d::inv(const std::array<float, 9> matrix) {
 
 /* Serialize as a string
  *
- * Useful for debugging.  If serializing to file or some other transfer stream,
- * this should be modified to utilize a standard format.
+ * Useful for debugging.  For files, streams and logs use format() and parse(),
+ * or the binary format in transform_file.hpp.
  */
 std::string Transform2d::to_string() const {
     std::stringstream ss;
@@ -257,3 +518,115 @@ std::string Transform2d::to_string() const {
        << "]";
     return ss.str();
 }
+
+/* Append the `n` characters of `text` at `first`
+ *
+ * Returns the new end, or nullptr if they do not fit before `last`.
+ */
+static char* PutText(char* first, char* last, const char* text, size_t n) {
+    if (first == nullptr || (size_t)(last - first) < n) {
+        return nullptr;
+    }
+    memcpy(first, text, n);
+    return first + n;
+}
+
+static char* PutText(char* first, char* last, const char* text) {
+    return PutText(first, last, text, strlen(text));
+}
+
+static char* PutFloat(char* first, char* last, const float value) {
+    if (first == nullptr) {
+        return nullptr;
+    }
+    std::to_chars_result res = std::to_chars(first, last, value);
+    return res.ec == std::errc() ? res.ptr : nullptr;
+}
+
+/* Write the matrix as text into [first, last)
+ *
+ * Each term is written in the shortest form that reads back to the same float,
+ * so parse() round-trips exactly; the inverse is not written and is recomputed
+ * when parsing.  Nothing is allocated and no terminator is added.  Returns the
+ * end of the text, or nullptr if it does not fit (kTransformTextMax always
+ * suffices).
+ */
+char* Transform2d::format(
+    char* first, char* last, const TransformFormat layout) const {
+    char* out = first;
+    switch (layout) {
+        case TransformFormat::kCompact:
+            out = PutText(out, last, "[");
+            for (size_t i = 0; i < this->data.size(); ++i) {
+                if (i > 0) out = PutText(out, last, ",");
+                out = PutFloat(out, last, this->data[i]);
+            }
+            return PutText(out, last, "]");
+        case TransformFormat::kJson:
+            out = PutText(out, last, "{");
+            for (size_t axis = 0; axis < 3; ++axis) {
+                out = PutText(out, last, axis > 0 ? ",\"" : "\"");
+                out = PutText(out, last, kAxisNames[axis]);
+                out = PutText(out, last, "\":[");
+                for (size_t i = 0; i < 3; ++i) {
+                    if (i > 0) out = PutText(out, last, ",");
+                    out = PutFloat(out, last, this->data[axis * 3 + i]);
+                }
+                out = PutText(out, last, "]");
+            }
+            return PutText(out, last, "}");
+        case TransformFormat::kYaml:
+            for (size_t axis = 0; axis < 3; ++axis) {
+                out = PutText(out, last, kAxisNames[axis]);
+                out = PutText(out, last, ": [");
+                for (size_t i = 0; i < 3; ++i) {
+                    if (i > 0) out = PutText(out, last, ", ");
+                    out = PutFloat(out, last, this->data[axis * 3 + i]);
+                }
+                out = PutText(out, last, "]\n");
+            }
+            return out;
+    }
+    return nullptr;
+}
+
+static bool IsSeparator(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' ||
+           c == ':' || c == '"' || c == '[' || c == ']' || c == '{' || c == '}';
+}
+
+/* Read a transform written by format(), in any layout
+ *
+ * Axis names are optional but must be in order when present.  Nothing is
+ * allocated.  Returns the end of the consumed text, including trailing
+ * brackets and whitespace, or nullptr if the text is not a transform; `out`
+ * is only assigned on success.
+ */
+const char* Transform2d::parse(
+    const char* first, const char* last, Transform2d& out) {
+    SqMatrix3 matrix;
+    const char* pos = first;
+    for (size_t i = 0; i < matrix.size(); ++i) {
+        while (pos != last && IsSeparator(*pos)) ++pos;
+        if (i % 3 == 0) {
+            // Skip the axis name, if any
+            const char* name = kAxisNames[i / 3];
+            const size_t len = strlen(name);
+            if ((size_t)(last - pos) >= len && memcmp(pos, name, len) == 0) {
+                pos += len;
+                while (pos != last && IsSeparator(*pos)) ++pos;
+            }
+        }
+        std::from_chars_result res = std::from_chars(pos, last, matrix[i]);
+        if (res.ec != std::errc()) {
+            return nullptr;
+        }
+        pos = res.ptr;
+    }
+    while (pos != last && (*pos == ']' || *pos == '}' || *pos == ' ' ||
+                           *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+        ++pos;
+    }
+    out = Transform2d(matrix);
+    return pos;
+}
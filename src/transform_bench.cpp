@@ -0,0 +1,712 @@
+/* Microbenchmarks for Transform2d
+ *
+ * Self-contained: no benchmark framework, no network, no input files.  Every
+ * benchmark is calibrated to run for at least --min-time per sample and is
+ * sampled --repetitions times; the median is reported.
+ *
+ * --json writes the raw samples with host and ISA details; --compare checks the
+ * run against such a file and exits with 1 if any benchmark slowed down by
+ * more than --threshold percent beyond its measurement noise.
+ *
+ * Where the kernel allows it, hardware counters run alongside the timing and
+ * each benchmark also reports IPC and cache and branch misses per point (per
+ * operation for benchmarks that map no points); --no-counters turns them off.
+ *
+ * Usage: transform_bench [--filter substr] [--repetitions N] [--min-time ms]
+ *                        [--max-points N] [--json out.json]
+ *                        [--compare baseline.json] [--threshold pct]
+ *                        [--no-counters]
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "metrics.hpp"
+#include "perf_counters.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "transform.hpp"
+#include "types.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+// Inputs cycle through this many values so nothing constant-folds
+static const size_t kInputCount = 1024;
+
+struct BenchConfig {
+    std::string filter;
+    int repetitions;
+    double min_time_s;
+    size_t max_points;
+    std::string json_path;
+    std::string baseline_path;
+    // Slowdown, in percent, that fails a comparison
+    double threshold_pct;
+    bool counters;
+};
+
+/* One benchmark: `run(iters)` performs `iters` operations
+ *
+ * `items` is the number of points each operation touches and `bytes` the
+ * memory traffic per operation, both 0 where they do not apply.
+ */
+struct Bench {
+    std::string name;
+    size_t items;
+    size_t bytes;
+    std::function<void(size_t)> run;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t items;
+    size_t bytes;
+    // Nanoseconds per operation, one per repetition
+    std::vector<double> samples;
+    // Mean count per operation, by PerfCounter; empty without counters
+    std::vector<double> counters;
+};
+
+// Scale from the MAD to the standard deviation of normally distributed data
+static const double kMadToSigma = 1.4826;
+// Differences within this many noise sigmas are not significant
+static const double kSignificanceSigmas = 3.0;
+
+// Keep `value` alive without letting the compiler see through it
+template <typename T>
+static inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+// Median absolute deviation
+static double Mad(const std::vector<double>& values) {
+    const double median = Median(values);
+    std::vector<double> deviations;
+    for (double v : values) {
+        deviations.push_back(std::fabs(v - median));
+    }
+    return Median(deviations);
+}
+
+static double Seconds(const Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+/* Iterations needed for one sample to last at least `min_time_s`
+ *
+ * Doubles the count until a run takes a tenth of the target, then scales.
+ */
+static size_t Calibrate(const Bench& bench, const double min_time_s) {
+    size_t iters = 1;
+    for (;;) {
+        const Clock::time_point start = Clock::now();
+        bench.run(iters);
+        const double secs = Seconds(Clock::now() - start);
+        if (secs >= min_time_s / 10.0 || iters >= (size_t(1) << 40)) {
+            const double scale = min_time_s / std::max(secs, 1e-9);
+            return std::max<size_t>(1, (size_t)std::ceil(iters * scale));
+        }
+        iters *= 2;
+    }
+}
+
+/* Time `bench`, counting hardware events over the same runs if `counters` is
+ * available
+ *
+ * The counters are switched on and off outside the timed region, and the two
+ * ioctls each way are noise next to a sample of --min-time.
+ */
+static BenchResult RunBench(
+    const Bench& bench, const BenchConfig& config, PerfCounters& counters) {
+    BenchResult result = {bench.name, bench.items, bench.bytes, {}, {}};
+    const size_t iters = Calibrate(bench, config.min_time_s);
+    std::vector<double> totals(kPerfCounterCount, 0.0);
+    for (int rep = 0; rep < config.repetitions; ++rep) {
+        counters.start();
+        const Clock::time_point start = Clock::now();
+        bench.run(iters);
+        const double secs = Seconds(Clock::now() - start);
+        counters.stop();
+        result.samples.push_back(secs * 1e9 / iters);
+        for (int c = 0; c < kPerfCounterCount; ++c) {
+            totals[c] += counters.value((PerfCounter)c);
+        }
+    }
+    if (counters.available()) {
+        const double ops = (double)iters * config.repetitions;
+        for (int c = 0; c < kPerfCounterCount; ++c) {
+            result.counters.push_back(
+                counters.available((PerfCounter)c) ? totals[c] / ops : NAN);
+        }
+    }
+    return result;
+}
+
+static std::vector<cv::Point2f> MakePoints(const size_t n) {
+    std::vector<cv::Point2f> pts(n);
+    for (size_t i = 0; i < n; ++i) {
+        pts[i] = cv::Point2f(
+            (float)(i % 4096) * 0.75f - 1000.0f, (float)(i / 4096) * 1.25f + 3.0f);
+    }
+    return pts;
+}
+
+static std::vector<Transform2d> MakeTransforms() {
+    std::vector<Transform2d> xforms;
+    for (size_t i = 0; i < kInputCount; ++i) {
+        xforms.push_back(Transform2d()
+                             .rotate_ccw_deg((float)i * 0.37f)
+                             .translate((float)i, -0.5f * (float)i));
+    }
+    return xforms;
+}
+
+/* Single-point, construction and composition benchmarks
+ *
+ * Each operation reads its inputs from a table indexed by the iteration, so
+ * consecutive operations are independent and the timing is throughput.
+ */
+static void AddScalarBenches(std::vector<Bench>& benches) {
+    static const std::vector<Transform2d> xforms = MakeTransforms();
+    static const std::vector<cv::Point2f> pts = MakePoints(kInputCount);
+    static std::vector<SqMatrix3> matrices;
+    static std::vector<SqMatrix3> inverses;
+    static std::vector<cv::Vec4f> fits;
+    if (matrices.empty()) {
+        for (const Transform2d& xform : xforms) {
+            matrices.push_back(xform.matrix());
+            inverses.push_back(xform.inverse());
+        }
+        for (size_t i = 0; i < kInputCount; ++i) {
+            const float angle = (float)i * 0.01f;
+            fits.push_back(cv::Vec4f(cosf(angle), sinf(angle), (float)i, 2.0f * i));
+        }
+    }
+    const size_t mask = kInputCount - 1;
+
+    benches.push_back({"world_to_local/point", 1, 16, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(xforms[i & mask].world_to_local(pts[i & mask]));
+                           }
+                       }});
+    benches.push_back({"local_to_world/point", 1, 16, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(xforms[i & mask].local_to_world(pts[i & mask]));
+                           }
+                       }});
+    // Conversion constructor: the cost is the 3x3 inversion
+    benches.push_back({"inv/construct_from_matrix", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(Transform2d(matrices[i & mask]));
+                           }
+                       }});
+    benches.push_back({"construct/matrix_and_inverse", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(
+                                   Transform2d(matrices[i & mask], inverses[i & mask]));
+                           }
+                       }});
+    benches.push_back({"construct/affine_terms", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               const cv::Point2f& p = pts[i & mask];
+                               DoNotOptimize(Transform2d(1.0f, 0.0f, 0.0f, 1.0f, p.x, p.y));
+                           }
+                       }});
+    benches.push_back({"construct/line_fit", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(Transform2d(fits[i & mask], pts[i & mask]));
+                           }
+                       }});
+    benches.push_back({"construct/from_rotation_translation", 0, 0, [](size_t iters) {
+                           static const cv::RotateFlags flags[3] = {
+                               cv::ROTATE_90_CLOCKWISE,
+                               cv::ROTATE_180,
+                               cv::ROTATE_90_COUNTERCLOCKWISE};
+                           for (size_t i = 0; i < iters; ++i) {
+                               const cv::Point2f& p = pts[i & mask];
+                               DoNotOptimize(Transform2d::from_rotation_translation(
+                                   flags[i % 3], p.x, p.y));
+                           }
+                       }});
+    benches.push_back({"rotate_ccw_deg", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(xforms[i & mask].rotate_ccw_deg((float)(i & mask)));
+                           }
+                       }});
+    benches.push_back({"rotate_ccw_rad", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(
+                                   xforms[i & mask].rotate_ccw_rad((float)(i & mask) * 0.01f));
+                           }
+                       }});
+    benches.push_back({"translate", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               const cv::Point2f& p = pts[i & mask];
+                               DoNotOptimize(xforms[i & mask].translate(p.x, p.y));
+                           }
+                       }});
+    benches.push_back({"mirror_about_x", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(xforms[i & mask].mirror_about_x());
+                           }
+                       }});
+    benches.push_back({"mirror_about_y", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               DoNotOptimize(xforms[i & mask].mirror_about_y());
+                           }
+                       }});
+}
+
+/* Cost of one TraceScope, with tracing stopped and while recording
+ *
+ * The recording variant starts a new session every buffer's worth of events
+ * so none is dropped and every iteration pays for the full write.
+ */
+static void AddTraceBenches(std::vector<Bench>& benches) {
+    benches.push_back({"trace/scope_stopped", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               TraceScope scope("bench");
+                               DoNotOptimize(i);
+                           }
+                       }});
+    benches.push_back({"trace/scope_recording", 0, 0, [](size_t iters) {
+                           for (size_t done = 0; done < iters;) {
+                               trace_start();
+                               const size_t n = std::min(iters - done, kTraceBufferEvents);
+                               for (size_t i = 0; i < n; ++i) {
+                                   TraceScope scope("bench");
+                                   DoNotOptimize(i);
+                               }
+                               done += n;
+                           }
+                           trace_stop();
+                       }});
+}
+
+/* Cost of recording a metric from the thread's own shard
+ */
+static void AddMetricsBenches(std::vector<Bench>& benches) {
+    static const MetricCounter counter =
+        MetricsRegistry::global().counter("transform_bench_total", "Bench iterations");
+    static const MetricHistogram histogram =
+        MetricsRegistry::global().histogram("transform_bench_seconds", "Bench values");
+    benches.push_back({"metrics/counter_add", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               counter.add();
+                               DoNotOptimize(i);
+                           }
+                       }});
+    benches.push_back({"metrics/histogram_record", 0, 0, [](size_t iters) {
+                           for (size_t i = 0; i < iters; ++i) {
+                               histogram.record(i & 0xffff);
+                           }
+                       }});
+}
+
+/* Batch kernels over working sets from L1-resident up to DRAM
+ *
+ * Traffic counts the points read and written, 16 bytes per point.
+ */
+static void AddBatchBenches(std::vector<Bench>& benches, const size_t max_points) {
+    static const Transform2d xform =
+        Transform2d().rotate_ccw_deg(30.0f).translate(400.0f, 200.0f);
+    // 8 KB, 128 KB, 2 MB and 32 MB of input points
+    static const size_t sizes[] = {1 << 10, 1 << 14, 1 << 18, 1 << 22};
+    for (size_t n : sizes) {
+        if (n > max_points) {
+            continue;
+        }
+        auto in = std::make_shared<std::vector<cv::Point2f>>(MakePoints(n));
+        auto out = std::make_shared<std::vector<cv::Point2f>>(n);
+        auto xs = std::make_shared<std::vector<float>>(n);
+        auto ys = std::make_shared<std::vector<float>>(n);
+        for (size_t i = 0; i < n; ++i) {
+            (*xs)[i] = (*in)[i].x;
+            (*ys)[i] = (*in)[i].y;
+        }
+        auto out_x = std::make_shared<std::vector<float>>(n);
+        auto out_y = std::make_shared<std::vector<float>>(n);
+        const std::string suffix = "/" + std::to_string(n);
+        const size_t bytes = n * 2 * sizeof(cv::Point2f);
+
+        benches.push_back({"world_to_local/batch" + suffix, n, bytes, [=](size_t iters) {
+                               for (size_t i = 0; i < iters; ++i) {
+                                   xform.world_to_local(in->data(), out->data(), n);
+                                   DoNotOptimize(out->data()[i % n]);
+                               }
+                           }});
+        benches.push_back({"local_to_world/batch" + suffix, n, bytes, [=](size_t iters) {
+                               for (size_t i = 0; i < iters; ++i) {
+                                   xform.local_to_world(in->data(), out->data(), n);
+                                   DoNotOptimize(out->data()[i % n]);
+                               }
+                           }});
+        benches.push_back({"world_to_local/batch_soa" + suffix, n, bytes, [=](size_t iters) {
+                               for (size_t i = 0; i < iters; ++i) {
+                                   xform.world_to_local(
+                                       xs->data(), ys->data(), out_x->data(), out_y->data(), n);
+                                   DoNotOptimize(out_x->data()[i % n]);
+                               }
+                           }});
+        benches.push_back({"world_to_local/batch_pool" + suffix, n, bytes, [=](size_t iters) {
+                               for (size_t i = 0; i < iters; ++i) {
+                                   xform.world_to_local(
+                                       in->data(), out->data(), n, ThreadPool::global());
+                                   DoNotOptimize(out->data()[i % n]);
+                               }
+                           }});
+    }
+}
+
+static void PrintResult(const BenchResult& result) {
+    const double ns = Median(result.samples);
+    printf("%-44s %12.2f ns/op", result.name.c_str(), ns);
+    if (result.items > 0) {
+        printf("  %10.1f Mpts/s", result.items / ns * 1e3);
+    }
+    if (result.bytes > 0) {
+        printf("  %8.2f GB/s", result.bytes / ns);
+    }
+    if (!result.counters.empty()) {
+        const std::vector<double>& c = result.counters;
+        if (c[kPerfCycles] > 0.0 && !std::isnan(c[kPerfInstructions])) {
+            printf("  IPC %5.2f", c[kPerfInstructions] / c[kPerfCycles]);
+        }
+        // Misses per point, or per operation when no points are mapped
+        const double per = result.items > 0 ? (double)result.items : 1.0;
+        static const PerfCounter kMisses[] = {kPerfL1dMisses, kPerfLlcMisses, kPerfBranchMisses};
+        static const char* const kLabels[] = {"L1d", "LLC", "br"};
+        for (int i = 0; i < 3; ++i) {
+            if (!std::isnan(c[kMisses[i]])) {
+                printf("  %s %.3f", kLabels[i], c[kMisses[i]] / per);
+            }
+        }
+        printf(result.items > 0 ? " /pt" : " /op");
+    }
+    printf("\n");
+}
+
+static std::string JsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static std::string CpuModel() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                return line.substr(line.find_first_not_of(' ', colon + 1));
+            }
+        }
+    }
+    return "unknown";
+}
+
+/* Instruction set extensions: what the CPU offers and what the build uses
+ */
+static std::vector<std::string> CpuIsa() {
+    std::vector<std::string> isa;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) isa.push_back("sse4.2");
+    if (__builtin_cpu_supports("avx")) isa.push_back("avx");
+    if (__builtin_cpu_supports("avx2")) isa.push_back("avx2");
+    if (__builtin_cpu_supports("fma")) isa.push_back("fma");
+    if (__builtin_cpu_supports("avx512f")) isa.push_back("avx512f");
+#elif defined(__aarch64__)
+    isa.push_back("neon");
+#endif
+    return isa;
+}
+
+static std::vector<std::string> BuildIsa() {
+    std::vector<std::string> isa;
+#if defined(__SSE4_2__)
+    isa.push_back("sse4.2");
+#endif
+#if defined(__AVX__)
+    isa.push_back("avx");
+#endif
+#if defined(__AVX2__)
+    isa.push_back("avx2");
+#endif
+#if defined(__FMA__)
+    isa.push_back("fma");
+#endif
+#if defined(__AVX512F__)
+    isa.push_back("avx512f");
+#endif
+#if defined(__ARM_NEON)
+    isa.push_back("neon");
+#endif
+    return isa;
+}
+
+static std::string JsonList(const std::vector<std::string>& items) {
+    std::string out = "[";
+    for (size_t i = 0; i < items.size(); ++i) {
+        out += (i > 0 ? ", \"" : "\"") + JsonEscape(items[i]) + "\"";
+    }
+    return out + "]";
+}
+
+static bool WriteJson(
+    const std::string& path,
+    const BenchConfig& config,
+    const std::vector<BenchResult>& results) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    char date[32];
+    const time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(file, "{\n  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", date);
+    fprintf(file, "    \"host\": \"%s\",\n", JsonEscape(host).c_str());
+    fprintf(file, "    \"cpu\": \"%s\",\n", JsonEscape(CpuModel()).c_str());
+    fprintf(file, "    \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(file, "    \"threads\": %zu,\n", ThreadPool::global().concurrency());
+    fprintf(file, "    \"cpu_isa\": %s,\n", JsonList(CpuIsa()).c_str());
+    fprintf(file, "    \"build_isa\": %s,\n", JsonList(BuildIsa()).c_str());
+    fprintf(file, "    \"compiler\": \"%s\",\n", JsonEscape(__VERSION__).c_str());
+    fprintf(file, "    \"repetitions\": %d,\n", config.repetitions);
+    fprintf(file, "    \"min_time_s\": %g\n", config.min_time_s);
+    fprintf(file, "  },\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        fprintf(file, "    {\"name\": \"%s\", ", JsonEscape(r.name).c_str());
+        fprintf(file, "\"items\": %zu, \"bytes\": %zu, ", r.items, r.bytes);
+        fprintf(file, "\"median_ns\": %.6g, ", Median(r.samples));
+        fprintf(file, "\"mad_ns\": %.6g, \"samples\": [", Mad(r.samples));
+        for (size_t k = 0; k < r.samples.size(); ++k) {
+            fprintf(file, "%s%.6g", k > 0 ? ", " : "", r.samples[k]);
+        }
+        fprintf(file, "]");
+        if (!r.counters.empty()) {
+            // Per operation, as measured; unavailable counters are left out
+            fprintf(file, ", \"counters\": {");
+            const char* separator = "";
+            for (int c = 0; c < kPerfCounterCount; ++c) {
+                if (!std::isnan(r.counters[c])) {
+                    fprintf(
+                        file,
+                        "%s\"%s\": %.6g",
+                        separator,
+                        PerfCounters::name((PerfCounter)c),
+                        r.counters[c]);
+                    separator = ", ";
+                }
+            }
+            fprintf(file, "}");
+        }
+        fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+/* Read the name and samples of each benchmark from a file written by WriteJson
+ *
+ * Only understands that layout, not JSON in general.
+ */
+static bool ReadJson(const std::string& path, std::vector<BenchResult>& results) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string text = buffer.str();
+    size_t pos = text.find("\"benchmarks\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const std::string name_key = "\"name\": \"";
+    const std::string samples_key = "\"samples\": [";
+    while ((pos = text.find(name_key, pos)) != std::string::npos) {
+        BenchResult result = {"", 0, 0, {}, {}};
+        pos += name_key.size();
+        const size_t name_end = text.find('"', pos);
+        const size_t samples = text.find(samples_key, pos);
+        if (name_end == std::string::npos || samples == std::string::npos) {
+            return false;
+        }
+        result.name = text.substr(pos, name_end - pos);
+        pos = samples + samples_key.size();
+        while (pos < text.size() && text[pos] != ']') {
+            char* end = nullptr;
+            const double value = strtod(text.c_str() + pos, &end);
+            if (end == text.c_str() + pos) {
+                return false;
+            }
+            result.samples.push_back(value);
+            pos = end - text.c_str();
+            while (pos < text.size() && (text[pos] == ',' || text[pos] == ' ')) ++pos;
+        }
+        if (result.samples.empty()) {
+            return false;
+        }
+        results.push_back(result);
+    }
+    return !results.empty();
+}
+
+/* Compare each benchmark with the baseline; returns the number of regressions
+ *
+ * A benchmark regresses when its median is more than `threshold_pct` slower
+ * than the baseline median and the difference is also well outside the noise
+ * of either run, judged by the larger MAD, so a noisy machine does not fail
+ * on a single slow sample.
+ */
+static int Compare(
+    const std::vector<BenchResult>& baseline,
+    const std::vector<BenchResult>& results,
+    const double threshold_pct) {
+    int regressions = 0;
+    printf(
+        "\n%-44s %12s %12s %8s\n", "comparison", "base ns", "new ns", "change");
+    for (const BenchResult& result : results) {
+        auto base = std::find_if(
+            baseline.begin(), baseline.end(), [&](const BenchResult& b) {
+                return b.name == result.name;
+            });
+        if (base == baseline.end()) {
+            printf("%-44s %12s\n", result.name.c_str(), "new");
+            continue;
+        }
+        const double before = Median(base->samples);
+        const double after = Median(result.samples);
+        const double change_pct = (after - before) / before * 100.0;
+        const double noise =
+            kSignificanceSigmas * kMadToSigma * std::max(Mad(base->samples), Mad(result.samples));
+        const bool significant = std::fabs(after - before) > noise;
+        const char* verdict = "";
+        if (significant && change_pct > threshold_pct) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (significant && change_pct < -threshold_pct) {
+            verdict = "faster";
+        }
+        printf(
+            "%-44s %12.2f %12.2f %+7.1f%%  %s\n",
+            result.name.c_str(),
+            before,
+            after,
+            change_pct,
+            verdict);
+    }
+    return regressions;
+}
+
+static bool ParseArgs(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            config.filter = argv[++i];
+        } else if (strcmp(argv[i], "--repetitions") == 0 && has_value) {
+            config.repetitions = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--min-time") == 0 && has_value) {
+            config.min_time_s = std::max(1.0, atof(argv[++i])) * 1e-3;
+        } else if (strcmp(argv[i], "--max-points") == 0 && has_value) {
+            config.max_points = (size_t)std::max(0LL, atoll(argv[++i]));
+        } else if (strcmp(argv[i], "--json") == 0 && has_value) {
+            config.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && has_value) {
+            config.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && has_value) {
+            config.threshold_pct = std::max(0.0, atof(argv[++i]));
+        } else if (strcmp(argv[i], "--no-counters") == 0) {
+            config.counters = false;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config = {"", 5, 0.05, size_t(1) << 22, "", "", 5.0, true};
+    if (!ParseArgs(argc, argv, config)) {
+        fprintf(
+            stderr,
+            "Usage: %s [--filter substr] [--repetitions N] [--min-time ms] "
+            "[--max-points N] [--json out.json] [--compare baseline.json] "
+            "[--threshold pct] [--no-counters]\n",
+            argv[0]);
+        return 2;
+    }
+    std::vector<BenchResult> baseline;
+    if (!config.baseline_path.empty() && !ReadJson(config.baseline_path, baseline)) {
+        fprintf(stderr, "Could not read baseline %s\n", config.baseline_path.c_str());
+        return 2;
+    }
+    // Before the pool starts, so its workers inherit the counters
+    PerfCounters counters;
+    if (config.counters && !counters.open()) {
+        printf("Hardware counters unavailable (see perf_event_paranoid), timing only\n");
+    }
+    std::vector<Bench> benches;
+    AddScalarBenches(benches);
+    AddBatchBenches(benches, config.max_points);
+    AddTraceBenches(benches);
+    AddMetricsBenches(benches);
+    printf(
+        "%zu thread(s), %d repetition(s), median of each\n",
+        ThreadPool::global().concurrency(),
+        config.repetitions);
+    std::vector<BenchResult> results;
+    for (const Bench& bench : benches) {
+        if (bench.name.find(config.filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(RunBench(bench, config, counters));
+        PrintResult(results.back());
+    }
+    if (!config.json_path.empty() && !WriteJson(config.json_path, config, results)) {
+        fprintf(stderr, "Could not write %s\n", config.json_path.c_str());
+        return 2;
+    }
+    if (!baseline.empty()) {
+        const int regressions = Compare(baseline, results, config.threshold_pct);
+        if (regressions > 0) {
+            printf("%d regression(s) above %.1f%%\n", regressions, config.threshold_pct);
+            return 1;
+        }
+    }
+    return 0;
+}
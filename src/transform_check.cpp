@@ -0,0 +1,875 @@
+/* Checks for the invariants the transform library's formats, estimators and
+ * metrics promise
+ *
+ * Self-contained like transform_bench: every check writes what it needs to a
+ * temporary directory and removes it again.  Each failed condition is
+ * printed with its line; the exit code is 1 if any failed.  Registered with
+ * ctest.
+ *
+ * Usage: transform_check [--filter substr]
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <opencv2/core.hpp>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_log.hpp"
+#include "homography.hpp"
+#include "keypoint_file.hpp"
+#include "metrics.hpp"
+#include "point_grid.hpp"
+#include "shm_ring.hpp"
+#include "thread_pool.hpp"
+#include "transform.hpp"
+#include "transform_file.hpp"
+#include "types.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                      \
+        }                                                                    \
+    } while (0)
+
+/* Heap allocations by this program, to check code that must not allocate
+ *
+ * Replacing the plain operator new covers the array, nothrow and sized forms,
+ * which fall back to it; every form of delete falls back to free.
+ */
+static std::atomic<size_t> allocations(0);
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+struct Check {
+    std::string name;
+    std::function<void()> run;
+};
+
+// Path for a scratch file, unique to this process
+static std::string TempPath(const char* name) {
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir != nullptr ? dir : "/tmp") + "/transform_check_" +
+           std::to_string(getpid()) + "_" + name;
+}
+
+static std::vector<char> ReadBytes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), {});
+}
+
+static void WriteBytes(const std::string& path, const std::vector<char>& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), (std::streamsize)bytes.size());
+}
+
+static bool SameBits(const AffineRows& a, const AffineRows& b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// The six affine terms; the constant bottom row is not stored anywhere
+static bool SameAffine(const SqMatrix3& a, const SqMatrix3& b) {
+    return SameBits(AffineRows::from_matrix(a), AffineRows::from_matrix(b));
+}
+
+// Rotations and translations of every size, deterministic across runs
+static std::vector<Transform2d> RandomTransforms(const size_t n) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> angle(-180.0f, 180.0f);
+    std::uniform_real_distribution<float> offset(-1e5f, 1e5f);
+    std::vector<Transform2d> out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        out.push_back(
+            Transform2d().rotate_ccw_deg(angle(rng)).translate(offset(rng), offset(rng)));
+    }
+    return out;
+}
+
+/* Transform files read back bit for bit, with and without the inverse, and
+ * damaged ones are refused
+ */
+static void AddTransformFileChecks(std::vector<Check>& checks) {
+    checks.push_back({"transform_file/round_trip", [] {
+                          const std::vector<Transform2d> xforms = RandomTransforms(60000);
+                          const std::string path = TempPath("xforms.bin");
+                          for (const bool with_inverse : {true, false}) {
+                              TransformWriter writer;
+                              CHECK(writer.open(path, with_inverse));
+                              CHECK(writer.append(xforms.data(), xforms.size() - 1));
+                              CHECK(writer.append(xforms.back()));
+                              CHECK(writer.close());
+
+                              TransformFile file;
+                              CHECK(file.open(path));
+                              CHECK(file.size() == xforms.size());
+                              CHECK(file.has_inverse() == with_inverse);
+                              bool same = file.size() == xforms.size();
+                              for (size_t i = 0; same && i < xforms.size(); ++i) {
+                                  const Transform2d& x = xforms[i];
+                                  same = SameBits(
+                                      file.rows(i), AffineRows::from_matrix(x.matrix()));
+                                  if (with_inverse) {
+                                      same = same &&
+                                             SameBits(
+                                                 file.inverse_rows(i),
+                                                 AffineRows::from_matrix(x.inverse())) &&
+                                             SameAffine(file.at(i).inverse(), x.inverse());
+                                  }
+                                  same = same && SameAffine(file.at(i).matrix(), x.matrix());
+                              }
+                              CHECK(same);
+                          }
+                          std::remove(path.c_str());
+                      }});
+    checks.push_back({"transform_file/damage", [] {
+                          const std::vector<Transform2d> xforms = RandomTransforms(100);
+                          const std::string path = TempPath("damaged.bin");
+                          TransformWriter writer;
+                          CHECK(writer.open(path, true));
+                          CHECK(writer.append(xforms.data(), xforms.size()));
+                          CHECK(writer.close());
+                          const std::vector<char> good = ReadBytes(path);
+                          TransformFile file;
+
+                          // A flipped bit in a record fails the checksum only
+                          std::vector<char> bytes = good;
+                          bytes[sizeof(TransformFileHeader) + 100] ^= 0x10;
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path));
+                          CHECK(file.open(path, false));
+
+                          // Records cut off, a foreign file, a newer version
+                          bytes = good;
+                          bytes.resize(bytes.size() - 1);
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path, false));
+                          bytes = good;
+                          bytes[0] = 'Y';
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path, false));
+                          bytes = good;
+                          bytes[offsetof(TransformFileHeader, version)] += 1;
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path, false));
+                          bytes.resize(sizeof(TransformFileHeader) - 1);
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path, false));
+                          std::remove(path.c_str());
+                      }});
+}
+
+// Float with the bit pattern `bits`
+static float FromBits(const u32 bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/* Matrices whose terms cover the float range: random bit patterns (NaNs
+ * aside, which never compare equal), both zeros, the extremes of the normal
+ * range and the smallest subnormal
+ */
+static std::vector<SqMatrix3> ExtremeMatrices(const size_t n) {
+    static const float specials[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, FLT_MAX, -FLT_MAX, FLT_MIN, -FLT_MIN,
+        FLT_TRUE_MIN, -FLT_TRUE_MIN, FLT_EPSILON, 1e-38f, 3.4e38f, 0.1f, 1.0f / 3.0f,
+    };
+    const size_t special_count = sizeof(specials) / sizeof(specials[0]);
+    std::mt19937 rng(7);
+    std::vector<SqMatrix3> out(n);
+    for (size_t i = 0; i < n; ++i) {
+        for (float& term : out[i]) {
+            const u32 bits = (u32)rng();
+            if (bits % 8 == 0) {
+                term = specials[(bits >> 3) % special_count];
+            } else {
+                term = FromBits(bits);
+                if (term != term) term = FromBits(bits & 0x807fffffu);
+            }
+        }
+    }
+    return out;
+}
+
+/* Transform2d::format and parse round-trip every term bit for bit in every
+ * layout, never allocate, and refuse to overflow the buffer
+ */
+static void AddTextChecks(std::vector<Check>& checks) {
+    static const TransformFormat layouts[] = {
+        TransformFormat::kCompact, TransformFormat::kJson, TransformFormat::kYaml};
+    checks.push_back({"text/round_trip", [] {
+                          std::vector<Transform2d> xforms;
+                          for (const SqMatrix3& m : ExtremeMatrices(20000)) {
+                              xforms.emplace_back(m, m);
+                          }
+                          for (const Transform2d& x : RandomTransforms(40000)) {
+                              xforms.push_back(x);
+                          }
+                          char text[kTransformTextMax];
+                          size_t mismatches = 0;
+                          bool fits = true;
+                          bool parsed_all = true;
+                          const size_t before = allocations.load();
+                          for (const TransformFormat layout : layouts) {
+                              for (const Transform2d& x : xforms) {
+                                  char* end = x.format(text, text + sizeof(text), layout);
+                                  if (end == nullptr) {
+                                      fits = false;
+                                      continue;
+                                  }
+                                  Transform2d back;
+                                  parsed_all &= Transform2d::parse(text, end, back) == end;
+                                  mismatches += memcmp(
+                                                    back.matrix().data(),
+                                                    x.matrix().data(),
+                                                    sizeof(SqMatrix3)) != 0;
+                              }
+                          }
+                          CHECK(allocations.load() == before);
+                          CHECK(fits);
+                          CHECK(parsed_all);
+                          CHECK(mismatches == 0);
+                      }});
+    checks.push_back({"text/buffer_bounds", [] {
+                          const SqMatrix3 worst = {
+                              -FLT_TRUE_MIN, -FLT_MAX, -1.17549421e-38f,
+                              -FLT_TRUE_MIN, -FLT_MAX, -1.17549421e-38f,
+                              -FLT_TRUE_MIN, -FLT_MAX, -1.17549421e-38f};
+                          const Transform2d x(worst, worst);
+                          char text[kTransformTextMax + 1];
+                          for (const TransformFormat layout : layouts) {
+                              char* end = x.format(text, text + sizeof(text), layout);
+                              CHECK(end != nullptr);
+                              if (end == nullptr) continue;
+                              const size_t length = (size_t)(end - text);
+                              CHECK(length <= kTransformTextMax);
+                              // Every shorter buffer is refused, not overrun
+                              bool refused = true;
+                              for (size_t n = 0; n < length; ++n) {
+                                  text[n] = '\x7f';
+                                  refused &= x.format(text, text + n, layout) == nullptr &&
+                                             text[n] == '\x7f';
+                              }
+                              CHECK(refused);
+                          }
+                          Transform2d back;
+                          const char bad[] = "[1,2,x]";
+                          CHECK(Transform2d::parse(bad, bad + sizeof(bad) - 1, back) == nullptr);
+                          const char cut[] = "[1,2,3,4,5";
+                          CHECK(Transform2d::parse(cut, cut + sizeof(cut) - 1, back) == nullptr);
+                      }});
+}
+
+static std::vector<cv::Point2f> RandomPoints(const size_t n) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> coord(-5e4f, 5e4f);
+    std::vector<cv::Point2f> out(n);
+    for (cv::Point2f& pt : out) {
+        pt = cv::Point2f(coord(rng), coord(rng));
+    }
+    return out;
+}
+
+static bool SamePoints(const std::vector<cv::Point2f>& a, const std::vector<cv::Point2f>& b) {
+    return a.size() == b.size() &&
+           (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(cv::Point2f)) == 0);
+}
+
+/* Binary keypoint files map with aligned columns and load exactly; text files
+ * parse exactly, in order, whatever the separators, across chunk boundaries
+ */
+static void AddKeypointFileChecks(std::vector<Check>& checks) {
+    checks.push_back({"keypoint_file/binary", [] {
+                          const std::vector<cv::Point2f> pts = RandomPoints(100003);
+                          const std::string path = TempPath("keypoints.bin");
+                          CHECK(KeypointFile::write(path, pts.data(), pts.size()));
+                          KeypointFile file;
+                          CHECK(file.open(path));
+                          CHECK(file.size() == pts.size());
+                          CHECK((uintptr_t)file.xs() % 64 == 0);
+                          CHECK((uintptr_t)file.ys() % 64 == 0);
+                          bool same = file.size() == pts.size();
+                          for (size_t i = 0; same && i < pts.size(); ++i) {
+                              same = memcmp(&file.xs()[i], &pts[i].x, sizeof(float)) == 0 &&
+                                     memcmp(&file.ys()[i], &pts[i].y, sizeof(float)) == 0;
+                          }
+                          CHECK(same);
+                          file.close();
+
+                          ThreadPool pool(4);
+                          std::vector<cv::Point2f> loaded;
+                          CHECK(load_keypoints(path, loaded, pool));
+                          CHECK(SamePoints(loaded, pts));
+
+                          // Columns written separately land in the same layout
+                          std::vector<float> xs(pts.size());
+                          std::vector<float> ys(pts.size());
+                          for (size_t i = 0; i < pts.size(); ++i) {
+                              xs[i] = pts[i].x;
+                              ys[i] = pts[i].y;
+                          }
+                          const std::vector<char> from_points = ReadBytes(path);
+                          CHECK(KeypointFile::write(path, xs.data(), ys.data(), xs.size()));
+                          CHECK(ReadBytes(path) == from_points);
+
+                          // A cut-off column is refused
+                          KeypointFileHeader header;
+                          memcpy(&header, from_points.data(), sizeof(header));
+                          std::vector<char> bytes = from_points;
+                          bytes.resize(header.y_offset + header.count * sizeof(float) - 4);
+                          WriteBytes(path, bytes);
+                          CHECK(!file.open(path));
+                          std::remove(path.c_str());
+                      }});
+    checks.push_back({"keypoint_file/text", [] {
+                          const std::vector<cv::Point2f> pts = RandomPoints(50000);
+                          static const char* const separators[] = {",", ";", "\t", " ", ", "};
+                          std::string text = "x,y,score\n# comment\n";
+                          char number[32];
+                          char* const last = number + sizeof(number);
+                          for (size_t i = 0; i < pts.size(); ++i) {
+                              text.append(number, std::to_chars(number, last, pts[i].x).ptr);
+                              text += separators[i % 5];
+                              text.append(number, std::to_chars(number, last, pts[i].y).ptr);
+                              text += i % 7 == 0 ? ",0.5" : "";
+                              text += i % 11 == 0 ? "\r\n" : "\n";
+                              text += i % 13 == 0 ? "\n" : "";
+                          }
+                          const std::string path = TempPath("keypoints.csv");
+                          WriteBytes(path, std::vector<char>(text.begin(), text.end()));
+                          for (const size_t threads : {(size_t)1, (size_t)3, (size_t)8}) {
+                              ThreadPool pool(threads);
+                              std::vector<cv::Point2f> parsed;
+                              CHECK(parse_keypoints_text(path, parsed, pool));
+                              CHECK(SamePoints(parsed, pts));
+                              std::vector<cv::Point2f> loaded;
+                              CHECK(load_keypoints(path, loaded, pool));
+                              CHECK(SamePoints(loaded, pts));
+                          }
+
+                          ThreadPool pool(2);
+                          std::vector<cv::Point2f> parsed;
+                          // Numbers run together or followed by junk are rejected
+                          for (const char* bad :
+                               {"12.5,oops\n", "1-2\n", "1.5.5\n", "3\n", "1,2x\n"}) {
+                              const std::string broken = text + bad;
+                              WriteBytes(path, std::vector<char>(broken.begin(), broken.end()));
+                              CHECK(!parse_keypoints_text(path, parsed, pool));
+                          }
+                          std::remove(path.c_str());
+                          CHECK(!load_keypoints(path, parsed, pool));
+                      }});
+}
+
+/* Frame logs read back in order through their index, and an index entry
+ * that points outside the frame data is caught when its frame is read
+ */
+static void AddFrameLogChecks(std::vector<Check>& checks) {
+    checks.push_back({"frame_log/index", [] {
+                          const std::string path = TempPath("frames.log");
+                          const std::vector<cv::Point2f> pts = RandomPoints(40);
+                          FrameLogWriter writer;
+                          CHECK(writer.open(path));
+                          for (u64 i = 0; i < 8; ++i) {
+                              CHECK(writer.append(i * 1000, pts.data(), i * 5));
+                          }
+                          CHECK(writer.close());
+                          const std::vector<char> good = ReadBytes(path);
+                          FrameLogHeader header;
+                          memcpy(&header, good.data(), sizeof(header));
+                          auto read_all = [&path](size_t& frames, size_t& points) {
+                              FrameLogReader log;
+                              frames = points = 0;
+                              if (!log.open(path)) return false;
+                              FrameView frame;
+                              while (log.next(frame)) {
+                                  ++frames;
+                                  points += frame.count;
+                              }
+                              return true;
+                          };
+                          size_t frames;
+                          size_t points;
+                          CHECK(read_all(frames, points));
+                          CHECK(frames == 8 && points == 140);
+                          FrameLogReader log;
+                          CHECK(log.open(path));
+                          CHECK(log.find(2500) == 3);
+                          CHECK(log.frame(7).count == 35);
+                          const FrameView last = log.frame(7);
+                          CHECK(memcmp(last.points, pts.data(), 35 * sizeof(pts[0])) == 0);
+                          log.close();
+
+                          // Entry 3 points far past the file: reading stops before it
+                          std::vector<char> bytes = good;
+                          FrameLogEntry entry;
+                          const size_t at = header.index_offset + 3 * sizeof(entry);
+                          memcpy(&entry, &bytes[at], sizeof(entry));
+                          entry.offset = (u64)1 << 40;
+                          memcpy(&bytes[at], &entry, sizeof(entry));
+                          WriteBytes(path, bytes);
+                          CHECK(read_all(frames, points));
+                          CHECK(frames == 3 && points == 15);
+                          CHECK(log.open(path));
+                          CHECK(log.frame(3).points == nullptr);
+                          CHECK(log.frame(4).count == 20);
+                          log.close();
+
+                          // The last frame claims more points than there are:
+                          // the index is not trusted and the frames are scanned
+                          bytes = good;
+                          const size_t last_at = header.index_offset + 7 * sizeof(entry);
+                          memcpy(&entry, &bytes[last_at], sizeof(entry));
+                          FrameRecord record;
+                          memcpy(&record, &bytes[entry.offset], sizeof(record));
+                          record.count = 1u << 30;
+                          memcpy(&bytes[entry.offset], &record, sizeof(record));
+                          WriteBytes(path, bytes);
+                          CHECK(read_all(frames, points));
+                          CHECK(frames == 7 && points == 105);
+                          std::remove(path.c_str());
+                      }});
+}
+
+// Points of frame `seq`, each identifying its frame and position
+static cv::Point2f FramePoint(const u32 seq, const u32 i) {
+    return cv::Point2f((float)seq, (float)i);
+}
+
+/* Frames cross a shared-memory ring between two threads complete and in
+ * order, through both sides' waits; timeouts, transforms and frames that
+ * claim more points than a slot holds behave
+ */
+static void AddShmRingChecks(std::vector<Check>& checks) {
+    checks.push_back({"shm_ring/transfer", [] {
+                          static const u32 kFrames = 100000;
+                          static const u32 kMaxPoints = 64;
+                          const std::string name = "/transform_check_" + std::to_string(getpid());
+                          ShmRing producer;
+                          CHECK(producer.create(name, 4, kMaxPoints));
+                          CHECK(producer.slots() == 4);
+                          ShmRing consumer;
+                          CHECK(consumer.attach(name));
+                          CHECK(consumer.max_points() == kMaxPoints);
+                          CHECK(consumer.peek(1000000) == nullptr);
+
+                          std::thread writer([&producer] {
+                              for (u32 seq = 0; seq < kFrames; ++seq) {
+                                  ShmFrame* frame = producer.acquire();
+                                  frame->timestamp_ns = seq;
+                                  frame->count = seq % (kMaxPoints + 1);
+                                  for (u32 i = 0; i < frame->count; ++i) {
+                                      frame->points()[i] = FramePoint(seq, i);
+                                  }
+                                  if (seq % 3 == 0) {
+                                      frame->set_transform(
+                                          Transform2d().rotate_ccw_deg(seq % 360).translate(
+                                              seq, -1.0f));
+                                  }
+                                  producer.publish();
+                              }
+                          });
+                          u32 in_order = 0;
+                          bool intact = true;
+                          for (u32 seq = 0; seq < kFrames; ++seq) {
+                              const ShmFrame* frame = consumer.peek();
+                              in_order += frame->timestamp_ns == seq;
+                              intact &= frame->count == seq % (kMaxPoints + 1) &&
+                                        ((frame->flags & kFrameHasTransform) != 0) ==
+                                            (seq % 3 == 0);
+                              for (u32 i = 0; intact && i < frame->count; ++i) {
+                                  intact = frame->points()[i] == FramePoint(seq, i);
+                              }
+                              consumer.release();
+                          }
+                          writer.join();
+                          CHECK(in_order == kFrames);
+                          CHECK(intact);
+                          CHECK(consumer.available() == 0);
+                      }});
+    checks.push_back({"shm_ring/full_and_transform", [] {
+                          const std::string name = "/transform_check_" + std::to_string(getpid());
+                          ShmRing producer;
+                          CHECK(producer.create(name, 2, 8));
+                          for (int i = 0; i < 2; ++i) {
+                              ShmFrame* frame = producer.acquire(0);
+                              CHECK(frame != nullptr);
+                              if (frame == nullptr) return;
+                              frame->count = 8;
+                              for (u32 k = 0; k < 8; ++k) {
+                                  frame->points()[k] = cv::Point2f(k * 1.5f, k * -2.0f);
+                              }
+                              if (i == 1) {
+                                  frame->set_transform(
+                                      Transform2d().rotate_ccw_deg(30.0f).translate(7.0f, 9.0f));
+                              }
+                              producer.publish();
+                          }
+                          // Full: the producer times out instead of overwriting
+                          CHECK(producer.acquire(1000000) == nullptr);
+
+                          ShmRing consumer;
+                          CHECK(consumer.attach(name));
+                          CHECK(consumer.available() == 2);
+                          ShmFrame* plain = consumer.peek(0);
+                          CHECK(!(plain->flags & kFrameHasTransform));
+                          consumer.release();
+
+                          // Mapped in place by the batch kernel, as the
+                          // single-point mapping would up to rounding
+                          ShmFrame* frame = consumer.peek(0);
+                          CHECK((frame->flags & kFrameHasTransform) != 0);
+                          const Transform2d xform = frame->transform();
+                          const Transform2d sent =
+                              Transform2d().rotate_ccw_deg(30.0f).translate(7.0f, 9.0f);
+                          CHECK(SameAffine(xform.matrix(), sent.matrix()));
+                          CHECK(SameAffine(xform.inverse(), sent.inverse()));
+                          std::vector<cv::Point2f> expected;
+                          for (u32 k = 0; k < frame->count; ++k) {
+                              expected.push_back(xform.local_to_world(frame->points()[k]));
+                          }
+                          xform.local_to_world(frame->points(), frame->points(), frame->count);
+                          bool close = true;
+                          for (u32 k = 0; k < frame->count; ++k) {
+                              const cv::Point2f d = frame->points()[k] - expected[k];
+                              close &= std::hypot(d.x, d.y) < 1e-4f;
+                          }
+                          CHECK(close);
+                          consumer.release();
+
+                          // A count past the slot is cut to the slot's points
+                          ShmFrame* bad = producer.acquire(0);
+                          CHECK(bad != nullptr);
+                          if (bad == nullptr) return;
+                          bad->count = 0xffffffffu;
+                          producer.publish();
+                          CHECK(consumer.peek(0)->count == consumer.max_points());
+                          consumer.release();
+                          producer.close();
+                          CHECK(!consumer.attach(name));
+                      }});
+}
+
+/* Non-finite and extreme points neither break the grid nor show up in
+ * finite queries
+ */
+static void AddPointGridChecks(std::vector<Check>& checks) {
+    checks.push_back({"point_grid/non_finite", [] {
+                          const float inf = std::numeric_limits<float>::infinity();
+                          const float nan = std::numeric_limits<float>::quiet_NaN();
+                          const std::vector<cv::Point2f> pts = {
+                              {nan, nan}, {1.0f, 1.0f}, {inf, -inf}, {2.0f, 3.0f}, {nan, 2.0f}};
+                          PointGrid grid;
+                          grid.build(pts);
+                          CHECK(grid.size() == pts.size());
+                          const cv::Rect2f bounds = grid.bounds();
+                          CHECK(bounds.x == 1.0f && bounds.y == 1.0f && bounds.width == 1.0f &&
+                                bounds.height == 2.0f);
+                          std::vector<u32> found;
+                          grid.query_rect(cv::Rect2f(-1e30f, -1e30f, 2e30f, 2e30f), found);
+                          std::sort(found.begin(), found.end());
+                          CHECK(found == std::vector<u32>({1, 3}));
+                          u32 slot = 0;
+                          CHECK(grid.nearest({1.9f, 2.9f}, slot) && grid.sorted_ids()[slot] == 3);
+                          CHECK(!grid.nearest({nan, 0.0f}, slot));
+                          CHECK(grid.nearest({-1e18f, 1e18f}, slot));
+
+                          // Points a whole float range apart, and no finite point at all
+                          grid.build({{-FLT_MAX, -FLT_MAX}, {FLT_MAX, FLT_MAX}, {0.0f, 0.0f}});
+                          found.clear();
+                          grid.query_rect(cv::Rect2f(-1.0f, -1.0f, 2.0f, 2.0f), found);
+                          CHECK(found == std::vector<u32>({2}));
+                          grid.build({{nan, 1.0f}, {inf, inf}});
+                          CHECK(grid.size() == 2 && !grid.nearest({0.0f, 0.0f}, slot));
+                      }});
+}
+
+/* A known homography is recovered from noisy correspondences, through
+ * outliers with RANSAC; collinear input is refused rather than fitted
+ */
+static void AddHomographyChecks(std::vector<Check>& checks) {
+    checks.push_back({"homography/recover", [] {
+                          // Row-major [0.9 0.1 20; -0.05 1.1 -10; 1e-4 -5e-5 1]
+                          const Homography2d truth(SqMatrix3{
+                              0.9f, -0.05f, 1e-4f, 0.1f, 1.1f, -5e-5f, 20.0f, -10.0f, 1.0f});
+                          static const size_t kPairs = 400;
+                          std::mt19937 rng(5);
+                          std::uniform_real_distribution<float> coord(0.0f, 1000.0f);
+                          std::normal_distribution<float> noise(0.0f, 0.5f);
+                          std::vector<cv::Point2f> local(kPairs);
+                          std::vector<cv::Point2f> world(kPairs);
+                          std::vector<u8> outlier(kPairs, 0);
+                          std::vector<cv::Point2f> clean_local;
+                          std::vector<cv::Point2f> clean_world;
+                          for (size_t i = 0; i < kPairs; ++i) {
+                              local[i] = cv::Point2f(coord(rng), coord(rng));
+                              // Every third pair is an outlier anywhere in the image
+                              outlier[i] = i % 3 == 0;
+                              if (outlier[i]) {
+                                  world[i] = cv::Point2f(coord(rng), coord(rng));
+                              } else {
+                                  world[i] = truth.local_to_world(local[i]) +
+                                             cv::Point2f(noise(rng), noise(rng));
+                                  clean_local.push_back(local[i]);
+                                  clean_world.push_back(world[i]);
+                              }
+                          }
+                          // Largest distance from the true mapping over the image
+                          auto error = [&truth](const Homography2d& fit) {
+                              float worst = 0.0f;
+                              for (float y = 0.0f; y <= 1000.0f; y += 50.0f) {
+                                  for (float x = 0.0f; x <= 1000.0f; x += 50.0f) {
+                                      const cv::Point2f d = fit.local_to_world({x, y}) -
+                                                            truth.local_to_world({x, y});
+                                      worst = std::max(worst, std::hypot(d.x, d.y));
+                                  }
+                              }
+                              return worst;
+                          };
+
+                          const Homography2d dlt =
+                              Homography2d::from_correspondences(clean_local, clean_world);
+                          CHECK(error(dlt) < 0.5f);
+                          // Outliers drag the plain fit off; RANSAC sets them aside
+                          CHECK(error(Homography2d::from_correspondences(local, world)) > 5.0f);
+                          for (const size_t threads : {(size_t)1, (size_t)4}) {
+                              ThreadPool pool(threads);
+                              std::vector<u8> mask;
+                              const Homography2d robust = Homography2d::from_correspondences_ransac(
+                                  local, world, RansacParams(), &mask, pool);
+                              CHECK(error(robust) < 0.5f);
+                              size_t misclassified = 0;
+                              for (size_t i = 0; i < kPairs; ++i) {
+                                  misclassified += mask.size() == kPairs && mask[i] == outlier[i];
+                              }
+                              CHECK(mask.size() == kPairs && misclassified <= 2);
+                          }
+
+                          // Four exact pairs determine the homography
+                          const std::vector<cv::Point2f> corners = {
+                              {0.0f, 0.0f}, {1000.0f, 0.0f}, {0.0f, 1000.0f}, {1000.0f, 1000.0f}};
+                          std::vector<cv::Point2f> mapped(4);
+                          truth.local_to_world(corners.data(), mapped.data(), 4);
+                          CHECK(error(Homography2d::from_correspondences(corners, mapped)) < 0.05f);
+                      }});
+    checks.push_back({"homography/degenerate", [] {
+                          std::vector<cv::Point2f> local;
+                          std::vector<cv::Point2f> world;
+                          for (int i = 0; i < 50; ++i) {
+                              local.push_back(cv::Point2f(i * 10.37f, i * 5.11f + 3.0f));
+                              world.push_back(cv::Point2f(i * 7.0f + 1.0f, i * 2.0f));
+                          }
+                          auto throws = [](const std::function<void()>& fit, bool invalid) {
+                              try {
+                                  fit();
+                              } catch (const std::invalid_argument&) {
+                                  return invalid;
+                              } catch (const std::runtime_error&) {
+                                  return !invalid;
+                              }
+                              return false;
+                          };
+                          CHECK(throws([&] { Homography2d::from_correspondences(local, world); },
+                                       false));
+                          CHECK(throws(
+                              [&] { Homography2d::from_correspondences_ransac(local, world); },
+                              false));
+                          // Collinear on the world side only: no sample is usable
+                          for (int i = 0; i < 50; ++i) {
+                              local[i] = cv::Point2f((i % 7) * 100.0f, (i / 7) * 100.0f);
+                          }
+                          CHECK(throws(
+                              [&] { Homography2d::from_correspondences_ransac(local, world); },
+                              false));
+                          // Too few pairs, or counts that differ
+                          local.resize(3);
+                          world.resize(3);
+                          CHECK(throws([&] { Homography2d::from_correspondences(local, world); },
+                                       true));
+                          local.resize(5, cv::Point2f(1.0f, 2.0f));
+                          CHECK(throws([&] { Homography2d::from_correspondences(local, world); },
+                                       true));
+                      }});
+}
+
+/* Histogram buckets tile the value range and report quantiles within their
+ * promised error; counters outlive the threads that recorded them; the
+ * exposition text has the Prometheus shape
+ */
+static void AddMetricsChecks(std::vector<Check>& checks) {
+    checks.push_back({"metrics/buckets", [] {
+                          // Every bucket holds exactly the values from its low to
+                          // its high bound, and the next one starts right after
+                          bool tiled = histogram_bucket_low(0) == 0;
+                          for (size_t b = 0; b < kHistogramBuckets; ++b) {
+                              const u64 low = histogram_bucket_low(b);
+                              const u64 high = histogram_bucket_high(b);
+                              tiled &= low <= high && histogram_bucket(low) == b &&
+                                       histogram_bucket(high) == b;
+                              if (b + 1 < kHistogramBuckets) {
+                                  tiled &= histogram_bucket_low(b + 1) == high + 1;
+                              }
+                          }
+                          CHECK(tiled);
+                          // Powers of two and their neighbours land in a bucket
+                          // that holds them, no wider than 1/16 of its low bound
+                          bool holds = true;
+                          for (int bit = 0; bit < kHistogramMaxBits; ++bit) {
+                              const u64 power = (u64)1 << bit;
+                              for (const u64 value : {power - 1, power, power + 1}) {
+                                  const size_t b = histogram_bucket(value);
+                                  const u64 low = histogram_bucket_low(b);
+                                  const u64 high = histogram_bucket_high(b);
+                                  holds &= low <= value && value <= high;
+                                  holds &= (high - low) * 16 <= low;
+                              }
+                              holds &= histogram_bucket_low(histogram_bucket(power)) == power;
+                          }
+                          CHECK(holds);
+                          // Past the range everything goes to the last bucket
+                          const u64 top = histogram_bucket_high(kHistogramBuckets - 1);
+                          CHECK(top == ((u64)1 << kHistogramMaxBits) - 1);
+                          CHECK(histogram_bucket(top + 1) == kHistogramBuckets - 1);
+                          CHECK(histogram_bucket((u64)1 << 50) == kHistogramBuckets - 1);
+                          CHECK(histogram_bucket(~(u64)0) == kHistogramBuckets - 1);
+                      }});
+    checks.push_back({"metrics/quantiles", [] {
+                          const MetricHistogram histogram =
+                              MetricsRegistry::global().histogram(
+                                  "check_uniform", "Values 1 to 100000");
+                          static const u64 kValues = 100000;
+                          for (u64 value = 1; value <= kValues; ++value) {
+                              histogram.record(value);
+                          }
+                          const MetricsSnapshot snapshot = MetricsRegistry::global().snapshot();
+                          const HistogramSnapshot* uniform = nullptr;
+                          for (const HistogramSnapshot& h : snapshot.histograms) {
+                              if (h.name == "check_uniform") uniform = &h;
+                          }
+                          CHECK(uniform != nullptr);
+                          if (uniform == nullptr) return;
+                          CHECK(uniform->count == kValues);
+                          CHECK(uniform->sum == kValues * (kValues + 1) / 2);
+                          for (const double q : {0.01, 0.1, 0.5, 0.9, 0.99, 0.999}) {
+                              const double expected = q * kValues;
+                              const double error =
+                                  std::fabs((double)uniform->quantile(q) - expected) / expected;
+                              CHECK(error < 0.06);
+                          }
+                          CHECK(uniform->quantile(0.0) == 1);
+                          CHECK(uniform->quantile(1.0) >= kValues * 94 / 100);
+                          const HistogramSnapshot empty = {"", "", "", 0, 0, {}};
+                          CHECK(empty.quantile(0.5) == 0);
+                      }});
+    checks.push_back({"metrics/thread_exit", [] {
+                          const MetricCounter counter = MetricsRegistry::global().counter(
+                              "check_thread_exit_total", "Added by exiting threads");
+                          auto value = [] {
+                              for (const CounterSnapshot& c :
+                                   MetricsRegistry::global().snapshot().counters) {
+                                  if (c.name == "check_thread_exit_total") return c.value;
+                              }
+                              return ~(u64)0;
+                          };
+                          counter.add(2);
+                          std::thread([&counter] { counter.add(5); }).join();
+                          CHECK(value() == 7);
+                          // The next thread reuses the shard, which starts empty
+                          std::thread([&counter] { counter.add(3); }).join();
+                          CHECK(value() == 10);
+                          std::thread([&counter, &value] {
+                              counter.add(1);
+                              CHECK(value() == 11);
+                          }).join();
+                          CHECK(value() == 11);
+                      }});
+    checks.push_back({"metrics/prometheus", [] {
+                          MetricsSnapshot snapshot;
+                          snapshot.counters.push_back({"check_total", "Checks", "path=\"a\"", 3});
+                          snapshot.counters.push_back({"check_total", "Checks", "path=\"b\"", 4});
+                          snapshot.counters.push_back({"check_other_total", "Other", "", 0});
+                          std::vector<u64> buckets(kHistogramBuckets, 0);
+                          buckets[histogram_bucket(5)] = 2;
+                          snapshot.histograms.push_back(
+                              {"check_seconds", "Latency", "kernel=\"soa\"", 2, 10, buckets});
+                          const std::string expected =
+                              "# HELP check_total Checks\n"
+                              "# TYPE check_total counter\n"
+                              "check_total{path=\"a\"} 3\n"
+                              "check_total{path=\"b\"} 4\n"
+                              "# HELP check_other_total Other\n"
+                              "# TYPE check_other_total counter\n"
+                              "check_other_total 0\n"
+                              "# HELP check_seconds Latency\n"
+                              "# TYPE check_seconds summary\n"
+                              "check_seconds{kernel=\"soa\",quantile=\"0.5\"} 5e-09\n"
+                              "check_seconds{kernel=\"soa\",quantile=\"0.9\"} 5e-09\n"
+                              "check_seconds{kernel=\"soa\",quantile=\"0.99\"} 5e-09\n"
+                              "check_seconds{kernel=\"soa\",quantile=\"0.999\"} 5e-09\n"
+                              "check_seconds_sum{kernel=\"soa\"} 1e-08\n"
+                              "check_seconds_count{kernel=\"soa\"} 2\n";
+                          const std::string text = snapshot.to_prometheus();
+                          CHECK(text == expected);
+                          if (text != expected) printf("%s", text.c_str());
+                      }});
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--filter substr]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<Check> checks;
+    AddTransformFileChecks(checks);
+    AddTextChecks(checks);
+    AddKeypointFileChecks(checks);
+    AddFrameLogChecks(checks);
+    AddShmRingChecks(checks);
+    AddPointGridChecks(checks);
+    AddHomographyChecks(checks);
+    AddMetricsChecks(checks);
+    size_t run = 0;
+    for (const Check& check : checks) {
+        if (check.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        const int before = failures;
+        check.run();
+        printf("%-40s %s\n", check.name.c_str(), failures == before ? "ok" : "FAILED");
+        ++run;
+    }
+    printf("%zu check(s), %d failure(s)\n", run, failures);
+    return failures == 0 ? 0 : 1;
+}
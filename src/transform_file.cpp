@@ -0,0 +1,271 @@
+#include "transform_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+static const u64 kChecksumPrime = 0x9E3779B97F4A7C15ull;
+static const u64 kChecksumSeed[4] = {
+    0x243F6A8885A308D3ull,
+    0x13198A2E03707344ull,
+    0xA4093822299F31D0ull,
+    0x082EFA98EC4E6C89ull,
+};
+
+AffineRows AffineRows::from_matrix(const SqMatrix3& m) {
+    return AffineRows{m[0], m[3], m[6], m[1], m[4], m[7]};
+}
+
+SqMatrix3 AffineRows::to_matrix() const {
+    return SqMatrix3{
+        // clang-format off
+        this->xi, this->xj, 0.0f,
+        this->yi, this->yj, 0.0f,
+        this->Ti, this->Tj, 1.0f,
+        // clang-format on
+    };
+}
+
+cv::Point2f AffineRows::apply(const cv::Point2f& pt) const {
+    return cv::Point2f(
+        this->xi * pt.x + this->yi * pt.y + this->Ti,
+        this->xj * pt.x + this->yj * pt.y + this->Tj);
+}
+
+static inline u64 Rotl(const u64 v, const int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline u64 ChecksumStep(const u64 lane, const u64 word) {
+    return Rotl(lane ^ word, 29) * kChecksumPrime;
+}
+
+/* Fold `n` 8-byte words into the four checksum lanes, starting at `lane`
+ *
+ * Word i goes to lane (start + i) % 4, so the lanes are independent
+ * dependency chains and the loop runs at several bytes per cycle.  Returns the
+ * lane of the next word.
+ */
+static size_t ChecksumWords(u64 lanes[4], size_t lane, const u8* bytes, size_t n) {
+    size_t i = 0;
+    for (; i < n && lane != 0; ++i, lane = (lane + 1) & 3) {
+        u64 w;
+        memcpy(&w, bytes + i * 8, 8);
+        lanes[lane] = ChecksumStep(lanes[lane], w);
+    }
+    u64 l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+    for (; i + 4 <= n; i += 4) {
+        u64 w[4];
+        memcpy(w, bytes + i * 8, 32);
+        l0 = ChecksumStep(l0, w[0]);
+        l1 = ChecksumStep(l1, w[1]);
+        l2 = ChecksumStep(l2, w[2]);
+        l3 = ChecksumStep(l3, w[3]);
+    }
+    lanes[0] = l0, lanes[1] = l1, lanes[2] = l2, lanes[3] = l3;
+    for (; i < n; ++i, lane = (lane + 1) & 3) {
+        u64 w;
+        memcpy(&w, bytes + i * 8, 8);
+        lanes[lane] = ChecksumStep(lanes[lane], w);
+    }
+    return lane;
+}
+
+static u64 ChecksumFinish(const u64 lanes[4], const u64 n) {
+    u64 h = n * kChecksumPrime;
+    for (int k = 0; k < 4; ++k) {
+        h = Rotl(h, 17) ^ lanes[k];
+        h *= kChecksumPrime;
+    }
+    return h ^ (h >> 32);
+}
+
+u64 transform_checksum(const void* data, const size_t n) {
+    u64 lanes[4];
+    memcpy(lanes, kChecksumSeed, sizeof(lanes));
+    ChecksumWords(lanes, 0, (const u8*)data, n / 8);
+    return ChecksumFinish(lanes, n);
+}
+
+static TransformFileHeader MakeHeader(const bool with_inverse) {
+    TransformFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kTransformFileMagic, sizeof(header.magic));
+    header.version = kTransformFileVersion;
+    header.flags = with_inverse ? kHasInverse : 0;
+    header.stride = (u32)(sizeof(AffineRows) * (with_inverse ? 2 : 1));
+    return header;
+}
+
+TransformWriter::TransformWriter()
+    : file(nullptr), with_inverse(false), failed(false), count(0), lane(0) {
+    memcpy(this->lanes, kChecksumSeed, sizeof(this->lanes));
+}
+
+TransformWriter::~TransformWriter() { this->close(); }
+
+bool TransformWriter::open(const std::string& path, const bool with_inverse) {
+    this->close();
+    this->file = std::fopen(path.c_str(), "wb");
+    if (this->file == nullptr) {
+        return false;
+    }
+    this->with_inverse = with_inverse;
+    this->failed = false;
+    this->count = 0;
+    this->lane = 0;
+    memcpy(this->lanes, kChecksumSeed, sizeof(this->lanes));
+    // Placeholder with a count of 0 until close()
+    TransformFileHeader header = MakeHeader(with_inverse);
+    this->failed = std::fwrite(&header, sizeof(header), 1, this->file) != 1;
+    return !this->failed;
+}
+
+bool TransformWriter::append(const Transform2d& tform) {
+    return this->append(&tform, 1);
+}
+
+bool TransformWriter::append(const Transform2d* tforms, const size_t n) {
+    if (this->file == nullptr || this->failed) {
+        return false;
+    }
+    // Records are staged in a small stack buffer between fwrite calls
+    AffineRows buffer[256];
+    const size_t per_record = this->with_inverse ? 2 : 1;
+    const size_t batch = 256 / per_record;
+    for (size_t first = 0; first < n; first += batch) {
+        const size_t m = std::min(batch, n - first);
+        for (size_t i = 0; i < m; ++i) {
+            const Transform2d& tform = tforms[first + i];
+            buffer[i * per_record] = AffineRows::from_matrix(tform.matrix());
+            if (this->with_inverse) {
+                buffer[i * per_record + 1] =
+                    AffineRows::from_matrix(tform.inverse());
+            }
+        }
+        const size_t rows = m * per_record;
+        if (std::fwrite(buffer, sizeof(AffineRows), rows, this->file) != rows) {
+            this->failed = true;
+            return false;
+        }
+        this->lane = ChecksumWords(
+            this->lanes, this->lane, (const u8*)buffer, rows * sizeof(AffineRows) / 8);
+        this->count += m;
+    }
+    return true;
+}
+
+bool TransformWriter::close() {
+    if (this->file == nullptr) {
+        return !this->failed;
+    }
+    TransformFileHeader header = MakeHeader(this->with_inverse);
+    header.count = this->count;
+    header.checksum = ChecksumFinish(this->lanes, this->count * header.stride);
+    if (std::fseek(this->file, 0, SEEK_SET) != 0 ||
+        std::fwrite(&header, sizeof(header), 1, this->file) != 1) {
+        this->failed = true;
+    }
+    if (std::fclose(this->file) != 0) {
+        this->failed = true;
+    }
+    this->file = nullptr;
+    return !this->failed;
+}
+
+size_t TransformWriter::size() const { return this->count; }
+
+TransformFile::TransformFile()
+    : base(nullptr),
+      length(0),
+      records(nullptr),
+      stride(0),
+      count(0),
+      inverse(false) {}
+
+TransformFile::~TransformFile() { this->close(); }
+
+bool TransformFile::open(const std::string& path, const bool verify) {
+    this->close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TransformFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    const size_t length = (size_t)st.st_size;
+    void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    this->base = (const u8*)map;
+    this->length = length;
+
+    TransformFileHeader header;
+    memcpy(&header, this->base, sizeof(header));
+    const bool with_inverse = (header.flags & kHasInverse) != 0;
+    const size_t body = length - sizeof(header);
+    bool ok = memcmp(header.magic, kTransformFileMagic, sizeof(header.magic)) == 0 &&
+              header.version == kTransformFileVersion &&
+              (header.flags & ~kHasInverse) == 0 &&
+              header.stride == MakeHeader(with_inverse).stride &&
+              header.count <= body / header.stride;
+    if (ok && verify) {
+        if (header.count * header.stride > (1u << 20)) {
+            madvise(map, length, MADV_SEQUENTIAL);
+        }
+        ok = transform_checksum(
+                 this->base + sizeof(header), header.count * header.stride) ==
+             header.checksum;
+    }
+    if (!ok) {
+        this->close();
+        return false;
+    }
+    this->records = this->base + sizeof(header);
+    this->stride = header.stride;
+    this->count = header.count;
+    this->inverse = with_inverse;
+    return true;
+}
+
+void TransformFile::close() {
+    if (this->base != nullptr) {
+        munmap((void*)this->base, this->length);
+    }
+    this->base = nullptr;
+    this->length = 0;
+    this->records = nullptr;
+    this->stride = 0;
+    this->count = 0;
+    this->inverse = false;
+}
+
+size_t TransformFile::size() const { return this->count; }
+
+bool TransformFile::has_inverse() const { return this->inverse; }
+
+const AffineRows& TransformFile::rows(const size_t i) const {
+    return *(const AffineRows*)(this->records + i * this->stride);
+}
+
+const AffineRows& TransformFile::inverse_rows(const size_t i) const {
+    return *(const AffineRows*)(this->records + i * this->stride +
+                                sizeof(AffineRows));
+}
+
+Transform2d TransformFile::at(const size_t i) const {
+    if (this->inverse) {
+        return Transform2d(
+            this->rows(i).to_matrix(), this->inverse_rows(i).to_matrix());
+    }
+    return Transform2d(this->rows(i).to_matrix());
+}